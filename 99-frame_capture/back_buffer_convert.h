@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include "half_float.h"
+
+// Back buffers in their native format turned into the half float B, G and R planes of an EXR, linear if asked for.
+// Every channel value is looked up in a table that maps its code straight to the half of the linear value, one per format and transfer function,
+// for 8 and 10 bit channels as well as for half floats. A 4K frame then takes three loads and three stores per pixel.
+
+enum class back_buffer_layout
+{
+	rgba8,
+	bgra8,
+	rgb10a2,
+	bgr10a2,
+	rgba16f
+};
+
+enum class transfer_function : int
+{
+	automatic, // sRGB for 8 bit, PQ for 10 bit, scRGB half floats are linear already
+	none, // Values as they are stored
+	srgb,
+	pq
+};
+
+inline constexpr const char *transfer_function_names[] = { "Automatic", "None, as stored", "sRGB to linear", "PQ (HDR10) to linear" };
+
+// Scale of the linear values, 1.0 is 80 nits like in scRGB, so PQ and half float back buffers come out alike
+static constexpr double pq_nits_per_unit = 80.0;
+
+inline double srgb_to_linear(double v)
+{
+	return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+}
+
+// SMPTE ST 2084 EOTF, to nits
+inline double pq_to_nits(double v)
+{
+	const double m1 = 2610.0 / 16384.0, m2 = 2523.0 / 4096.0 * 128.0, c1 = 3424.0 / 4096.0, c2 = 2413.0 / 4096.0 * 32.0, c3 = 2392.0 / 4096.0 * 32.0;
+	const double p = std::pow(std::max(v, 0.0), 1.0 / m2);
+	return 10000.0 * std::pow(std::max(p - c1, 0.0) / (c2 - c3 * p), 1.0 / m1);
+}
+
+inline transfer_function resolve_transfer(back_buffer_layout layout, transfer_function transfer)
+{
+	if (transfer != transfer_function::automatic)
+		return transfer;
+	switch (layout)
+	{
+	case back_buffer_layout::rgb10a2:
+	case back_buffer_layout::bgr10a2:
+		return transfer_function::pq;
+	case back_buffer_layout::rgba16f:
+		return transfer_function::none;
+	default:
+		return transfer_function::srgb;
+	}
+}
+
+// Code of a channel to the half of its linear value. Tables are built on first use and kept, the largest one, for half floats, has 128 KB.
+inline const uint16_t *transfer_table(back_buffer_layout layout, transfer_function transfer)
+{
+	static std::unique_ptr<uint16_t[]> tables[3][3];
+	static std::mutex mutex;
+
+	const int bits_index = layout == back_buffer_layout::rgba16f ? 2 : layout == back_buffer_layout::rgba8 || layout == back_buffer_layout::bgra8 ? 0 : 1;
+	const int transfer_index = static_cast<int>(transfer) - 1;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unique_ptr<uint16_t[]> &table = tables[bits_index][transfer_index];
+	if (table == nullptr)
+	{
+		const uint32_t count = bits_index == 0 ? 256 : bits_index == 1 ? 1024 : 65536;
+		table.reset(new uint16_t[count]);
+		for (uint32_t code = 0; code < count; ++code)
+		{
+			const double value = bits_index == 2 ? half_to_float(static_cast<uint16_t>(code)) : static_cast<double>(code) / (count - 1);
+			// Half floats may be negative or not finite, the curves are applied to the magnitude
+			double linear = value;
+			if (std::isfinite(value) && transfer == transfer_function::srgb)
+				linear = std::copysign(srgb_to_linear(std::fabs(value)), value);
+			else if (std::isfinite(value) && transfer == transfer_function::pq)
+				linear = std::copysign(pq_to_nits(std::fabs(value)) / pq_nits_per_unit, value);
+			table[code] = float_to_half(static_cast<float>(linear));
+		}
+	}
+	return table.get();
+}
+
+// Converts rows that are `row_pitch` bytes apart into B, G and R planes of halfs, alpha is left out like it is for the BMP
+inline void convert_back_buffer(const unsigned char *rows, uint32_t row_pitch, uint32_t width, uint32_t height, back_buffer_layout layout, transfer_function transfer, uint16_t *planes)
+{
+	transfer = resolve_transfer(layout, transfer);
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+	uint16_t *const plane_b = planes, *const plane_g = planes + num_pixels, *const plane_r = planes + num_pixels * 2;
+
+	// Half floats without a curve are copied as they are
+	if (layout == back_buffer_layout::rgba16f && transfer == transfer_function::none)
+	{
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			const uint16_t *const src = reinterpret_cast<const uint16_t *>(rows + static_cast<size_t>(y) * row_pitch);
+			const size_t base = static_cast<size_t>(y) * width;
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				plane_r[base + x] = src[x * 4];
+				plane_g[base + x] = src[x * 4 + 1];
+				plane_b[base + x] = src[x * 4 + 2];
+			}
+		}
+		return;
+	}
+
+	const uint16_t *const table = transfer_table(layout, transfer);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const unsigned char *const row = rows + static_cast<size_t>(y) * row_pitch;
+		const size_t base = static_cast<size_t>(y) * width;
+		switch (layout)
+		{
+		case back_buffer_layout::rgba8:
+		case back_buffer_layout::bgra8:
+		{
+			const int r = layout == back_buffer_layout::rgba8 ? 0 : 2, b = 2 - r;
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				plane_r[base + x] = table[row[x * 4 + r]];
+				plane_g[base + x] = table[row[x * 4 + 1]];
+				plane_b[base + x] = table[row[x * 4 + b]];
+			}
+			break;
+		}
+		case back_buffer_layout::rgb10a2:
+		case back_buffer_layout::bgr10a2:
+		{
+			const int r = layout == back_buffer_layout::rgb10a2 ? 0 : 20, b = 20 - r;
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				uint32_t texel;
+				std::memcpy(&texel, row + x * 4, 4);
+				plane_r[base + x] = table[(texel >> r) & 0x3FF];
+				plane_g[base + x] = table[(texel >> 10) & 0x3FF];
+				plane_b[base + x] = table[(texel >> b) & 0x3FF];
+			}
+			break;
+		}
+		case back_buffer_layout::rgba16f:
+		{
+			const uint16_t *const src = reinterpret_cast<const uint16_t *>(row);
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				plane_r[base + x] = table[src[x * 4]];
+				plane_g[base + x] = table[src[x * 4 + 1]];
+				plane_b[base + x] = table[src[x * 4 + 2]];
+			}
+			break;
+		}
+		}
+	}
+}
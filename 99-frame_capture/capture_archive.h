@@ -0,0 +1,267 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One file for all frames of a sequence instead of thousands of loose ones. The encoded files are appended one after another,
+// each behind a small header, and an index of all entries follows them when the archive is closed.
+// Without that index, after a crash, it is rebuilt from the entry headers.
+
+enum class archive_pass : uint32_t
+{
+	back_buffer,
+	depth,
+	normal,
+	back_buffer_qoi,
+	back_buffer_png,
+	back_buffer_exr
+};
+
+// Suffix of the file an entry stands for, the same names the loose files of a sequence get
+inline constexpr const char *archive_pass_names[] = { "BackBuffer.bmp", "DepthBuffer.exr", "NormalMap.exr", "BackBuffer.qoi", "BackBuffer.png", "BackBuffer.exr" };
+static constexpr uint32_t archive_pass_count = 6;
+
+struct archive_entry
+{
+	uint32_t frame = 0;
+	archive_pass pass = archive_pass::back_buffer;
+	uint64_t offset = 0; // Of the payload
+	uint64_t size = 0; // Zero for a frame that equals the last earlier one of its pass
+	uint64_t timestamp = 0; // Microseconds since the recording started
+};
+
+class capture_archive
+{
+public:
+	~capture_archive()
+	{
+		close();
+	}
+
+	bool create(const std::filesystem::path &path)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		// Entries are at least a few hundred kilobytes, a large buffer turns header and payload into one sequential write
+		_buffer.reset(new char[buffer_size]);
+		_file.rdbuf()->pubsetbuf(_buffer.get(), buffer_size);
+		_file.open(path, std::ios::binary | std::ios::trunc);
+		if (!_file.is_open())
+			return false;
+
+		put(_file, file_magic);
+		put(_file, version);
+		_end = file_header_size;
+		_file.flush();
+		return !!_file;
+	}
+	// Writes the index, the archive is complete afterwards
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_file.is_open())
+			return;
+
+		const uint64_t index_offset = _end;
+		for (const archive_entry &entry : _entries)
+		{
+			put(_file, entry.frame);
+			put(_file, static_cast<uint32_t>(entry.pass));
+			put(_file, entry.offset);
+			put(_file, entry.size);
+			put(_file, entry.timestamp);
+		}
+		put(_file, index_offset);
+		put(_file, static_cast<uint32_t>(_entries.size()));
+		put(_file, index_magic);
+		_file.close();
+	}
+
+	// Called from the capture threads, entries are stored in the order they arrive
+	bool append(uint32_t frame, archive_pass pass, uint64_t timestamp, const void *data, uint64_t size)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_file.is_open())
+			return false;
+
+		archive_entry entry;
+		entry.frame = frame;
+		entry.pass = pass;
+		entry.offset = _end + entry_header_size;
+		entry.size = size;
+		entry.timestamp = timestamp;
+
+		put(_file, entry_magic);
+		put(_file, entry.frame);
+		put(_file, static_cast<uint32_t>(entry.pass));
+		put(_file, static_cast<uint32_t>(0));
+		put(_file, entry.size);
+		put(_file, entry.timestamp);
+		_file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+		// Flushed per entry, so a crash loses at most the entry that was being written
+		_file.flush();
+		if (!_file)
+		{
+			_file.clear();
+			return false;
+		}
+
+		_end = entry.offset + size;
+		_entries.push_back(entry);
+		_bytes += size;
+		return true;
+	}
+
+	size_t entries() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _entries.size();
+	}
+	uint64_t bytes() const { return _bytes.load(); }
+
+	static constexpr uint32_t file_magic = 0x52414346; // "FCAR"
+	static constexpr uint32_t version = 1;
+	static constexpr uint32_t entry_magic = 0x45414346; // "FCAE"
+	static constexpr uint32_t index_magic = 0x58414346; // "FCAX"
+	static constexpr uint64_t file_header_size = sizeof(uint32_t) * 2;
+	static constexpr uint64_t entry_header_size = sizeof(uint32_t) * 4 + sizeof(uint64_t) * 2;
+	static constexpr uint64_t index_entry_size = sizeof(uint32_t) * 2 + sizeof(uint64_t) * 3;
+	static constexpr uint64_t footer_size = sizeof(uint64_t) + sizeof(uint32_t) * 2;
+
+private:
+	static constexpr size_t buffer_size = 4 * 1024 * 1024;
+
+	template <typename T>
+	static void put(std::ofstream &file, const T &value)
+	{
+		file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+
+	mutable std::mutex _mutex;
+	std::unique_ptr<char[]> _buffer;
+	std::ofstream _file;
+	uint64_t _end = 0;
+	std::vector<archive_entry> _entries;
+	std::atomic<uint64_t> _bytes { 0 };
+};
+
+// Lists and reads the entries of an archive, also of one that was never closed
+class archive_reader
+{
+public:
+	bool open(const std::filesystem::path &path)
+	{
+		_file.open(path, std::ios::binary);
+		if (!_file.is_open())
+			return false;
+
+		uint32_t magic = 0, version = 0;
+		get(magic);
+		get(version);
+		if (!_file || magic != capture_archive::file_magic || version != capture_archive::version)
+			return false;
+
+		_file.seekg(0, std::ios::end);
+		_file_size = static_cast<uint64_t>(_file.tellg());
+		_file.clear();
+
+		_recovered = !read_index();
+		if (_recovered)
+			rebuild_index();
+		return true;
+	}
+
+	const std::vector<archive_entry> &entries() const { return _entries; }
+	// True when the index was missing or damaged and was rebuilt from the entry headers
+	bool recovered() const { return _recovered; }
+
+	bool read(const archive_entry &entry, std::vector<unsigned char> &data)
+	{
+		data.resize(static_cast<size_t>(entry.size));
+		_file.clear();
+		_file.seekg(static_cast<std::streamoff>(entry.offset));
+		_file.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(entry.size));
+		return !!_file;
+	}
+
+private:
+	template <typename T>
+	void get(T &value)
+	{
+		_file.read(reinterpret_cast<char *>(&value), sizeof(value));
+	}
+
+	bool read_index()
+	{
+		if (_file_size < capture_archive::file_header_size + capture_archive::footer_size)
+			return false;
+
+		uint64_t index_offset = 0;
+		uint32_t count = 0, magic = 0;
+		_file.seekg(static_cast<std::streamoff>(_file_size - capture_archive::footer_size));
+		get(index_offset);
+		get(count);
+		get(magic);
+		if (!_file || magic != capture_archive::index_magic || index_offset + count * capture_archive::index_entry_size + capture_archive::footer_size != _file_size)
+			return false;
+
+		_file.seekg(static_cast<std::streamoff>(index_offset));
+		_entries.resize(count);
+		for (archive_entry &entry : _entries)
+		{
+			uint32_t pass = 0;
+			get(entry.frame);
+			get(pass);
+			get(entry.offset);
+			get(entry.size);
+			get(entry.timestamp);
+			entry.pass = static_cast<archive_pass>(pass);
+			if (!_file || pass >= archive_pass_count || entry.offset + entry.size > index_offset)
+			{
+				_entries.clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Walks the entry headers from the start, an entry that was cut off and everything after it is left out
+	void rebuild_index()
+	{
+		_entries.clear();
+		_file.clear();
+
+		uint64_t offset = capture_archive::file_header_size;
+		while (offset + capture_archive::entry_header_size <= _file_size)
+		{
+			uint32_t magic = 0, pass = 0, reserved = 0;
+			archive_entry entry;
+			_file.seekg(static_cast<std::streamoff>(offset));
+			get(magic);
+			get(entry.frame);
+			get(pass);
+			get(reserved);
+			get(entry.size);
+			get(entry.timestamp);
+			entry.pass = static_cast<archive_pass>(pass);
+			entry.offset = offset + capture_archive::entry_header_size;
+			if (!_file || magic != capture_archive::entry_magic || pass >= archive_pass_count || entry.offset + entry.size > _file_size)
+				break;
+
+			_entries.push_back(entry);
+			offset = entry.offset + entry.size;
+		}
+		_file.clear();
+	}
+
+	std::ifstream _file;
+	uint64_t _file_size = 0;
+	std::vector<archive_entry> _entries;
+	bool _recovered = false;
+};
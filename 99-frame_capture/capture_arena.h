@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// One block of memory holding every transient host buffer of a capture. It is sized once per resolution,
+// handed out linearly and reset after the capture, so steady state captures neither call the heap nor fault in new pages.
+// Long-lived buffers grow from the bottom, short-lived scratch buffers from the top, so per-chunk temporaries can be
+// popped again while the chunk data below them stays. Requests that do not fit fall back to malloc with the same alignment, those blocks
+// are kept in a list and freed by the next reset like the arena memory, so a caller that never deallocates does not leak them.
+class capture_arena
+{
+public:
+	static constexpr size_t alignment = 64;
+
+	capture_arena() = default;
+	~capture_arena() { release(); }
+
+	capture_arena(const capture_arena &) = delete;
+	capture_arena &operator=(const capture_arena &) = delete;
+
+	// Makes sure the arena can hold at least `size` bytes, only reallocates when growing
+	bool reserve(size_t size)
+	{
+		size = align_up(size + _overflow_bytes, 2 * 1024 * 1024);
+		if (size <= _capacity)
+			return true;
+
+		release();
+
+#ifdef _WIN32
+		// Large pages need SeLockMemoryPrivilege, which most users do not have, so quietly fall back to regular pages
+		const size_t large_page_size = GetLargePageMinimum();
+		if (large_page_size != 0)
+		{
+			const size_t large_size = align_up(size, large_page_size);
+			_base = static_cast<unsigned char *>(VirtualAlloc(nullptr, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+			if (_base != nullptr)
+			{
+				size = large_size;
+				_huge_pages = true;
+			}
+		}
+		if (_base == nullptr)
+			_base = static_cast<unsigned char *>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+		void *const base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base != MAP_FAILED)
+		{
+			_base = static_cast<unsigned char *>(base);
+#ifdef MADV_HUGEPAGE
+			_huge_pages = madvise(base, size, MADV_HUGEPAGE) == 0;
+#endif
+		}
+#endif
+		if (_base == nullptr)
+			return false;
+
+		// Fault every page in now instead of during the capture
+		for (size_t offset = 0; offset < size; offset += 4096)
+			_base[offset] = 0;
+
+		_capacity = size;
+		_overflow_bytes = 0;
+		reset();
+		return true;
+	}
+	void release()
+	{
+		if (_base != nullptr)
+		{
+#ifdef _WIN32
+			VirtualFree(_base, 0, MEM_RELEASE);
+#else
+			munmap(_base, _capacity);
+#endif
+		}
+		_base = nullptr;
+		_capacity = 0;
+		_huge_pages = false;
+		reset();
+	}
+
+	// Allocates a buffer that lives until the next rewind or reset
+	void *allocate(size_t size)
+	{
+		const size_t offset = align_up(_bottom, alignment);
+		if (_base == nullptr || offset + size > _top)
+			return allocate_overflow(size);
+
+		_bottom = offset + size;
+		update_high_water();
+		return _base + offset;
+	}
+	template <typename T>
+	T *allocate(size_t count)
+	{
+		return static_cast<T *>(allocate(count * sizeof(T)));
+	}
+
+	// Allocates a short-lived buffer from the top, which is popped again by deallocate
+	void *allocate_scratch(size_t size)
+	{
+		// Every scratch buffer is preceded by a header that links to the previous top
+		if (_base == nullptr || size > _top || align_down(_top - size, alignment) < align_up(_bottom, alignment) + alignment)
+			return allocate_overflow(size);
+
+		const size_t offset = align_down(_top - size, alignment);
+		scratch_header *const header = reinterpret_cast<scratch_header *>(_base + offset - alignment);
+		header->previous_top = _top;
+		header->released = false;
+
+		_top = offset - alignment;
+		update_high_water();
+		return _base + offset;
+	}
+
+	void deallocate(void *ptr, bool scratch)
+	{
+		if (ptr == nullptr)
+			return;
+		if (!owns(ptr))
+		{
+			free_overflow(reinterpret_cast<overflow_header *>(static_cast<unsigned char *>(ptr) - sizeof(overflow_header)));
+			return;
+		}
+		if (!scratch)
+			return; // Released with the next rewind or reset
+
+		reinterpret_cast<scratch_header *>(static_cast<unsigned char *>(ptr) - alignment)->released = true;
+
+		// Pop every released buffer from the top, which is the common case for vectors freed in reverse order
+		while (_top < _capacity)
+		{
+			const scratch_header *const header = reinterpret_cast<const scratch_header *>(_base + _top);
+			if (!header->released)
+				break;
+			_top = header->previous_top;
+		}
+	}
+
+	bool owns(const void *ptr) const
+	{
+		return ptr >= _base && ptr < _base + _capacity;
+	}
+
+	void reset()
+	{
+		_bottom = 0;
+		_top = _capacity;
+		while (_overflow != nullptr)
+			free_overflow(_overflow);
+	}
+
+	size_t capacity() const { return _capacity; }
+	size_t high_water() const { return _high_water; }
+	bool huge_pages() const { return _huge_pages; }
+
+private:
+	struct scratch_header
+	{
+		size_t previous_top;
+		bool released;
+	};
+	// Right in front of every aligned malloc block, newest first in the list
+	struct overflow_header
+	{
+		overflow_header *previous;
+		overflow_header *next;
+		void *allocation;
+	};
+
+	static size_t align_up(size_t value, size_t align) { return (value + align - 1) & ~(align - 1); }
+	static size_t align_down(size_t value, size_t align) { return value & ~(align - 1); }
+
+	void *allocate_overflow(size_t size)
+	{
+		// Remember how much did not fit, so the next reserve makes room for it
+		_overflow_bytes += align_up(size, alignment);
+		void *const allocation = std::malloc(sizeof(overflow_header) + alignment - 1 + size);
+		if (allocation == nullptr)
+			return nullptr;
+		unsigned char *const ptr = reinterpret_cast<unsigned char *>(align_up(reinterpret_cast<uintptr_t>(allocation) + sizeof(overflow_header), alignment));
+		overflow_header *const header = reinterpret_cast<overflow_header *>(ptr - sizeof(overflow_header));
+		header->previous = nullptr;
+		header->next = _overflow;
+		header->allocation = allocation;
+		if (_overflow != nullptr)
+			_overflow->previous = header;
+		_overflow = header;
+		return ptr;
+	}
+	void free_overflow(overflow_header *header)
+	{
+		if (header->previous != nullptr)
+			header->previous->next = header->next;
+		else
+			_overflow = header->next;
+		if (header->next != nullptr)
+			header->next->previous = header->previous;
+		std::free(header->allocation);
+	}
+	void update_high_water()
+	{
+		const size_t used = _bottom + (_capacity - _top);
+		if (used > _high_water)
+			_high_water = used;
+	}
+
+	unsigned char *_base = nullptr;
+	size_t _capacity = 0;
+	size_t _bottom = 0;
+	size_t _top = 0;
+	size_t _high_water = 0;
+	size_t _overflow_bytes = 0;
+	overflow_header *_overflow = nullptr;
+	bool _huge_pages = false;
+};
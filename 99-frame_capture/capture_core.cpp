@@ -0,0 +1,1895 @@
+/*
+ * Frame Capture Add-on for Reshade 5.0: https://github.com/crosire/reshade
+ */
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+
+#define TINYEXR_IMPLEMENTATION
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include "capture_core.h"
+#include "exr_codec.h"
+#include "content_hash.h"
+#include "dds_writer.h"
+#include "half_float.h"
+#include "plane_extract.h"
+#include "platform.h"
+#include <filesystem>
+#include <stb_image_write.h>
+
+#include "tinyexr.h"
+#include "miniz.c"
+#include "miniz.h"
+
+using namespace reshade::api;
+
+bool enableCapturing = false;
+bool enableDepthExp = false;
+bool enableNormalExp = false;
+
+int exportCompression = static_cast<int>(exr_compression::piz);
+float autoMaxMs = 0.0f;
+int autoMaxMB = 0;
+
+int exportFileType = static_cast<int>(export_file_type::exr);
+int colorFormat = static_cast<int>(color_format::bmp);
+int pngThreads = 4;
+bool npyHalf = false;
+bool npyPreallocate = false;
+bool backBufferExr = false;
+int exportScale = static_cast<int>(export_scale::full);
+int depthReduction = static_cast<int>(depth_reduction::closest);
+bool cropBorders = false;
+bool tiledExr = false;
+int tileSize = 256;
+int backBufferTransfer = static_cast<int>(transfer_function::automatic);
+int regionMode = static_cast<int>(region_mode::full_frame);
+float regionRect[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+int captureMode = static_cast<int>(capture_mode::single);
+int sequenceInterval = 1;
+int burstLength = 60;
+
+int sequenceFormat = static_cast<int>(sequence_format::exr);
+int keyframeInterval = 30;
+bool skipUnchanged = false;
+int streamSlots = 4;
+
+capture_arena captureArenas[capture_queue::max_workers];
+// Scratch memory and cost model of the encoders of every capture thread
+static std::vector<unsigned char> colorBuffers[capture_queue::max_workers];
+static std::vector<png_stripe> pngStripes[capture_queue::max_workers];
+static exr_codec_model codecModels[capture_queue::max_workers];
+// Every arena holds about two raw frames outside the budget, so it is given back once its thread had nothing to encode for a while
+static constexpr double arena_idle_seconds = 5.0;
+static double presentEncodeTime = 0.0;
+
+int encodeThreads = 2;
+int budgetMB = 0;
+float budgetPercent = 25.0f;
+int budgetPolicy = static_cast<int>(budget_policy::block);
+capture_queue captureQueue;
+int workerPriority = static_cast<int>(thread_priority::normal);
+int workerIoPriority = static_cast<int>(io_priority::normal);
+uint64_t workerAffinityMask = 0;
+bool workerPinLeastLoaded = false;
+bool presentEncoding = false;
+int sliceBudgetUs = 2000;
+int sliceBlocks = 0;
+
+bool enableReplay = false;
+float replaySeconds = 10.0f;
+int replayInterval = 1;
+int replayMemoryMB = 2048;
+replay_ring replayRing;
+static std::atomic<size_t> replayJobs(0);
+
+int deferMode = static_cast<int>(defer_mode::off);
+int deferIdleSeconds = 10;
+int deferTargetFps = 0;
+spill_file spillFile;
+static std::atomic<size_t> spillJobs(0);
+bool encoderIdle = false;
+static double frameTimeAvg = 0.0;
+static double lastPresentTime = 0.0;
+double lastOverlayTime = -1.0;
+
+bool eventHooks = false;
+int eventTraceFrames = 600;
+event_trace_writer eventTrace;
+static int eventTraceFramesLeft = 0;
+
+std::filesystem::path saveDirectory;
+
+static void log_to_stderr(int level, const char* message)
+{
+	std::fprintf(stderr, "%s | %s\n", level == 1 ? "ERROR" : level == 2 ? "WARN" : level == 3 ? "INFO" : "DEBUG", message);
+}
+
+void (*captureLog)(int level, const char* message) = log_to_stderr;
+
+sequence_state sequence;
+std::shared_ptr<sequence_writer> sequenceContainers[2];
+std::shared_ptr<capture_archive> sequenceArchive;
+std::shared_ptr<npy_stack> sequenceStacks[2];
+frame_stream frameStream;
+const char* const frameStreamName = "FrameCapture";
+
+capture_trace lastCapture[2];
+std::mutex lastCaptureMutex;
+
+void apply_budget()
+{
+	captureQueue.set_budget(static_cast<uint64_t>(budgetMB) * 1024 * 1024, budgetPercent, static_cast<budget_policy>(budgetPolicy));
+}
+
+void apply_worker_qos()
+{
+	thread_qos qos;
+	qos.priority = static_cast<thread_priority>(workerPriority);
+	qos.io = static_cast<io_priority>(workerIoPriority);
+	qos.affinity_mask = workerAffinityMask;
+	qos.pin_least_loaded = workerPinLeastLoaded;
+	captureQueue.set_qos(qos);
+}
+
+static void release_arenas()
+{
+	for (capture_arena& arena : captureArenas)
+		arena.release();
+}
+
+void start_encoders()
+{
+	captureQueue.stop();
+	release_arenas();
+	captureQueue.set_idle_callback(arena_idle_seconds, [](size_t worker) { captureArenas[worker].release(); });
+	if (!presentEncoding)
+		captureQueue.start(encodeThreads);
+}
+
+double seconds_now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Lives next to the executable like the captures, so frames spilled before a reload are found again
+static std::filesystem::path spill_path()
+{
+	std::filesystem::path path = executable_path();
+	path.replace_filename(L"FrameCapture.spill");
+	return path;
+}
+
+void open_spill_file()
+{
+	if (spillFile.is_open())
+		return;
+	if (!spillFile.open(spill_path()))
+		captureLog(1, "Failed to open spill file for deferred encoding!");
+	else if (spillFile.pending_count() != 0) {
+		char message[96];
+		std::snprintf(message, sizeof(message), "Frame Capture: %u spilled frames are waiting to be encoded", static_cast<uint32_t>(spillFile.pending_count()));
+		captureLog(3, message);
+	}
+}
+
+// Runs on a capture thread, every thread encodes with its own arena and cost model. With an output the file goes there instead of to disk.
+static bool SaveEXR(const unsigned char* planes, bool half, int width, int height, const std::filesystem::path& outfilename, const exr_write_settings& settings, size_t worker, capture_trace& trace,
+	const std::function<bool(const unsigned char*, size_t)>& output = nullptr)
+{
+	if (output ? !encode_exr_planes(planes, half, width, height, settings, captureArenas[worker], codecModels[worker], trace, output) :
+		!write_exr_planes(planes, half, width, height, outfilename, settings, captureArenas[worker], codecModels[worker], trace))
+		return false;
+
+	if (trace.automatic) {
+		char message[256];
+		std::snprintf(message, sizeof(message), "Auto compression picked %s for %s: %s", exr_compression_names[static_cast<int>(trace.compression)], outfilename.filename().u8string().c_str(), trace.reason);
+		captureLog(3, message);
+	}
+
+	return true;
+}
+
+// Archive entries keep the format their back buffer was encoded in
+static archive_pass archive_color_pass(color_format format)
+{
+	return format == color_format::qoi ? archive_pass::back_buffer_qoi : format == color_format::png ? archive_pass::back_buffer_png : archive_pass::back_buffer;
+}
+
+// Encodes the back buffer, the file goes to `output` in one or more pieces
+static bool encode_color(color_format format, const unsigned char* pixels, uint32_t width, uint32_t height, size_t worker, const std::function<bool(const unsigned char*, size_t)>& output)
+{
+	switch (format)
+	{
+	case color_format::qoi:
+		return encode_qoi(pixels, width, height, colorBuffers[worker], output);
+	case color_format::png:
+		return encode_png(pixels, width, height, static_cast<uint32_t>(std::clamp(pngThreads, 1, 64)), pngStripes[worker], output);
+	default:
+		bool written = true;
+		const auto write = [&](const unsigned char* data, size_t size) { written = written && output(data, size); };
+		stbi_write_bmp_to_func([](void* context, void* data, int size) {
+			(*static_cast<decltype(write)*>(context))(static_cast<const unsigned char*>(data), static_cast<size_t>(size));
+		}, const_cast<void*>(static_cast<const void*>(&write)), width, height, 4, pixels);
+		return written;
+	}
+}
+
+// Like extract_planes, but every `factor` x `factor` block of the export texture becomes one texel of the planes on the way.
+// The hash takes the exported channels of the reduced texels, which are what is written.
+template <typename Store>
+static void extract_scaled_planes(const void* data, uint32_t row_pitch, uint32_t channels, uint32_t width, uint32_t height, uint32_t factor, type tex_type, Store store, content_hash* hash = nullptr,
+	content_bounds* bounds = nullptr)
+{
+	if (factor <= 1)
+		return extract_planes(data, row_pitch, channels, width, height, tex_type == depth, store, hash, bounds);
+
+	const uint32_t out_width = scaled_size(width, factor);
+	const uint32_t out_height = scaled_size(height, factor);
+	const depth_reduction reduction = static_cast<depth_reduction>(depthReduction);
+	content_hash local_hash = hash != nullptr ? *hash : content_hash();
+	content_row_sum row_sum(tex_type == depth ? 0x8 : 0x7);
+
+	const float* rows[4];
+	for (uint32_t out_y = 0; out_y < out_height; ++out_y)
+	{
+		const uint32_t row_count = std::min(factor, height - out_y * factor);
+		for (uint32_t r = 0; r < row_count; ++r)
+			rows[r] = reinterpret_cast<const float*>(static_cast<const unsigned char*>(data) + static_cast<size_t>(out_y * factor + r) * row_pitch);
+		uint32_t first = UINT32_MAX, last = 0;
+		for (uint32_t out_x = 0; out_x < out_width; ++out_x)
+		{
+			alignas(16) float texel[4];
+			reduce_block(rows, row_count, out_x * factor, std::min(factor, width - out_x * factor), channels, tex_type == depth, reduction, texel);
+			if (channels == 1)
+				texel[1] = texel[2] = texel[3] = texel[0];
+			if (bounds != nullptr)
+			{
+				if (out_x == 0 && out_y == 0)
+					bounds->begin(texel, 4, tex_type == depth ? 0x8 : 0x7);
+				if (bounds->differs(texel))
+				{
+					first = std::min(first, out_x);
+					last = out_x;
+				}
+			}
+
+			const size_t i = static_cast<size_t>(out_y) * out_width + out_x;
+			if (tex_type == depth)
+				store(i, texel[3], texel[3], texel[3]);
+			else
+				store(i, texel[2], texel[1], texel[0]);
+			if (hash != nullptr)
+				row_sum.add(texel);
+		}
+		if (hash != nullptr)
+			row_sum.fold(local_hash);
+		if (bounds != nullptr)
+			bounds->add_row(out_y, first, last);
+	}
+
+	if (hash != nullptr)
+		*hash = local_hash;
+}
+
+struct exr_crop
+{
+	uint32_t left, top, width, height;
+};
+
+// Packs the crop of each of the three planes to the front of the buffer. Every row moves towards the start, so it is done in place.
+static void crop_planes(unsigned char* planes, size_t element_size, uint32_t width, uint32_t height, const exr_crop& crop)
+{
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+	const size_t crop_pixels = static_cast<size_t>(crop.width) * crop.height;
+	for (size_t plane = 0; plane < 3; ++plane)
+		for (uint32_t y = 0; y < crop.height; ++y)
+			std::memmove(planes + (plane * crop_pixels + static_cast<size_t>(y) * crop.width) * element_size,
+				planes + (plane * num_pixels + static_cast<size_t>(crop.top + y) * width + crop.left) * element_size, crop.width * element_size);
+}
+
+// EXR of an export written over several presents, the state that is kept between the slices
+struct sliced_exr
+{
+	exr_scanline_writer writer;
+	capture_trace trace;
+	bool opened = false;
+	bool failed = false;
+};
+
+// Writes blocks of lines of the crop until the slice is used up, true once the file is complete. The crop is read in place from the planes.
+static bool step_exr(capture_job& job, sliced_exr& state, const std::filesystem::path& save_path, uint32_t width, uint32_t height, const exr_crop& crop,
+	const exr_write_settings& settings, type tex_type, encode_slice& slice)
+{
+	const auto start = std::chrono::steady_clock::now();
+	const size_t element_size = job.half ? sizeof(uint16_t) : sizeof(float);
+	if (!state.opened) {
+		state.opened = true;
+		state.failed = !state.writer.open(save_path, crop.width, crop.height, job.half, settings.compression, settings.window);
+		state.trace.valid = true;
+		state.trace.half = job.half;
+		state.trace.compression = settings.compression == exr_compression::none || settings.compression == exr_compression::rle ? settings.compression : exr_compression::zip;
+		state.trace.raw_bytes = static_cast<uint64_t>(crop.width) * crop.height * 3 * element_size;
+	}
+
+	const unsigned char* const first = job.data.get() + (static_cast<size_t>(crop.top) * width + crop.left) * element_size;
+	while (!state.failed && !state.writer.done()) {
+		state.failed = !state.writer.write_block(first, static_cast<size_t>(width) * height * element_size, width * element_size);
+		if (!slice.next_block())
+			break;
+	}
+	state.trace.encode_ms += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	job.progress = static_cast<float>(state.writer.blocks_written()) / state.writer.blocks();
+	if (!state.failed && !state.writer.done())
+		return false;
+
+	if (!state.writer.close() || state.failed)
+		captureLog(1, "Failed to write captured texture!");
+	state.trace.file_bytes = state.writer.file_bytes();
+	const std::lock_guard<std::mutex> lock(lastCaptureMutex);
+	lastCapture[tex_type] = state.trace;
+	return true;
+}
+
+static exr_write_settings current_write_settings()
+{
+	exr_write_settings settings;
+	settings.compression = static_cast<exr_compression>(exportCompression);
+	settings.target.max_ms = autoMaxMs;
+	settings.target.max_bytes = static_cast<uint64_t>(autoMaxMB) * 1024 * 1024;
+	return settings;
+}
+
+// Writes the raw planes of an export to the spill file, a plain sequential write instead of the encode. The planes keep their borders,
+// the crop is applied when the record is encoded.
+static bool spill_frame(const capture_job& job, int width, int height, const exr_crop& crop, const std::filesystem::path& save_path, const exr_write_settings& settings)
+{
+	spill_record record;
+	record.payload_size = job.size;
+	record.width = width;
+	record.height = height;
+	record.half = job.half;
+	record.compression = settings.compression;
+	record.max_ms = settings.target.max_ms;
+	record.max_bytes = settings.target.max_bytes;
+	record.window_x = settings.window.x;
+	record.window_y = settings.window.y;
+	record.display_width = settings.window.display_width;
+	record.display_height = settings.window.display_height;
+	record.crop_left = crop.left;
+	record.crop_top = crop.top;
+	record.crop_width = crop.width;
+	record.crop_height = crop.height;
+	record.path = save_path.u8string();
+	return spillFile.append(std::move(record), job.data.get());
+}
+
+// Microseconds since the recording started, stored with every entry of an archive
+static uint64_t sequence_timestamp(double time)
+{
+	return static_cast<uint64_t>(std::max(time - sequence.start_time, 0.0) * 1000000.0);
+}
+
+// Whether the exports of a capture go to files of the chosen type, sequences in other formats have their own
+static bool files_per_frame(int64_t sequence_index)
+{
+	return sequence_index < 0 || static_cast<sequence_format>(sequenceFormat) == sequence_format::exr;
+}
+
+// Suffix of the depth or normal file, the replay ring always saves EXRs
+static const char* export_file_name(type tex_type)
+{
+	const bool npy = static_cast<export_file_type>(exportFileType) == export_file_type::npy;
+	if (tex_type == depth)
+		return npy ? "DepthBuffer.npy" : "DepthBuffer.exr";
+	return npy ? "NormalMap.npy" : "NormalMap.exr";
+}
+
+// Compares the content of a converted export with the last written one of its kind, which it becomes otherwise
+static bool matches_last_frame(const content_hash& hash, type tex_type, uint32_t sequence_index)
+{
+	const uint64_t digest = hash.digest();
+	if (sequence.has_hash[tex_type] && sequence.last_hash[tex_type] == digest)
+		return true;
+	sequence.last_hash[tex_type] = digest;
+	sequence.has_hash[tex_type] = true;
+	sequence.source_index[tex_type] = sequence_index;
+	return false;
+}
+
+// Stores a frame of a sequence that equals the last written one as a reference instead of encoding it again
+static void record_unchanged(sequence_writer* container, type tex_type, uint32_t sequence_index, double capture_time)
+{
+	sequence.unchanged++;
+	if (container != nullptr) {
+		container->repeat(container->reserve(), sequence_index);
+		return;
+	}
+	if (sequenceArchive) {
+		// An empty entry, appended by a capture thread, since the archive may be busy with a large one
+		capture_job job;
+		job.write = [archive = sequenceArchive, sequence_index, pass = tex_type == depth ? archive_pass::depth : archive_pass::normal, timestamp = sequence_timestamp(capture_time)](capture_job&, size_t) {
+			archive->append(sequence_index, pass, timestamp, nullptr, 0);
+		};
+		captureQueue.submit(std::move(job));
+		return;
+	}
+
+	if (!sequence.index_file.is_open()) {
+		std::filesystem::path path = sequence.prefix;
+		path += L"Unchanged.txt";
+		sequence.index_file.open(path);
+		sequence.index_file << "# Frames that were not written because they equal an earlier file\n";
+	}
+	const char* const name = export_file_name(tex_type);
+	char line[96];
+	std::snprintf(line, sizeof(line), "%.6u %s = %.6u %s\n", sequence_index, name, sequence.source_index[tex_type], name);
+	sequence.index_file << line;
+	sequence.index_file.flush();
+}
+
+// Publishes the planes of an export in the shared memory stream, a single plane for depth
+static bool stream_image(const resource_desc& desc, const subresource_data& data, uint32_t channels, type tex_type, int64_t sequence_index, uint32_t factor)
+{
+	const size_t num_pixels = static_cast<size_t>(scaled_size(desc.texture.width, factor)) * scaled_size(desc.texture.height, factor);
+
+	frame_stream_info info;
+	info.frame_index = static_cast<uint64_t>(sequence_index);
+	info.width = scaled_size(desc.texture.width, factor);
+	info.height = scaled_size(desc.texture.height, factor);
+	info.channels = tex_type == depth ? 1 : 3;
+	info.format = frame_stream_format::float_planes;
+	info.pass = tex_type == depth ? frame_stream_pass::depth : frame_stream_pass::normal;
+	info.size = num_pixels * info.channels * sizeof(float);
+
+	float* const planes = reinterpret_cast<float*>(frameStream.begin_write(info));
+	if (planes == nullptr)
+		return false;
+
+	if (tex_type == depth)
+		extract_scaled_planes(data.data, data.row_pitch, channels, desc.texture.width, desc.texture.height, factor, tex_type, [planes](size_t i, float b, float, float) {
+			planes[i] = b;
+		});
+	else
+		extract_scaled_planes(data.data, data.row_pitch, channels, desc.texture.width, desc.texture.height, factor, tex_type, [planes, num_pixels](size_t i, float b, float g, float r) {
+			planes[i] = b;
+			planes[num_pixels + i] = g;
+			planes[num_pixels * 2 + i] = r;
+		});
+
+	frameStream.end_write(frame_stream_now());
+	return true;
+}
+
+// The export texture with depth and normals exactly as it was mapped, only the padding of the rows is left out
+static bool capture_dds(const resource_desc& desc, const subresource_data& data, const std::filesystem::path& save_path)
+{
+	const uint32_t row_size = format_row_pitch(desc.texture.format, desc.texture.width);
+	const size_t size = dds_header_size + static_cast<size_t>(row_size) * desc.texture.height;
+	if (row_size == 0 || captureQueue.admit(size, size) == admission::dropped)
+		return false;
+
+	capture_job job;
+	job.size = size;
+	captureQueue.allocate(job);
+	write_dds_header(job.data.get(), static_cast<uint32_t>(desc.texture.format), desc.texture.width, desc.texture.height, row_size);
+	copy_dds_rows(job.data.get() + dds_header_size, data.data, data.row_pitch, row_size, desc.texture.height);
+
+	job.write = [save_path](capture_job& job, size_t) {
+		std::ofstream file(save_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(job.data.get()), static_cast<std::streamsize>(job.size));
+		if (!file)
+			captureLog(1, "Failed to write captured texture!");
+	};
+	captureQueue.submit(std::move(job));
+	return true;
+}
+
+// Depth as [H,W] and normals as [H,W,3] RGB, interleaved right out of the mapped readback. The capture thread only writes them behind the precomputed header.
+static bool capture_npy(const resource_desc& desc, const subresource_data& data, const std::filesystem::path& save_path, uint32_t channels, type tex_type, int64_t sequence_index, double capture_time,
+	const std::shared_ptr<npy_stack>& stack, uint32_t factor)
+{
+	const uint32_t width = scaled_size(desc.texture.width, factor);
+	const uint32_t height = scaled_size(desc.texture.height, factor);
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+	const size_t components = tex_type == depth ? 1 : 3;
+
+	// A stack has one type for all frames, so only single files can degrade to float16
+	const size_t full_size = num_pixels * components * (npyHalf ? sizeof(uint16_t) : sizeof(float));
+	const admission admitted = captureQueue.admit(full_size, stack ? full_size : num_pixels * components * sizeof(uint16_t));
+	if (admitted == admission::dropped)
+		return false;
+
+	capture_job job;
+	job.half = npyHalf || admitted == admission::half;
+	job.size = num_pixels * components * (job.half ? sizeof(uint16_t) : sizeof(float));
+	captureQueue.allocate(job);
+
+	float* const values = reinterpret_cast<float*>(job.data.get());
+	uint16_t* const half_values = reinterpret_cast<uint16_t*>(job.data.get());
+	content_hash hash;
+	const bool check_unchanged = sequence_index >= 0 && skipUnchanged && !stack;
+	if (tex_type == depth)
+		extract_scaled_planes(data.data, data.row_pitch, channels, desc.texture.width, desc.texture.height, factor, tex_type, [values, half_values, half = job.half](size_t i, float b, float, float) {
+			if (half)
+				half_values[i] = float_to_half(b);
+			else
+				values[i] = b;
+		}, check_unchanged ? &hash : nullptr);
+	else
+		extract_scaled_planes(data.data, data.row_pitch, channels, desc.texture.width, desc.texture.height, factor, tex_type, [values, half_values, half = job.half](size_t i, float b, float g, float r) {
+			if (half) {
+				half_values[i * 3] = float_to_half(r);
+				half_values[i * 3 + 1] = float_to_half(g);
+				half_values[i * 3 + 2] = float_to_half(b);
+			}
+			else {
+				values[i * 3] = r;
+				values[i * 3 + 1] = g;
+				values[i * 3 + 2] = b;
+			}
+		}, check_unchanged ? &hash : nullptr);
+
+	if (check_unchanged && matches_last_frame(hash, tex_type, static_cast<uint32_t>(sequence_index))) {
+		captureQueue.cancel(job);
+		record_unchanged(nullptr, tex_type, static_cast<uint32_t>(sequence_index), capture_time);
+		return true;
+	}
+
+	const uint64_t shape[3] = { height, width, components };
+	const bool preallocate = npyPreallocate;
+	job.write = [save_path, stack, sequence_index, shape, preallocate](capture_job& job, size_t) {
+		const bool written = stack ? stack->write(static_cast<uint32_t>(sequence_index), job.data.get(), job.size) :
+			write_npy(save_path, job.half ? npy_dtype::float16 : npy_dtype::float32, shape, shape[2] == 1 ? 2 : 3, job.data.get(), job.size, preallocate);
+		if (!written)
+			captureLog(1, "Failed to write captured texture!");
+	};
+	captureQueue.submit(std::move(job));
+	return true;
+}
+
+bool capture_image(const resource_desc& desc, const subresource_data& data, std::filesystem::path save_path, uint32_t channels, type tex_type, int64_t sequence_index, double capture_time, const exr_window& window)
+{
+	const uint32_t factor = export_scale_factor(static_cast<export_scale>(exportScale));
+	const int width = scaled_size(desc.texture.width, factor);
+	const int height = scaled_size(desc.texture.height, factor);
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+
+	// Streamed frames are converted right into their slot, there is nothing left for a capture thread to do
+	if (sequence_index >= 0 && sequence.streaming)
+		return stream_image(desc, data, channels, tex_type, sequence_index, factor);
+	const std::shared_ptr<npy_stack> stack = sequence_index >= 0 ? sequenceStacks[tex_type] : nullptr;
+	if (stack || (static_cast<export_file_type>(exportFileType) == export_file_type::npy && files_per_frame(sequence_index)))
+		return capture_npy(desc, data, save_path, channels, tex_type, sequence_index, capture_time, stack, factor);
+
+	// The planar copy is what waits for the capture thread, so it is what the budget accounts for
+	const admission admitted = captureQueue.admit(num_pixels * 3 * sizeof(float), num_pixels * 3 * sizeof(uint16_t));
+	if (admitted == admission::dropped)
+		return false;
+
+	capture_job job;
+	job.half = admitted == admission::half;
+	job.size = num_pixels * 3 * (job.half ? sizeof(uint16_t) : sizeof(float));
+	captureQueue.allocate(job);
+
+	float* const planes = reinterpret_cast<float*>(job.data.get());
+	uint16_t* const half_planes = reinterpret_cast<uint16_t*>(job.data.get());
+	// Captured by value, references would be loaded again for every texel of the conversion
+	const auto store = [planes, half_planes, num_pixels, half = job.half](size_t i, float b, float g, float r) {
+		if (half) {
+			half_planes[i] = float_to_half(b);
+			half_planes[num_pixels + i] = float_to_half(g);
+			half_planes[num_pixels * 2 + i] = float_to_half(r);
+		}
+		else {
+			planes[i] = b;
+			planes[num_pixels + i] = g;
+			planes[num_pixels * 2 + i] = r;
+		}
+	};
+
+	// Frames of a delta container all have the same size, so only EXRs of their own lose their borders
+	const std::shared_ptr<sequence_writer> container = sequence_index >= 0 ? sequenceContainers[tex_type] : nullptr;
+	content_hash hash;
+	content_bounds bounds;
+	const bool check_unchanged = sequence_index >= 0 && skipUnchanged;
+	extract_scaled_planes(data.data, data.row_pitch, channels, desc.texture.width, desc.texture.height, factor, tex_type, store, check_unchanged ? &hash : nullptr,
+		cropBorders && !container ? &bounds : nullptr);
+
+	if (check_unchanged && matches_last_frame(hash, tex_type, static_cast<uint32_t>(sequence_index))) {
+		captureQueue.cancel(job);
+		record_unchanged(container.get(), tex_type, static_cast<uint32_t>(sequence_index), capture_time);
+		return true;
+	}
+
+	// The window of a region moves to the scaled pixels
+	exr_write_settings settings = current_write_settings();
+	settings.window = window;
+	settings.window.x = window.x / static_cast<int>(factor);
+	settings.window.y = window.y / static_cast<int>(factor);
+	settings.window.display_width = static_cast<int>(scaled_size(static_cast<uint32_t>(window.display_width), factor));
+	settings.window.display_height = static_cast<int>(scaled_size(static_cast<uint32_t>(window.display_height), factor));
+
+	// The data window shrinks to the content, a frame without any keeps a single pixel
+	exr_crop crop = { 0, 0, static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+	if (cropBorders && !container && channels == 4) {
+		if (bounds.empty())
+			crop = { 0, 0, 1, 1 };
+		else
+			crop = { bounds.min_x, bounds.min_y, bounds.max_x - bounds.min_x + 1, bounds.max_y - bounds.min_y + 1 };
+		if (crop.width != static_cast<uint32_t>(width) || crop.height != static_cast<uint32_t>(height)) {
+			if (!settings.window.cropped()) {
+				settings.window.display_width = width;
+				settings.window.display_height = height;
+			}
+			settings.window.x += static_cast<int>(crop.left);
+			settings.window.y += static_cast<int>(crop.top);
+		}
+	}
+	const defer_mode defer = static_cast<defer_mode>(deferMode);
+	job.deferrable = defer == defer_mode::memory;
+
+	// Deltas need the frames in order, so the ticket is taken here on the present thread
+	if (container) {
+		const uint64_t ticket = container->reserve();
+		job.write = [container, ticket, sequence_index, width, height](capture_job& job, size_t) {
+			if (!container->write(ticket, static_cast<uint32_t>(sequence_index), job.data.get(), job.half, width, height))
+				captureLog(1, "Failed to write captured texture to sequence container!");
+		};
+		job.discard = [container, ticket](capture_job&) { container->skip(ticket); };
+		captureQueue.submit(std::move(job));
+		return true;
+	}
+
+	const std::shared_ptr<capture_archive> archive = sequence_index >= 0 ? sequenceArchive : nullptr;
+	const uint64_t timestamp = sequence_timestamp(capture_time);
+	job.write = [save_path, width, height, crop, tex_type, settings, defer, archive, sequence_index, timestamp](capture_job& job, size_t worker) {
+		if (!archive && defer == defer_mode::spill_file && spill_frame(job, width, height, crop, save_path, settings))
+			return;
+		if (crop.width != static_cast<uint32_t>(width) || crop.height != static_cast<uint32_t>(height))
+			crop_planes(job.data.get(), job.half ? sizeof(uint16_t) : sizeof(float), width, height, crop);
+
+		std::function<bool(const unsigned char*, size_t)> output;
+		if (archive)
+			output = [&](const unsigned char* data, size_t size) {
+				return archive->append(static_cast<uint32_t>(sequence_index), tex_type == depth ? archive_pass::depth : archive_pass::normal, timestamp, data, size);
+			};
+
+		capture_trace trace;
+		if (!SaveEXR(job.data.get(), job.half, crop.width, crop.height, save_path, settings, worker, trace, output))
+			captureLog(1, "Failed to write captured texture!");
+
+		const std::lock_guard<std::mutex> lock(lastCaptureMutex);
+		lastCapture[tex_type] = trace;
+	};
+	// On the present thread files of their own are written a block of lines at a time instead
+	if (!archive && defer != defer_mode::spill_file) {
+		const std::shared_ptr<sliced_exr> state = std::make_shared<sliced_exr>();
+		job.step = [state, save_path, width, height, crop, tex_type, settings](capture_job& job, size_t, encode_slice& slice) {
+			return step_exr(job, *state, save_path, width, height, crop, settings, tex_type, slice);
+		};
+	}
+	captureQueue.submit(std::move(job));
+
+	return true;
+}
+
+static bool back_buffer_layout_of(format format, back_buffer_layout& layout)
+{
+	switch (format)
+	{
+	case format::r8g8b8a8_typeless:
+	case format::r8g8b8a8_unorm:
+	case format::r8g8b8a8_unorm_srgb:
+	case format::r8g8b8x8_typeless:
+	case format::r8g8b8x8_unorm:
+	case format::r8g8b8x8_unorm_srgb:
+		layout = back_buffer_layout::rgba8;
+		return true;
+	case format::b8g8r8a8_typeless:
+	case format::b8g8r8a8_unorm:
+	case format::b8g8r8a8_unorm_srgb:
+	case format::b8g8r8x8_typeless:
+	case format::b8g8r8x8_unorm:
+	case format::b8g8r8x8_unorm_srgb:
+		layout = back_buffer_layout::bgra8;
+		return true;
+	case format::r10g10b10a2_typeless:
+	case format::r10g10b10a2_unorm:
+		layout = back_buffer_layout::rgb10a2;
+		return true;
+	case format::b10g10r10a2_typeless:
+	case format::b10g10r10a2_unorm:
+		layout = back_buffer_layout::bgr10a2;
+		return true;
+	case format::r16g16b16a16_float:
+		layout = back_buffer_layout::rgba16f;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// The mapped back buffer is converted to half float planes right away, like the export texture, the capture thread only compresses them
+static bool capture_back_buffer(const resource_desc& desc, const subresource_data& data, std::filesystem::path save_path, int64_t sequence_index, double capture_time, const exr_window& window)
+{
+	back_buffer_layout layout;
+	if (!back_buffer_layout_of(desc.texture.format, layout))
+		return false;
+
+	const size_t size = static_cast<size_t>(desc.texture.width) * desc.texture.height * 3 * sizeof(uint16_t);
+	if (captureQueue.admit(size, size) == admission::dropped)
+		return false;
+
+	capture_job job;
+	job.half = true;
+	job.size = size;
+	captureQueue.allocate(job);
+	convert_back_buffer(static_cast<const unsigned char*>(data.data), data.row_pitch, desc.texture.width, desc.texture.height, layout, static_cast<transfer_function>(backBufferTransfer),
+		reinterpret_cast<uint16_t*>(job.data.get()));
+
+	save_path += L"BackBuffer.exr";
+	exr_write_settings settings = current_write_settings();
+	settings.window = window;
+	const int width = desc.texture.width;
+	const int height = desc.texture.height;
+	const std::shared_ptr<capture_archive> archive = sequence_index >= 0 ? sequenceArchive : nullptr;
+	job.write = [save_path, width, height, settings, archive, sequence_index, timestamp = sequence_timestamp(capture_time)](capture_job& job, size_t worker) {
+		std::function<bool(const unsigned char*, size_t)> output;
+		if (archive)
+			output = [&](const unsigned char* data, size_t size) {
+				return archive->append(static_cast<uint32_t>(sequence_index), archive_pass::back_buffer_exr, timestamp, data, size);
+			};
+
+		capture_trace trace;
+		if (!SaveEXR(job.data.get(), true, width, height, save_path, settings, worker, trace, output))
+			captureLog(1, "Failed to write captured back buffer!");
+	};
+	captureQueue.submit(std::move(job));
+	return true;
+}
+
+// Encodes an RGBA back buffer to the color format on a capture thread, into the sequence archive or its own file
+static void queue_color_job(capture_job&& job, const std::filesystem::path& save_path_o, uint32_t width, uint32_t height, int64_t sequence_index, double capture_time)
+{
+	const color_format format = static_cast<color_format>(colorFormat);
+	std::filesystem::path save_path = save_path_o;
+	save_path += L"BackBuffer";
+	save_path += color_format_extensions[static_cast<int>(format)];
+
+	const std::shared_ptr<capture_archive> archive = sequence_index >= 0 ? sequenceArchive : nullptr;
+	if (archive) {
+		job.write = [archive, sequence_index, timestamp = sequence_timestamp(capture_time), width, height, format](capture_job& job, size_t worker) {
+			std::vector<unsigned char> file_data;
+			file_data.reserve(format == color_format::bmp ? static_cast<size_t>(width) * height * 4 + 138 : static_cast<size_t>(width) * height);
+			encode_color(format, job.data.get(), width, height, worker, [&](const unsigned char* data, size_t size) {
+				file_data.insert(file_data.end(), data, data + size);
+				return true;
+			});
+			archive->append(static_cast<uint32_t>(sequence_index), archive_color_pass(format), timestamp, file_data.data(), file_data.size());
+		};
+	}
+	else {
+		job.write = [save_path, width, height, format](capture_job& job, size_t worker) {
+			std::ofstream file(save_path, std::ios::binary | std::ios::trunc);
+			if (!encode_color(format, job.data.get(), width, height, worker, [&](const unsigned char* data, size_t size) {
+				file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+				return !!file;
+			}))
+				captureLog(1, "Failed to write captured back buffer!");
+		};
+	}
+	captureQueue.submit(std::move(job));
+}
+
+// A mapped 8-bit back buffer becomes the tightly packed RGBA the color encoders take, with alpha made opaque like in screenshots
+static bool capture_color(const resource_desc& desc, const subresource_data& data, const std::filesystem::path& save_path, int64_t sequence_index, double capture_time)
+{
+	back_buffer_layout layout;
+	if (!back_buffer_layout_of(desc.texture.format, layout))
+		return false;
+
+	const uint32_t width = desc.texture.width;
+	const uint32_t height = desc.texture.height;
+	const size_t pixels_size = static_cast<size_t>(width) * height * 4;
+	if (captureQueue.admit(pixels_size, pixels_size) == admission::dropped)
+		return false;
+
+	capture_job job;
+	job.size = pixels_size;
+	captureQueue.allocate(job);
+	const int r = layout == back_buffer_layout::bgra8 ? 2 : 0, b = 2 - r;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const unsigned char* const src = static_cast<const unsigned char*>(data.data) + static_cast<size_t>(y) * data.row_pitch;
+		unsigned char* const dst = job.data.get() + static_cast<size_t>(y) * width * 4;
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			dst[x * 4] = src[x * 4 + r];
+			dst[x * 4 + 1] = src[x * 4 + 1];
+			dst[x * 4 + 2] = src[x * 4 + b];
+			dst[x * 4 + 3] = 0xFF;
+		}
+	}
+	queue_color_job(std::move(job), save_path, width, height, sequence_index, capture_time);
+	return true;
+}
+
+// Records a copy of the export texture or the back buffer, which is in `state` outside of the copy, into a host readable resource of the slot, which is kept for the next captures.
+// The copy goes into the immediate command list, the caller submits it once together with the other copies of the frame.
+static bool begin_readback(effect_runtime* runtime, stored_buffers_inst& sbi, readback_slot& slot, resource sbr, const resource_desc& texture_desc, resource_usage state, const subresource_box* box = nullptr)
+{
+	if (sbr == 0)
+		return false;
+
+	device* const device = runtime->get_device();
+	command_queue* const queue = runtime->get_command_queue();
+
+	// Only the region is copied, so the host resource and everything after it has the size of the region
+	reshade::api::resource_desc resource_desc = texture_desc;
+	slot.window = exr_window();
+	if (box != nullptr) {
+		resource_desc.texture.width = box->right - box->left;
+		resource_desc.texture.height = box->bottom - box->top;
+		slot.window.x = static_cast<int>(box->left);
+		slot.window.y = static_cast<int>(box->top);
+		slot.window.display_width = static_cast<int>(texture_desc.texture.width);
+		slot.window.display_height = static_cast<int>(texture_desc.texture.height);
+	}
+
+	uint32_t row_pitch = format_row_pitch(resource_desc.texture.format, resource_desc.texture.width);
+	if (device->get_api() == device_api::d3d12) // Align row pitch to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT (256)
+		row_pitch = (row_pitch + 255) & ~255;
+	// 16K frames of RGBA32F take 4 GB, more than 32 bits hold
+	const uint64_t slice_pitch = static_cast<uint64_t>(row_pitch) * resource_desc.texture.height;
+
+	// Recreate the intermediate resource only when the export texture changed
+	if (slot.intermediate != 0 && slot.owns_intermediate &&
+		(slot.desc.texture.width != resource_desc.texture.width || slot.desc.texture.height != resource_desc.texture.height || slot.desc.texture.format != resource_desc.texture.format)) {
+		device->destroy_resource(slot.intermediate);
+		slot.intermediate = { 0 };
+	}
+	if (!slot.owns_intermediate)
+		slot.intermediate = { 0 };
+
+	slot.desc = resource_desc;
+	slot.row_pitch = row_pitch;
+	slot.slice_pitch = slice_pitch;
+	slot.buffer = false;
+
+	if (resource_desc.heap != memory_heap::gpu_only)
+	{
+		// Avoid copying to temporary system memory resource if texture is accessible directly
+		slot.intermediate = sbr;
+		slot.owns_intermediate = false;
+	}
+	else if (device->check_capability(device_caps::copy_buffer_to_texture))
+	{
+		if ((resource_desc.usage & resource_usage::copy_source) != resource_usage::copy_source)
+		{
+			return false;
+		}
+
+		if (slot.intermediate == 0 && !device->create_resource(reshade::api::resource_desc(slice_pitch, memory_heap::gpu_to_cpu, resource_usage::copy_dest), nullptr, resource_usage::copy_dest, &slot.intermediate))
+		{
+			captureLog(1, "Failed to create system memory buffer for texture dumping!");
+			return false;
+		}
+		slot.owns_intermediate = true;
+		slot.buffer = true;
+
+		command_list* const cmd_list = queue->get_immediate_command_list();
+		cmd_list->barrier(sbr, state, resource_usage::copy_source);
+		cmd_list->copy_texture_to_buffer(sbr, 0, box, slot.intermediate, 0, resource_desc.texture.width, resource_desc.texture.height);
+		cmd_list->barrier(sbr, resource_usage::copy_source, state);
+	}
+	else
+	{
+		if ((resource_desc.usage & resource_usage::copy_source) != resource_usage::copy_source)
+			return false;
+
+		if (slot.intermediate == 0 && !device->create_resource(reshade::api::resource_desc(resource_desc.texture.width, resource_desc.texture.height, 1, 1, format_to_default_typed(resource_desc.texture.format), 1, memory_heap::gpu_to_cpu, resource_usage::copy_dest), nullptr, resource_usage::copy_dest, &slot.intermediate))
+		{
+			captureLog(1, "Failed to create system memory texture for texture dumping!");
+			return false;
+		}
+		slot.owns_intermediate = true;
+
+		command_list* const cmd_list = queue->get_immediate_command_list();
+		cmd_list->barrier(sbr, state, resource_usage::copy_source);
+		cmd_list->copy_texture_region(sbr, 0, box, slot.intermediate, 0, nullptr);
+		cmd_list->barrier(sbr, resource_usage::copy_source, state);
+	}
+
+	slot.pending = true;
+	slot.issued_frame = sbi.frame_count;
+	return true;
+}
+
+// Maps the copy of a slot, data is null when that failed
+static subresource_data map_readback(device* device, const readback_slot& slot)
+{
+	subresource_data mapped_data = {};
+	if (slot.buffer)
+	{
+		device->map_buffer_region(slot.intermediate, 0, std::numeric_limits<uint64_t>::max(), map_access::read_only, &mapped_data.data);
+
+		mapped_data.row_pitch = slot.row_pitch;
+		mapped_data.slice_pitch = static_cast<uint32_t>(std::min<uint64_t>(slot.slice_pitch, UINT32_MAX));
+	}
+	else
+	{
+		device->map_texture_region(slot.intermediate, 0, nullptr, map_access::read_only, &mapped_data);
+	}
+	// Resources that are mapped directly hold the full frame, the region starts inside of them
+	if (mapped_data.data != nullptr && !slot.owns_intermediate && slot.window.cropped())
+		mapped_data.data = static_cast<unsigned char*>(mapped_data.data) + static_cast<size_t>(slot.window.y) * mapped_data.row_pitch + static_cast<size_t>(slot.window.x) * format_row_pitch(slot.desc.texture.format, 1);
+	return mapped_data;
+}
+
+static void unmap_readback(device* device, const readback_slot& slot)
+{
+	if (slot.buffer)
+		device->unmap_buffer_region(slot.intermediate);
+	else
+		device->unmap_texture_region(slot.intermediate, 0);
+}
+
+// Maps a finished copy and queues the depth and normal exports made from it
+static void end_readback(effect_runtime* runtime, readback_slot& slot)
+{
+	device* const device = runtime->get_device();
+
+	slot.pending = false;
+
+	const subresource_data mapped_data = map_readback(device, slot);
+
+	if (mapped_data.data != nullptr && slot.back_buffer && slot.color_image)
+	{
+		capture_color(slot.desc, mapped_data, slot.save_path, slot.sequence_index, slot.time);
+	}
+	else if (mapped_data.data != nullptr && slot.back_buffer)
+	{
+		capture_back_buffer(slot.desc, mapped_data, slot.save_path, slot.sequence_index, slot.time, slot.window);
+	}
+	else if (mapped_data.data != nullptr)
+	{
+		uint32_t channels = 0;
+		switch (slot.desc.texture.format)
+		{
+			case format::r32_float:
+				channels = static_cast<uint32_t>(1);
+			break;
+			case format::r32g32b32a32_float:
+				channels = static_cast <uint32_t>(4);
+			break;
+		}
+
+		if (slot.replay && channels != 0)
+			replayRing.add_frame(mapped_data.data, mapped_data.row_pitch, slot.desc.texture.width, slot.desc.texture.height, channels, slot.time, replaySeconds);
+
+		if (static_cast<export_file_type>(exportFileType) == export_file_type::dds && files_per_frame(slot.sequence_index)) {
+			if (slot.depth || slot.normal) {
+				std::filesystem::path save_path = slot.save_path;
+				save_path += L"ExportTexture.dds";
+				capture_dds(slot.desc, mapped_data, save_path);
+			}
+		}
+		else {
+			if (slot.depth) {
+				std::filesystem::path save_path = slot.save_path;
+				save_path += export_file_name(depth);
+				capture_image(slot.desc, mapped_data, save_path, channels, depth, slot.sequence_index, slot.time, slot.window);
+			}
+			if (slot.normal) {
+				std::filesystem::path save_path = slot.save_path;
+				save_path += export_file_name(normal);
+				capture_image(slot.desc, mapped_data, save_path, channels, normal, slot.sequence_index, slot.time, slot.window);
+			}
+		}
+	}
+
+	if (mapped_data.data != nullptr)
+		unmap_readback(device, slot);
+}
+
+// Maps the copies that were issued at least `readback_latency` frames ago, or all of them, oldest first
+void resolve_readbacks(effect_runtime* runtime, stored_buffers_inst& sbi, bool all)
+{
+	bool waited = false;
+	for (;;)
+	{
+		readback_slot* oldest = nullptr;
+		for (readback_slot* const slots : { sbi.readbacks, sbi.color_readbacks })
+			for (readback_slot* slot = slots; slot != slots + readback_latency + 1; ++slot)
+				if (slot->pending && (all || sbi.frame_count - slot->issued_frame >= readback_latency) && (oldest == nullptr || slot->issued_frame < oldest->issued_frame))
+					oldest = slot;
+		if (oldest == nullptr)
+			break;
+
+		// D3D9, D3D10/11 and OpenGL synchronize the map themselves, D3D12 and Vulkan have no fence in this API, so wait once instead
+		const device_api api = runtime->get_device()->get_api();
+		if (!waited && (all || api == device_api::d3d12 || api == device_api::vulkan)) {
+			runtime->get_command_queue()->wait_idle();
+			waited = true;
+		}
+
+		end_readback(runtime, *oldest);
+	}
+}
+
+void release_readbacks(device* device, stored_buffers_inst& sbi)
+{
+	for (readback_slot* const slots : { sbi.readbacks, sbi.color_readbacks })
+	{
+		for (readback_slot* slot = slots; slot != slots + readback_latency + 1; ++slot)
+		{
+			if (slot->intermediate != 0 && slot->owns_intermediate)
+				device->destroy_resource(slot->intermediate);
+			*slot = readback_slot();
+		}
+	}
+}
+
+std::filesystem::path make_save_prefix()
+{
+	std::filesystem::path save_path = executable_path();
+	if (!saveDirectory.empty())
+		save_path = saveDirectory / save_path.filename();
+	save_path += L' ';
+
+	const auto now = std::chrono::system_clock::now();
+	const auto now_seconds = std::chrono::time_point_cast<std::chrono::seconds>(now);
+
+	char timestamp[21];
+	const std::time_t t = std::chrono::system_clock::to_time_t(now_seconds);
+	const tm tm = local_time(t);
+	std::snprintf(timestamp, sizeof(timestamp), "%.4d-%.2d-%.2d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+	save_path += timestamp;
+	save_path += L' ';
+	std::snprintf(timestamp, sizeof(timestamp), "%.2d-%.2d-%.2d", tm.tm_hour, tm.tm_min, tm.tm_sec);
+	save_path += timestamp;
+	save_path += L' ';
+	std::snprintf(timestamp, sizeof(timestamp), "%.3lld", static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(now - now_seconds).count()));
+	save_path += timestamp;
+	save_path += L' ';
+
+	return save_path;
+}
+
+static readback_slot& acquire_readback(effect_runtime* runtime, stored_buffers_inst& sbi, readback_slot (&slots)[readback_latency + 1])
+{
+	for (readback_slot& slot : slots)
+		if (!slot.pending)
+			return slot;
+
+	// Every slot is still in flight, which only happens when captures come faster than the readback latency
+	resolve_readbacks(runtime, sbi, true);
+	return slots[0];
+}
+
+// The region of a `width` x `height` frame that is captured, false when it is the whole frame
+static bool capture_region(uint32_t width, uint32_t height, subresource_box& box)
+{
+	if (static_cast<region_mode>(regionMode) == region_mode::full_frame || width == 0 || height == 0)
+		return false;
+
+	const bool normalized = static_cast<region_mode>(regionMode) == region_mode::normalized;
+	const auto edge = [normalized](float value, uint32_t size) {
+		return static_cast<int32_t>(std::clamp(normalized ? std::lround(value * size) : std::lround(value), 0l, static_cast<long>(size)));
+	};
+	const int32_t w = static_cast<int32_t>(width), h = static_cast<int32_t>(height);
+	box.left = std::min(edge(regionRect[0], width), w - 1);
+	box.top = std::min(edge(regionRect[1], height), h - 1);
+	box.right = std::max(edge(regionRect[2], width), box.left + 1);
+	box.bottom = std::max(edge(regionRect[3], height), box.top + 1);
+	box.front = 0;
+	box.back = 1;
+	return box.left != 0 || box.top != 0 || box.right != w || box.bottom != h;
+}
+
+// Size of the exported frames, which is that of the region when there is one
+static void export_frame_size(const stored_buffers_inst& sbi, uint32_t& width, uint32_t& height)
+{
+	subresource_box box;
+	const bool cropped = capture_region(sbi.export_texture_rd.texture.width, sbi.export_texture_rd.texture.height, box);
+	width = cropped ? static_cast<uint32_t>(box.right - box.left) : sbi.export_texture_rd.texture.width;
+	height = cropped ? static_cast<uint32_t>(box.bottom - box.top) : sbi.export_texture_rd.texture.height;
+}
+
+// Copies the region out of tightly packed RGBA pixels of the whole frame
+static void crop_pixels(const unsigned char* pixels, uint32_t width, const subresource_box& box, unsigned char* region)
+{
+	const size_t region_row = static_cast<size_t>(box.right - box.left) * 4;
+	for (int32_t y = box.top; y < box.bottom; ++y)
+		std::memcpy(region + static_cast<size_t>(y - box.top) * region_row, pixels + (static_cast<size_t>(y) * width + box.left) * 4, region_row);
+}
+
+// Records a copy of the back buffer in its own format, it is converted once the copy is mapped, to half floats for the EXR or to RGBA for the color encoders.
+// False for formats there is no conversion for, 10-bit and HDR back buffers only go to the EXR.
+static bool begin_back_buffer_readback(effect_runtime* runtime, stored_buffers_inst& sbi, const std::filesystem::path& save_path, int64_t sequence_index, bool exr)
+{
+	const resource back_buffer = runtime->get_current_back_buffer();
+	const resource_desc desc = runtime->get_device()->get_resource_desc(back_buffer);
+	back_buffer_layout layout;
+	if (desc.texture.samples > 1 || !back_buffer_layout_of(desc.texture.format, layout))
+		return false;
+	if (!exr && layout != back_buffer_layout::rgba8 && layout != back_buffer_layout::bgra8)
+		return false;
+
+	readback_slot& slot = acquire_readback(runtime, sbi, sbi.color_readbacks);
+	slot.save_path = save_path;
+	slot.back_buffer = true;
+	slot.color_image = !exr;
+	slot.depth = false;
+	slot.normal = false;
+	slot.replay = false;
+	slot.sequence_index = sequence_index;
+	slot.time = seconds_now();
+	subresource_box box;
+	const bool cropped = capture_region(desc.texture.width, desc.texture.height, box);
+	return begin_readback(runtime, sbi, slot, back_buffer, desc, resource_usage::present, cropped ? &box : nullptr);
+}
+
+// Very large frames go to tiled EXRs one band of tile rows at a time. Every band is copied to a staging resource of its own size, waited for,
+// converted and encoded before the next one is copied, so memory grows with the width of the frame but not with its height.
+// The present thread waits for all of it, which is fine for the single captures this is meant for.
+static bool capture_tiled(effect_runtime* runtime, stored_buffers_inst& sbi, const std::filesystem::path& save_path_o)
+{
+	device* const device = runtime->get_device();
+	command_queue* const queue = runtime->get_command_queue();
+	const resource_desc& desc = sbi.export_texture_rd;
+	const uint32_t channels = desc.texture.format == format::r32g32b32a32_float ? 4 : desc.texture.format == format::r32_float ? 1 : 0;
+	if (sbi.export_texture_r == 0 || channels == 0)
+		return false;
+
+	subresource_box region;
+	if (!capture_region(desc.texture.width, desc.texture.height, region))
+		region = { 0, 0, 0, static_cast<int32_t>(desc.texture.width), static_cast<int32_t>(desc.texture.height), 1 };
+	const uint32_t factor = export_scale_factor(static_cast<export_scale>(exportScale));
+	const uint32_t region_width = static_cast<uint32_t>(region.right - region.left);
+	const uint32_t region_height = static_cast<uint32_t>(region.bottom - region.top);
+	const int width = static_cast<int>(scaled_size(region_width, factor));
+	const int height = static_cast<int>(scaled_size(region_height, factor));
+	const int tile_size = std::clamp(tileSize, 16, 1024);
+
+	exr_window window;
+	if (region_width != desc.texture.width || region_height != desc.texture.height) {
+		window.x = region.left / static_cast<int>(factor);
+		window.y = region.top / static_cast<int>(factor);
+		window.display_width = static_cast<int>(scaled_size(desc.texture.width, factor));
+		window.display_height = static_cast<int>(scaled_size(desc.texture.height, factor));
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const bool exports[2] = { enableDepthExp, enableNormalExp };
+	exr_tiled_writer writers[2];
+	bool written = true;
+	for (int i = 0; i < 2; ++i) {
+		std::filesystem::path save_path = save_path_o;
+		save_path += export_file_name(static_cast<type>(i));
+		if (exports[i] && !writers[i].open(save_path, width, height, tile_size, static_cast<exr_compression>(exportCompression), window))
+			written = false;
+	}
+
+	std::vector<float> planes(static_cast<size_t>(width) * tile_size * 3);
+	readback_slot band;
+	for (uint32_t top = 0; top < region_height && written; top += tile_size * factor) {
+		subresource_box box = region;
+		box.top = region.top + static_cast<int32_t>(top);
+		box.bottom = std::min(box.top + tile_size * static_cast<int32_t>(factor), region.bottom);
+		if (!begin_readback(runtime, sbi, band, sbi.export_texture_r, desc, resource_usage::shader_resource, &box)) {
+			written = false;
+			break;
+		}
+		queue->flush_immediate_command_list();
+		queue->wait_idle();
+		band.pending = false;
+
+		const subresource_data mapped_data = map_readback(device, band);
+		if (mapped_data.data == nullptr) {
+			written = false;
+			break;
+		}
+		const int band_height = static_cast<int>(scaled_size(static_cast<uint32_t>(box.bottom - box.top), factor));
+		const size_t plane_values = static_cast<size_t>(width) * band_height;
+		for (int i = 0; i < 2; ++i) {
+			if (!exports[i])
+				continue;
+			extract_scaled_planes(mapped_data.data, mapped_data.row_pitch, channels, region_width, static_cast<uint32_t>(box.bottom - box.top), factor, static_cast<type>(i),
+				[&planes, plane_values](size_t p, float b, float g, float r) {
+					planes[p] = b;
+					planes[plane_values + p] = g;
+					planes[plane_values * 2 + p] = r;
+				});
+			written = writers[i].write_band(planes.data(), band_height) && written;
+		}
+		unmap_readback(device, band);
+	}
+	if (band.intermediate != 0 && band.owns_intermediate)
+		device->destroy_resource(band.intermediate);
+
+	const float encode_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	for (int i = 0; i < 2; ++i) {
+		if (!exports[i])
+			continue;
+		written = writers[i].close() && written;
+
+		capture_trace trace;
+		trace.valid = written;
+		trace.compression = static_cast<exr_compression>(exportCompression) == exr_compression::none ? exr_compression::none :
+			static_cast<exr_compression>(exportCompression) == exr_compression::rle ? exr_compression::rle : exr_compression::zip;
+		trace.encode_ms = encode_ms;
+		trace.raw_bytes = static_cast<uint64_t>(width) * height * 3 * sizeof(float);
+		trace.file_bytes = writers[i].file_bytes();
+		std::snprintf(trace.reason, sizeof(trace.reason), "Tiled in bands of %d rows", tile_size);
+		const std::lock_guard<std::mutex> lock(lastCaptureMutex);
+		lastCapture[i] = trace;
+	}
+	if (!written)
+		captureLog(1, "Failed to write tiled capture!");
+	return written;
+}
+
+// Sequence recording and the replay ring keep their readback resources between frames
+static bool readbacks_in_use()
+{
+	return sequence.recording || enableReplay;
+}
+
+// Records the copies of the back buffer and the export texture into one command list, which is submitted once, so both are of the same frame
+// and are waited for together, right away or a few frames later. Back buffers there is no readback for go through ReShade's screenshot instead.
+void capture_frame(effect_runtime* runtime, stored_buffers_inst& sbi, const std::filesystem::path& save_path_o, bool immediate, int64_t sequence_index)
+{
+	uint32_t frame_width, frame_height;
+	runtime->get_screenshot_width_and_height(&frame_width, &frame_height);
+	subresource_box color_box;
+	const bool color_cropped = capture_region(frame_width, frame_height, color_box);
+	const uint32_t width = color_cropped ? static_cast<uint32_t>(color_box.right - color_box.left) : frame_width;
+	const uint32_t height = color_cropped ? static_cast<uint32_t>(color_box.bottom - color_box.top) : frame_height;
+
+	// Taken before any copy is recorded, as taking a slot may have to wait for the ones in flight
+	const bool tiled = tiledExr && sequence_index < 0 && static_cast<export_file_type>(exportFileType) == export_file_type::exr;
+	readback_slot* const export_slot = (enableDepthExp || enableNormalExp) && !tiled ? &acquire_readback(runtime, sbi, sbi.readbacks) : nullptr;
+
+	// There is no smaller form of the back buffer, so with the degrade policy it waits for space instead
+	const size_t pixels_size = static_cast<size_t>(width) * height * 4;
+	bool issued = false;
+	if (sequence_index >= 0 && sequence.streaming) {
+		frame_stream_info info;
+		info.frame_index = static_cast<uint64_t>(sequence_index);
+		info.width = width;
+		info.height = height;
+		info.channels = 4;
+		info.format = frame_stream_format::rgba8;
+		info.pass = frame_stream_pass::back_buffer;
+		info.size = pixels_size;
+		if (unsigned char* const pixels = frameStream.begin_write(info)) {
+			if (color_cropped) {
+				std::vector<unsigned char> frame(static_cast<size_t>(frame_width) * frame_height * 4);
+				runtime->capture_screenshot(frame.data());
+				crop_pixels(frame.data(), frame_width, color_box, pixels);
+			}
+			else
+				runtime->capture_screenshot(pixels);
+			frameStream.end_write(frame_stream_now());
+		}
+	}
+	else if (begin_back_buffer_readback(runtime, sbi, save_path_o, sequence_index, backBufferExr)) {
+		issued = true;
+	}
+	else if (captureQueue.admit(pixels_size, pixels_size) != admission::dropped) {
+		capture_job job;
+		job.size = pixels_size;
+		captureQueue.allocate(job);
+		if (color_cropped) {
+			std::vector<unsigned char> frame(static_cast<size_t>(frame_width) * frame_height * 4);
+			runtime->capture_screenshot(frame.data());
+			crop_pixels(frame.data(), frame_width, color_box, job.data.get());
+		}
+		else
+			runtime->capture_screenshot(job.data.get());
+		queue_color_job(std::move(job), save_path_o, width, height, sequence_index, seconds_now());
+	}
+
+	if (export_slot != nullptr) {
+		export_slot->save_path = save_path_o;
+		export_slot->depth = enableDepthExp;
+		export_slot->normal = enableNormalExp;
+		export_slot->replay = false;
+		export_slot->sequence_index = sequence_index;
+		export_slot->time = seconds_now();
+		subresource_box box;
+		const bool cropped = capture_region(sbi.export_texture_rd.texture.width, sbi.export_texture_rd.texture.height, box);
+		issued = begin_readback(runtime, sbi, *export_slot, sbi.export_texture_r, sbi.export_texture_rd, resource_usage::shader_resource, cropped ? &box : nullptr) || issued;
+	}
+
+	if (issued)
+		runtime->get_command_queue()->flush_immediate_command_list();
+	if (issued && immediate)
+		resolve_readbacks(runtime, sbi, true);
+	if (tiled && (enableDepthExp || enableNormalExp))
+		capture_tiled(runtime, sbi, save_path_o);
+}
+
+void start_recording(effect_runtime* runtime, stored_buffers_inst& sbi, uint32_t burst_frames)
+{
+	sequence = sequence_state();
+	sequence.recording = true;
+	sequence.remaining = burst_frames;
+	sequence.prefix = make_save_prefix();
+	sequence.start_time = seconds_now();
+
+	uint32_t width, height;
+	runtime->get_screenshot_width_and_height(&width, &height);
+	// Raw textures are neither scaled nor converted
+	uint32_t region_width, region_height;
+	export_frame_size(sbi, region_width, region_height);
+	const uint32_t factor = export_scale_factor(static_cast<export_scale>(exportScale));
+	const uint32_t export_width = scaled_size(region_width, factor);
+	const uint32_t export_height = scaled_size(region_height, factor);
+	size_t export_size = static_cast<size_t>(export_width) * export_height * 3 * sizeof(float);
+	if (static_cast<export_file_type>(exportFileType) == export_file_type::dds && files_per_frame(0))
+		export_size = dds_header_size + static_cast<size_t>(format_row_pitch(sbi.export_texture_rd.texture.format, region_width)) * region_height;
+
+	if (static_cast<sequence_format>(sequenceFormat) == sequence_format::stream) {
+		// A slot takes the largest frame, the planes of an export or the back buffer
+		const uint64_t slot_size = std::max(static_cast<uint64_t>(width) * height * 4, static_cast<uint64_t>(export_size));
+		const uint32_t slot_count = static_cast<uint32_t>(std::clamp(streamSlots, 2, 64));
+		if (!frameStream.is_open() || frameStream.slot_count() != slot_count || frameStream.slot_capacity() < slot_size) {
+			if (!frameStream.create(frameStreamName, slot_count, slot_size))
+				captureLog(1, "Failed to create frame stream, a consumer may still hold one of another size!");
+		}
+		sequence.streaming = frameStream.is_open();
+	}
+
+	// Preallocate host buffers for every stream, enough for each capture thread plus the frames waiting for them
+	if (!sequence.streaming) {
+		const size_t streams = 1 + (enableDepthExp ? 1 : 0) + (enableNormalExp ? 1 : 0);
+		captureQueue.preallocate(std::max(static_cast<size_t>(width) * height * 4, enableDepthExp || enableNormalExp ? export_size : 0), streams * (encodeThreads + 2));
+	}
+
+	if (static_cast<sequence_format>(sequenceFormat) == sequence_format::archive) {
+		std::filesystem::path path = sequence.prefix;
+		path += L"Sequence.fcar";
+		sequenceArchive = std::make_shared<capture_archive>();
+		if (!sequenceArchive->create(path)) {
+			captureLog(1, "Failed to create capture archive!");
+			sequenceArchive.reset();
+		}
+	}
+	if (static_cast<sequence_format>(sequenceFormat) == sequence_format::npy_stack) {
+		const bool exports[2] = { enableDepthExp, enableNormalExp };
+		const wchar_t* const names[2] = { L"DepthBuffer.npy", L"NormalMap.npy" };
+		const uint64_t frame_shape[3] = { export_height, export_width, 3 };
+		for (int i = 0; i < 2; ++i) {
+			if (!exports[i])
+				continue;
+			std::filesystem::path path = sequence.prefix;
+			path += names[i];
+			sequenceStacks[i] = std::make_shared<npy_stack>();
+			if (!sequenceStacks[i]->open(path, npyHalf ? npy_dtype::float16 : npy_dtype::float32, frame_shape, i == depth ? 2 : 3, burst_frames, npyPreallocate)) {
+				captureLog(1, "Failed to create NumPy stack!");
+				sequenceStacks[i].reset();
+			}
+		}
+	}
+	if (static_cast<sequence_format>(sequenceFormat) == sequence_format::container) {
+		const bool exports[2] = { enableDepthExp, enableNormalExp };
+		const wchar_t* const names[2] = { L"DepthBuffer.fcseq", L"NormalMap.fcseq" };
+		for (int i = 0; i < 2; ++i) {
+			if (!exports[i])
+				continue;
+			std::filesystem::path path = sequence.prefix;
+			path += names[i];
+			sequenceContainers[i] = std::make_shared<sequence_writer>();
+			if (!sequenceContainers[i]->open(path, export_width, export_height, std::max(keyframeInterval, 1))) {
+				captureLog(1, "Failed to create sequence container!");
+				sequenceContainers[i].reset();
+			}
+		}
+	}
+
+	captureLog(3, "Frame Capture: recording started");
+}
+
+void stop_recording(effect_runtime* runtime, stored_buffers_inst& sbi)
+{
+	resolve_readbacks(runtime, sbi, true);
+	sequence.recording = false;
+	sequence.streaming = false;
+	for (std::shared_ptr<sequence_writer>& container : sequenceContainers)
+		container.reset();
+	sequenceArchive.reset();
+	for (std::shared_ptr<npy_stack>& stack : sequenceStacks)
+		stack.reset();
+	if (sequence.index_file.is_open())
+		sequence.index_file.close();
+	if (!readbacks_in_use())
+		release_readbacks(runtime->get_device(), sbi);
+	captureQueue.release_buffers();
+
+	char message[128];
+	std::snprintf(message, sizeof(message), "Frame Capture: recording stopped after %u frames, %u of the exports were unchanged", sequence.index, sequence.unchanged);
+	captureLog(3, message);
+}
+
+// Writes every frame of the replay ring as EXRs, split over the capture threads. The ring stays frozen until the last one is done.
+static void save_replay()
+{
+	const size_t count = replayRing.count();
+	if (count == 0 || replayRing.frozen())
+		return;
+
+	replayRing.freeze();
+
+	size_t max_values = 0, max_pixels = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const replay_ring::frame_record& record = replayRing.frame(i);
+		max_values = std::max(max_values, static_cast<size_t>(record.width) * record.height * record.channels);
+		max_pixels = std::max(max_pixels, static_cast<size_t>(record.width) * record.height);
+	}
+
+	// Without any export selected the replay is still worth keeping, so write both
+	const bool write_depth = enableDepthExp || !enableNormalExp;
+	const bool write_normal = enableNormalExp || !enableDepthExp;
+	const std::filesystem::path prefix = make_save_prefix();
+	const exr_write_settings settings = current_write_settings();
+
+	const size_t num_jobs = std::min(count, static_cast<size_t>(std::max(encodeThreads, 1)));
+	const size_t job_size = (max_values + max_pixels * 3) * sizeof(float);
+	replayJobs = num_jobs;
+
+	for (size_t j = 0; j < num_jobs; ++j)
+	{
+		if (captureQueue.admit(job_size, job_size) == admission::dropped) {
+			if (--replayJobs == 0)
+				replayRing.unfreeze();
+			continue;
+		}
+
+		capture_job job;
+		job.size = job_size;
+		captureQueue.allocate(job);
+		job.write = [j, num_jobs, count, max_values, prefix, settings, write_depth, write_normal](capture_job& job, size_t worker) {
+			float* const decoded = reinterpret_cast<float*>(job.data.get());
+			float* const planes = decoded + max_values;
+
+			for (size_t i = j; i < count; i += num_jobs)
+			{
+				const replay_ring::frame_record& record = replayRing.frame(i);
+				const size_t num_pixels = static_cast<size_t>(record.width) * record.height;
+				replayRing.decode(i, decoded);
+
+				for (const type tex_type : { depth, normal })
+				{
+					if (tex_type == depth ? !write_depth : !write_normal)
+						continue;
+
+					extract_planes(decoded, record.width * record.channels * sizeof(float), record.channels, record.width, record.height, tex_type == depth, [planes, num_pixels](size_t p, float b, float g, float r) {
+						planes[p] = b;
+						planes[num_pixels + p] = g;
+						planes[num_pixels * 2 + p] = r;
+					});
+
+					std::filesystem::path save_path = prefix;
+					char index[24];
+					std::snprintf(index, sizeof(index), "Replay %.6u ", static_cast<uint32_t>(i));
+					save_path += index;
+					save_path += tex_type == depth ? L"DepthBuffer.exr" : L"NormalMap.exr";
+
+					capture_trace trace;
+					if (!SaveEXR(reinterpret_cast<const unsigned char*>(planes), false, record.width, record.height, save_path, settings, worker, trace))
+						captureLog(1, "Failed to write replay frame!");
+				}
+			}
+
+			if (--replayJobs == 0)
+				replayRing.unfreeze();
+		};
+		// A job dropped to make room releases its share of the ring all the same, or the ring would stay frozen
+		job.discard = [](capture_job&) {
+			if (--replayJobs == 0)
+				replayRing.unfreeze();
+		};
+		captureQueue.submit(std::move(job));
+	}
+
+	char message[96];
+	std::snprintf(message, sizeof(message), "Frame Capture: saving %u replay frames", static_cast<uint32_t>(count));
+	captureLog(3, message);
+}
+
+// The overlay being open means the player looks at a menu, no input for a while means the game is paused or left alone,
+// and frames coming in well above the target rate leave CPU time to spare
+static bool is_idle()
+{
+	const double now = seconds_now();
+	if (lastOverlayTime >= 0.0 && now - lastOverlayTime < 0.5)
+		return true;
+
+	if (deferIdleSeconds > 0 && seconds_since_input() > deferIdleSeconds)
+		return true;
+
+	if (deferTargetFps > 0 && frameTimeAvg > 0.0 && 1.0 / frameTimeAvg > deferTargetFps * 1.1)
+		return true;
+
+	return false;
+}
+
+// Lets deferred work run while idle: frames kept in memory are released to the capture threads,
+// spilled frames are read back and encoded, at most one per capture thread at a time
+static void update_deferred()
+{
+	encoderIdle = is_idle();
+	captureQueue.set_paused(static_cast<defer_mode>(deferMode) == defer_mode::memory && !encoderIdle);
+
+	if (!encoderIdle || !spillFile.is_open())
+		return;
+
+	while (spillJobs < static_cast<size_t>(std::max(encodeThreads, 1)))
+	{
+		spill_record record;
+		if (!spillFile.take(record))
+			break;
+
+		const size_t size = static_cast<size_t>(record.payload_size);
+		if (captureQueue.admit(size, size) == admission::dropped) {
+			spillFile.finish(record, false);
+			break;
+		}
+
+		capture_job job;
+		job.size = size;
+		captureQueue.allocate(job);
+		spillJobs++;
+		job.write = [record](capture_job& job, size_t worker) {
+			exr_write_settings settings;
+			settings.compression = record.compression;
+			settings.target.max_ms = record.max_ms;
+			settings.target.max_bytes = record.max_bytes;
+			settings.window.x = record.window_x;
+			settings.window.y = record.window_y;
+			settings.window.display_width = record.display_width;
+			settings.window.display_height = record.display_height;
+			exr_crop crop = { record.crop_left, record.crop_top, record.crop_width, record.crop_height };
+			if (crop.width == 0 || crop.height == 0)
+				crop = { 0, 0, record.width, record.height };
+
+			// A record that cannot be read or written is dropped instead of being retried forever
+			capture_trace trace;
+			const bool loaded = spillFile.read(record, job.data.get());
+			if (loaded && (crop.width != record.width || crop.height != record.height))
+				crop_planes(job.data.get(), record.half ? sizeof(uint16_t) : sizeof(float), record.width, record.height, crop);
+			if (!loaded || !SaveEXR(job.data.get(), record.half, crop.width, crop.height, std::filesystem::u8path(record.path), settings, worker, trace))
+				captureLog(1, "Failed to encode spilled frame!");
+			spillFile.finish(record, true);
+			spillJobs--;
+		};
+		// Dropped to make room, the record goes back to the backlog and is encoded with a later idle spell
+		job.discard = [record](capture_job&) {
+			spillFile.finish(record, false);
+			spillJobs--;
+		};
+		captureQueue.submit(std::move(job));
+	}
+}
+
+// Keeps the replay ring sized to the settings and feeds it every Nth frame
+static void update_replay(effect_runtime* runtime, stored_buffers_inst& sbi)
+{
+	if (replayRing.frozen())
+		return; // Being written out, neither resized nor fed until then
+
+	if (!enableReplay) {
+		if (replayRing.capacity() != 0) {
+			replayRing.release();
+			if (!readbacks_in_use())
+				release_readbacks(runtime->get_device(), sbi);
+		}
+		return;
+	}
+
+	// Room for frames at up to 240 fps, the memory limit usually ends the window first
+	const size_t capacity = static_cast<size_t>(std::max(replayMemoryMB, 16)) * 1024 * 1024;
+	const size_t max_frames = static_cast<size_t>(std::max(replaySeconds, 1.0f) * 240.0f / std::max(replayInterval, 1)) + 2;
+	if (replayRing.capacity() != capacity || replayRing.max_frames() != max_frames) {
+		if (!replayRing.allocate(capacity, max_frames)) {
+			captureLog(1, "Failed to allocate instant replay memory!");
+			enableReplay = false;
+			return;
+		}
+	}
+
+	if (runtime->is_key_pressed(0x78)) {
+		resolve_readbacks(runtime, sbi, true);
+		save_replay();
+		return;
+	}
+
+	if (sbi.export_texture_r == 0 || sbi.frame_count % std::max(replayInterval, 1) != 0)
+		return;
+
+	readback_slot& slot = acquire_readback(runtime, sbi, sbi.readbacks);
+	slot.depth = false;
+	slot.normal = false;
+	slot.replay = true;
+	slot.sequence_index = -1;
+	slot.time = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	if (begin_readback(runtime, sbi, slot, sbi.export_texture_r, sbi.export_texture_rd, resource_usage::shader_resource))
+		runtime->get_command_queue()->flush_immediate_command_list();
+}
+
+void init_capture(effect_runtime*)
+{
+	start_encoders();
+
+	if (static_cast<defer_mode>(deferMode) == defer_mode::spill_file || std::filesystem::exists(spill_path()))
+		open_spill_file();
+}
+
+void destroy_capture(effect_runtime* runtime, stored_buffers_inst& sbi)
+{
+	if (sequence.recording)
+		stop_recording(runtime, sbi);
+	release_readbacks(runtime->get_device(), sbi);
+
+	// Finish writing everything that is still queued, frames kept in memory are encoded now, spilled ones wait for the next start
+	captureQueue.set_paused(false);
+	captureQueue.stop();
+	release_arenas();
+	replayRing.release();
+	spillFile.close();
+	frameStream.close();
+	stop_event_trace();
+}
+
+void present_capture(effect_runtime* runtime, stored_buffers_inst& sbi)
+{
+	sbi.frame_count++;
+	resolve_readbacks(runtime, sbi, false);
+
+	const double now = seconds_now();
+	if (lastPresentTime > 0.0)
+		frameTimeAvg = frameTimeAvg > 0.0 ? frameTimeAvg * 0.95 + (now - lastPresentTime) * 0.05 : now - lastPresentTime;
+	lastPresentTime = now;
+
+	if (runtime->is_key_pressed(0x79) && enableCapturing)
+	{
+		switch (static_cast<capture_mode>(captureMode))
+		{
+		case capture_mode::single:
+			capture_frame(runtime, sbi, make_save_prefix(), true);
+			if (!readbacks_in_use())
+				release_readbacks(runtime->get_device(), sbi);
+			break;
+		case capture_mode::interval:
+			if (sequence.recording)
+				stop_recording(runtime, sbi);
+			else
+				start_recording(runtime, sbi, 0);
+			break;
+		case capture_mode::burst:
+			if (!sequence.recording)
+				start_recording(runtime, sbi, std::max(burstLength, 1));
+			break;
+		}
+	}
+
+	if (sequence.recording)
+	{
+		const uint32_t interval = sequence.remaining != 0 ? 1 : std::max(sequenceInterval, 1);
+		if (sequence.frame++ % interval == 0)
+		{
+			std::filesystem::path save_path = sequence.prefix;
+			char index[16];
+			std::snprintf(index, sizeof(index), "%.6u ", sequence.index);
+			save_path += index;
+
+			capture_frame(runtime, sbi, save_path, false, sequence.index++);
+
+			if (sequence.remaining != 0 && --sequence.remaining == 0)
+				stop_recording(runtime, sbi);
+		}
+	}
+
+	update_replay(runtime, sbi);
+	update_deferred();
+
+	if (presentEncoding) {
+		encode_slice slice;
+		slice.deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(std::max(sliceBudgetUs, 1));
+		slice.max_blocks = static_cast<uint32_t>(std::max(sliceBlocks, 0));
+		const bool busy = captureQueue.run_slice(slice) || slice.blocks != 0;
+
+		// Slices encode with the arena of the first thread, given back the same way
+		const double now = seconds_now();
+		if (busy)
+			presentEncodeTime = now;
+		else if (captureArenas[0].capacity() != 0 && now - presentEncodeTime > arena_idle_seconds)
+			captureArenas[0].release();
+	}
+}
+
+void start_event_trace(const std::filesystem::path& path)
+{
+	std::filesystem::path trace_path = path;
+	if (trace_path.empty())
+		trace_path = make_save_prefix() += "Events.fctrace";
+	if (!eventTrace.open(trace_path))
+	{
+		captureLog(1, "Frame Capture: could not create the event trace");
+		return;
+	}
+	eventTraceFramesLeft = std::max(eventTraceFrames, 1);
+	captureLog(3, "Frame Capture: event recording started");
+}
+
+void stop_event_trace()
+{
+	if (!eventTrace.is_open())
+		return;
+	eventTrace.close();
+
+	char msg[128];
+	std::snprintf(msg, sizeof(msg), "Frame Capture: event recording stopped after %llu events, %.1f MB", static_cast<unsigned long long>(eventTrace.events()), eventTrace.bytes() / (1024.0 * 1024.0));
+	captureLog(3, msg);
+}
+
+void on_init_resource(device*, const resource_desc& desc, const subresource_data*, resource_usage initial_state, resource resource)
+{
+	if (!eventTrace.is_open())
+		return;
+	trace_record record;
+	record.type = trace_event::init_resource;
+	record.handle = resource.handle;
+	record.desc = desc;
+	record.usage = initial_state;
+	eventTrace.write(record);
+}
+
+void on_destroy_resource(device*, resource resource)
+{
+	if (!eventTrace.is_open())
+		return;
+	trace_record record;
+	record.type = trace_event::destroy_resource;
+	record.handle = resource.handle;
+	eventTrace.write(record);
+}
+
+void on_init_resource_view(device*, resource resource, resource_usage usage_type, const resource_view_desc& desc, resource_view view)
+{
+	if (!eventTrace.is_open())
+		return;
+	trace_record record;
+	record.type = trace_event::init_resource_view;
+	record.handle = view.handle;
+	record.parent = resource.handle;
+	record.usage = usage_type;
+	record.view_desc = desc;
+	eventTrace.write(record);
+}
+
+void on_destroy_resource_view(device*, resource_view view)
+{
+	if (!eventTrace.is_open())
+		return;
+	trace_record record;
+	record.type = trace_event::destroy_resource_view;
+	record.handle = view.handle;
+	eventTrace.write(record);
+}
+
+void on_bind_render_targets_and_depth_stencil(command_list* cmd_list, uint32_t count, const resource_view* rtvs, resource_view dsv)
+{
+	if (!eventTrace.is_open())
+		return;
+	trace_record record;
+	record.type = trace_event::bind_render_targets_and_depth_stencil;
+	record.object = reinterpret_cast<uintptr_t>(cmd_list);
+	record.count = std::min(count, trace_record::max_views);
+	for (uint32_t i = 0; i < record.count; ++i)
+		record.views[i] = rtvs[i].handle;
+	record.handle = dsv.handle;
+	eventTrace.write(record);
+}
+
+void on_bind_viewports(command_list* cmd_list, uint32_t first, uint32_t count, const viewport* viewports)
+{
+	if (!eventTrace.is_open())
+		return;
+	trace_record record;
+	record.type = trace_event::bind_viewports;
+	record.object = reinterpret_cast<uintptr_t>(cmd_list);
+	record.first = first;
+	record.count = std::min(count, trace_record::max_viewports);
+	std::copy(viewports, viewports + record.count, record.viewports);
+	eventTrace.write(record);
+}
+
+bool on_clear_depth_stencil_view(command_list* cmd_list, resource_view dsv, const float* depth, const uint8_t* stencil, uint32_t rect_count, const rect*)
+{
+	if (!eventTrace.is_open())
+		return false;
+	trace_record record;
+	record.type = trace_event::clear_depth_stencil_view;
+	record.object = reinterpret_cast<uintptr_t>(cmd_list);
+	record.handle = dsv.handle;
+	record.has_depth = depth != nullptr;
+	record.depth = depth != nullptr ? *depth : 0.0f;
+	record.has_stencil = stencil != nullptr;
+	record.stencil = stencil != nullptr ? *stencil : 0;
+	record.rect_count = rect_count;
+	eventTrace.write(record);
+	return false;
+}
+
+bool on_draw(command_list* cmd_list, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance)
+{
+	if (!eventTrace.is_open())
+		return false;
+	trace_record record;
+	record.type = trace_event::draw;
+	record.object = reinterpret_cast<uintptr_t>(cmd_list);
+	record.args[0] = vertex_count;
+	record.args[1] = instance_count;
+	record.args[2] = first_vertex;
+	record.args[3] = first_instance;
+	eventTrace.write(record);
+	return false;
+}
+
+bool on_draw_indexed(command_list* cmd_list, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance)
+{
+	if (!eventTrace.is_open())
+		return false;
+	trace_record record;
+	record.type = trace_event::draw_indexed;
+	record.object = reinterpret_cast<uintptr_t>(cmd_list);
+	record.args[0] = index_count;
+	record.args[1] = instance_count;
+	record.args[2] = first_index;
+	record.args[3] = static_cast<uint32_t>(vertex_offset);
+	record.args[4] = first_instance;
+	eventTrace.write(record);
+	return false;
+}
+
+bool on_draw_or_dispatch_indirect(command_list* cmd_list, indirect_command type, resource buffer, uint64_t offset, uint32_t draw_count, uint32_t stride)
+{
+	if (!eventTrace.is_open())
+		return false;
+	trace_record record;
+	record.type = trace_event::draw_or_dispatch_indirect;
+	record.object = reinterpret_cast<uintptr_t>(cmd_list);
+	record.args[0] = static_cast<uint32_t>(type);
+	record.handle = buffer.handle;
+	record.offset = offset;
+	record.args[1] = draw_count;
+	record.args[2] = stride;
+	eventTrace.write(record);
+	return false;
+}
+
+void on_present(command_queue* queue, swapchain* swapchain, const rect*, const rect*, uint32_t, const rect*)
+{
+	if (!eventTrace.is_open())
+		return;
+	trace_record record;
+	record.type = trace_event::present;
+	record.object = reinterpret_cast<uintptr_t>(queue);
+	record.parent = reinterpret_cast<uintptr_t>(swapchain);
+	eventTrace.write(record);
+	if (--eventTraceFramesLeft <= 0)
+		stop_event_trace();
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#ifndef _WIN32
+// The ReShade headers mark their interfaces and private data with MSVC attributes. Elsewhere every type gets an address of its own
+// in place of a GUID, which is all a runtime needs to tell its private data apart.
+#define __declspec(attributes)
+template <typename T>
+struct private_data_id { static constexpr uint8_t guid[16] = {}; };
+#define __uuidof(type) private_data_id<type>::guid
+#endif
+#include <reshade_api.hpp>
+#include "back_buffer_convert.h"
+#include "capture_archive.h"
+#include "capture_arena.h"
+#include "capture_queue.h"
+#include "color_encoder.h"
+#include "content_bounds.h"
+#include "downsample.h"
+#include "event_trace.h"
+#include "exr_stream_writer.h"
+#include "exr_tiled_writer.h"
+#include "exr_writer.h"
+#include "frame_stream.h"
+#include "npy_writer.h"
+#include "replay_ring.h"
+#include "sequence_container.h"
+#include "spill_file.h"
+
+// Everything of the add-on that does not need ReShade to be loaded: readbacks, conversion, encoding, sequences and file names.
+// It only talks to the reshade::api interfaces, so the add-on DLL is a thin layer of events and overlay on top of it,
+// and tools on any platform can drive it with a mock runtime.
+
+extern bool enableCapturing;
+extern bool enableDepthExp;
+extern bool enableNormalExp;
+
+extern int exportCompression;
+extern float autoMaxMs;
+extern int autoMaxMB;
+
+// Depth and normals go to EXRs, to NumPy arrays, which training jobs map as they are, or together as the raw export texture
+enum class export_file_type : int
+{
+	exr,
+	npy,
+	dds
+};
+
+inline constexpr const char* export_file_type_names[] = { "OpenEXR (.exr)", "NumPy array (.npy)", "Raw texture (.dds)" };
+
+extern int exportFileType;
+// Format of the back buffer, PNG stripes are deflated on this many threads of their own
+extern int colorFormat;
+extern int pngThreads;
+extern bool npyHalf;
+extern bool npyPreallocate;
+// Depth and normals can be reduced to a half or a quarter of the resolution while they are converted
+extern int exportScale;
+extern int depthReduction;
+// EXRs of their own shrink their data window to the content, borders of one constant value are left out
+extern bool cropBorders;
+// Single captures can be written as tiled EXRs, read back and encoded one band of tiles at a time, for frames too large to hold at once
+extern bool tiledExr;
+extern int tileSize;
+// The back buffer read back in its own format to a half float EXR, so HDR stays HDR, with its curve undone on the way
+extern bool backBufferExr;
+extern int backBufferTransfer;
+
+// Captures can be limited to a region of the frame, given as fractions of its size or in pixels. Only the region is copied from the GPU,
+// and EXRs keep the full frame as their display window.
+enum class region_mode : int
+{
+	full_frame,
+	normalized,
+	pixels
+};
+
+inline constexpr const char* region_mode_names[] = { "Full frame", "Fractions of the frame", "Pixels" };
+
+extern int regionMode;
+extern float regionRect[4]; // Left, top, right and bottom
+
+enum class capture_mode : int
+{
+	single,
+	interval,
+	burst
+};
+
+inline constexpr const char* capture_mode_names[] = { "Single frame", "Every Nth frame", "Burst of frames" };
+
+extern int captureMode;
+extern int sequenceInterval;
+extern int burstLength;
+
+// Sequences go to one EXR per frame, to a container per export with keyframes and deltas against the previous frame,
+// with all their files into one archive, without any file into shared memory for another process, or into one NumPy array per export
+enum class sequence_format : int
+{
+	exr,
+	container,
+	archive,
+	stream,
+	npy_stack
+};
+
+inline constexpr const char* sequence_format_names[] = { "File per frame", "Delta container (.fcseq)", "Single archive (.fcar)", "Shared memory stream", "NumPy stack (.npy)" };
+
+extern int sequenceFormat;
+extern int keyframeInterval;
+// Frames whose export texture did not change are recorded as a reference to the last written one
+extern bool skipUnchanged;
+// Slots of the shared memory ring, more of them give a slow consumer more time before frames are overwritten
+extern int streamSlots;
+
+// Backing memory for the encoder of every capture thread, the arena is reset after every file
+extern capture_arena captureArenas[capture_queue::max_workers];
+
+// Frames are written on background threads, the budget limits the host copies waiting for them
+extern int encodeThreads;
+extern int budgetMB;
+extern float budgetPercent;
+extern int budgetPolicy;
+extern capture_queue captureQueue;
+// Priority, I/O priority and cores of the capture threads, zero cores allows all of them
+extern int workerPriority;
+extern int workerIoPriority;
+extern uint64_t workerAffinityMask;
+extern bool workerPinLeastLoaded;
+// Without capture threads, jobs are written a few blocks of lines at a time at the end of every present, within a time or block budget
+extern bool presentEncoding;
+extern int sliceBudgetUs;
+extern int sliceBlocks;
+
+// Instant replay keeps the last seconds of the export texture compressed in memory, F9 writes them out
+extern bool enableReplay;
+extern float replaySeconds;
+extern int replayInterval;
+extern int replayMemoryMB;
+extern replay_ring replayRing;
+
+// Deferred encoding keeps raw frames in memory or spills them to disk and compresses them when the game leaves CPU time
+enum class defer_mode : int
+{
+	off,
+	memory,
+	spill_file
+};
+
+inline constexpr const char* defer_mode_names[] = { "Off", "Keep raw frames in memory", "Spill raw frames to disk" };
+
+extern int deferMode;
+extern int deferIdleSeconds;
+extern int deferTargetFps;
+extern spill_file spillFile;
+extern bool encoderIdle;
+// Last time the overlay was drawn, a menu being open counts as idle
+extern double lastOverlayTime;
+
+// Events of the game recorded to a trace for replaying them off the game machine. The hooks are only registered when enabled
+// at startup, as they run for every draw call, and return right away while no trace is recorded.
+extern bool eventHooks;
+extern int eventTraceFrames;
+extern event_trace_writer eventTrace;
+
+// Captures go there when set, next to the executable otherwise
+extern std::filesystem::path saveDirectory;
+// Where messages go, the add-on points it at the ReShade log
+extern void (*captureLog)(int level, const char* message);
+
+// Copies of the export texture are mapped this many frames after they were issued, so the GPU is not stalled
+static constexpr uint64_t readback_latency = 2;
+
+// A copy of the export texture on its way to the host
+struct readback_slot
+{
+	reshade::api::resource intermediate = { 0 };
+	bool owns_intermediate = false;
+	bool buffer = false;
+	reshade::api::resource_desc desc;
+	uint32_t row_pitch = 0;
+	uint64_t slice_pitch = 0;
+	bool pending = false;
+	uint64_t issued_frame = 0;
+	std::filesystem::path save_path;
+	bool depth = false;
+	bool normal = false;
+	bool replay = false; // Goes into the replay ring instead of being exported
+	bool back_buffer = false; // Copy of the back buffer instead of the export texture
+	bool color_image = false; // Back buffer goes to the color encoder instead of the EXR
+	exr_window window; // Where the copied region is in the frame, desc has the size of the region
+	int64_t sequence_index = -1; // Frame of the recording it belongs to, -1 for single captures
+	double time = 0.0;
+};
+
+struct __declspec(uuid("eadae23a-4009-4d32-8557-0af07e45f409")) stored_buffers_inst
+{
+	reshade::api::resource export_texture_r = { 0 };
+	reshade::api::resource_desc export_texture_rd;
+	reshade::api::resource_view export_texture_rv = { 0 };
+	uint64_t frame_count = 0;
+	readback_slot readbacks[readback_latency + 1];
+	readback_slot color_readbacks[readback_latency + 1];
+	void update(reshade::api::resource sr, reshade::api::resource_desc srd, reshade::api::resource_view srv)
+	{
+		export_texture_r = sr;
+		export_texture_rd = srd;
+		export_texture_rv = srv;
+	}
+	void reset()
+	{
+		export_texture_r = { 0 };
+		export_texture_rv = { 0 };
+	}
+};
+
+enum type
+{
+	depth,
+	normal
+};
+
+struct sequence_state
+{
+	bool recording = false;
+	uint64_t frame = 0; // Presents since the recording started
+	uint32_t index = 0; // Index of the next captured frame, used in the file names
+	uint32_t remaining = 0; // Frames left of a burst, zero when recording every Nth frame until stopped
+	double start_time = 0.0;
+	std::filesystem::path prefix;
+	uint64_t last_hash[2] = {}; // Content of the last depth and normal frame that was written
+	bool has_hash[2] = {};
+	uint32_t source_index[2] = {}; // Frame the unchanged ones refer to
+	uint32_t unchanged = 0;
+	bool streaming = false; // Frames go to the shared memory stream instead of the capture threads
+	std::ofstream index_file; // Lists the unchanged frames when every frame is its own EXR
+};
+
+extern sequence_state sequence;
+// Held by the queued frames as well, so a container is closed once its last frame was written
+extern std::shared_ptr<sequence_writer> sequenceContainers[2];
+extern std::shared_ptr<capture_archive> sequenceArchive;
+extern std::shared_ptr<npy_stack> sequenceStacks[2];
+// Kept between recordings, so consumers do not have to open it again for every one
+extern frame_stream frameStream;
+extern const char* const frameStreamName;
+
+// What happened to the depth and normal export of the last capture, shown in the overlay
+extern capture_trace lastCapture[2];
+extern std::mutex lastCaptureMutex;
+
+double seconds_now();
+void apply_budget();
+void apply_worker_qos();
+// Starts the capture threads again, or none of them when encoding on the present thread
+void start_encoders();
+void open_spill_file();
+// Executable path, or the save directory, and the current time, which every file of a capture starts with
+std::filesystem::path make_save_prefix();
+
+// Starts the capture threads of a new effect runtime and finishes everything that is still queued when it goes away
+void init_capture(reshade::api::effect_runtime* runtime);
+void destroy_capture(reshade::api::effect_runtime* runtime, stored_buffers_inst& sbi);
+// Everything the add-on does once per presented frame: resolving readbacks, hotkeys, sequences, the replay ring and deferred work
+void present_capture(reshade::api::effect_runtime* runtime, stored_buffers_inst& sbi);
+
+void capture_frame(reshade::api::effect_runtime* runtime, stored_buffers_inst& sbi, const std::filesystem::path& save_path_o, bool immediate, int64_t sequence_index = -1);
+void start_recording(reshade::api::effect_runtime* runtime, stored_buffers_inst& sbi, uint32_t burst_frames);
+void stop_recording(reshade::api::effect_runtime* runtime, stored_buffers_inst& sbi);
+void resolve_readbacks(reshade::api::effect_runtime* runtime, stored_buffers_inst& sbi, bool all);
+void release_readbacks(reshade::api::device* device, stored_buffers_inst& sbi);
+bool capture_image(const reshade::api::resource_desc& desc, const reshade::api::subresource_data& data, std::filesystem::path save_path, uint32_t channels, type tex_type, int64_t sequence_index, double capture_time, const exr_window& window = {});
+
+// Records the next eventTraceFrames frames of events to the path, or next to the captures
+void start_event_trace(const std::filesystem::path& path = {});
+void stop_event_trace();
+
+void on_init_resource(reshade::api::device* device, const reshade::api::resource_desc& desc, const reshade::api::subresource_data* initial_data, reshade::api::resource_usage initial_state, reshade::api::resource resource);
+void on_destroy_resource(reshade::api::device* device, reshade::api::resource resource);
+void on_init_resource_view(reshade::api::device* device, reshade::api::resource resource, reshade::api::resource_usage usage_type, const reshade::api::resource_view_desc& desc, reshade::api::resource_view view);
+void on_destroy_resource_view(reshade::api::device* device, reshade::api::resource_view view);
+void on_bind_render_targets_and_depth_stencil(reshade::api::command_list* cmd_list, uint32_t count, const reshade::api::resource_view* rtvs, reshade::api::resource_view dsv);
+void on_bind_viewports(reshade::api::command_list* cmd_list, uint32_t first, uint32_t count, const reshade::api::viewport* viewports);
+bool on_clear_depth_stencil_view(reshade::api::command_list* cmd_list, reshade::api::resource_view dsv, const float* depth, const uint8_t* stencil, uint32_t rect_count, const reshade::api::rect* rects);
+bool on_draw(reshade::api::command_list* cmd_list, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance);
+bool on_draw_indexed(reshade::api::command_list* cmd_list, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance);
+bool on_draw_or_dispatch_indirect(reshade::api::command_list* cmd_list, reshade::api::indirect_command type, reshade::api::resource buffer, uint64_t offset, uint32_t draw_count, uint32_t stride);
+void on_present(reshade::api::command_queue* queue, reshade::api::swapchain* swapchain, const reshade::api::rect* source_rect, const reshade::api::rect* dest_rect, uint32_t dirty_rect_count, const reshade::api::rect* dirty_rects);
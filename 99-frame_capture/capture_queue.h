@@ -0,0 +1,503 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "thread_qos.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// What to do with a new frame when the host copies of the frames still being written exceed the memory budget
+enum class budget_policy : int
+{
+	block,
+	drop_newest,
+	drop_oldest,
+	degrade
+};
+
+inline constexpr const char *budget_policy_names[] = { "Wait for space", "Drop newest frame", "Drop oldest frame", "Degrade to half precision" };
+
+// Physical memory that is currently available to the process
+inline uint64_t available_physical_memory()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX status = { sizeof(status) };
+	if (GlobalMemoryStatusEx(&status))
+		return status.ullAvailPhys;
+	return 0;
+#else
+	// MemAvailable includes reclaimable page cache, unlike _SC_AVPHYS_PAGES
+	if (FILE *const meminfo = std::fopen("/proc/meminfo", "r"))
+	{
+		char line[128];
+		unsigned long long kb = 0;
+		while (std::fgets(line, sizeof(line), meminfo))
+			if (std::sscanf(line, "MemAvailable: %llu kB", &kb) == 1)
+				break;
+		std::fclose(meminfo);
+		if (kb != 0)
+			return kb * 1024;
+	}
+	return static_cast<uint64_t>(sysconf(_SC_AVPHYS_PAGES)) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// Share of a present callback that cooperative encoding may take, a block is one chunk of the file being written
+struct encode_slice
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+	uint32_t max_blocks = 0; // Zero for no limit
+	uint32_t blocks = 0;
+
+	// Counts a finished block and says whether there is room for another one
+	bool next_block()
+	{
+		++blocks;
+		return (max_blocks == 0 || blocks < max_blocks) && std::chrono::steady_clock::now() < deadline;
+	}
+	bool expired() const { return (max_blocks != 0 && blocks >= max_blocks) || std::chrono::steady_clock::now() >= deadline; }
+};
+
+// A frame whose host copy waits to be encoded and written on a capture thread
+struct capture_job
+{
+	std::unique_ptr<uint8_t[]> data;
+	size_t size = 0; // Bytes accounted against the budget
+	bool half = false; // Data was stored with half precision to fit the budget
+	size_t pool = 0; // Generation of the pool the buffer was taken from, zero for buffers from the heap
+	bool deferrable = false; // May wait in the queue while it is paused
+	// Called with the index of the capture thread, so per-thread resources can be picked
+	std::function<void(capture_job &, size_t worker)> write;
+	// Called instead of write when the job is dropped from the queue to make room
+	std::function<void(capture_job &)> discard;
+	// Called instead of write when jobs run in slices, advances the job as far as the slice allows and returns true once it is done
+	std::function<bool(capture_job &, size_t worker, encode_slice &slice)> step;
+	float progress = 0.0f; // Share of a job run in slices that is done
+};
+
+enum class admission
+{
+	full,
+	half,
+	dropped
+};
+
+// Background threads that pick up captured frames in submission order and write them, with a budget on the host memory held by them
+class capture_queue
+{
+public:
+	static constexpr size_t max_workers = 8;
+
+	struct stats
+	{
+		uint64_t in_flight_bytes = 0;
+		uint64_t peak_bytes = 0;
+		uint64_t limit_bytes = 0;
+		size_t queued_jobs = 0;
+		uint64_t dropped_frames = 0;
+		uint64_t degraded_frames = 0;
+		uint64_t blocked_frames = 0;
+		size_t pooled_buffers = 0;
+		size_t free_buffers = 0;
+		size_t workers = 0;
+		size_t deferred_jobs = 0;
+		uint64_t deferred_bytes = 0;
+		bool slicing = false; // A job is partly written by slices
+		float slice_progress = 0.0f;
+		uint64_t pinned_cores = 0; // Cores the workers are pinned to by the least loaded mode
+		uint64_t refused_qos = 0; // Times the system refused a setting of a worker
+	};
+
+	~capture_queue() { stop(); }
+
+	// Zero workers starts as many as last time
+	void start(size_t num_workers = 0)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_threads.empty())
+			return;
+		_stopping = false;
+		if (num_workers != 0)
+			_num_workers = num_workers < max_workers ? num_workers : max_workers;
+		for (size_t i = 0; i < _num_workers; ++i)
+			_threads.emplace_back(&capture_queue::worker, this, i);
+	}
+	// Finishes all queued jobs before returning, on the calling thread when they run in slices
+	void stop()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stopping = true;
+		if (_threads.empty())
+		{
+			lock.unlock();
+			encode_slice unlimited;
+			while (run_slice(unlimited))
+				continue;
+			lock.lock();
+			_stopping = false;
+			return;
+		}
+		lock.unlock();
+		_work.notify_all();
+		for (std::thread &thread : _threads)
+			thread.join();
+		lock.lock();
+		_threads.clear();
+		std::fill(std::begin(_worker_cores), std::end(_worker_cores), 0);
+	}
+
+	// Runs queued jobs on the calling thread until the slice is used up, for when no capture thread can be spared. A job with a step function
+	// is left partly written when the slice ends and continued by the next one, others are written whole. Returns whether work is left.
+	bool run_slice(encode_slice &slice, bool single_job = false)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		for (;;)
+		{
+			if (!_has_current)
+			{
+				const std::deque<capture_job>::iterator it = next_job_locked();
+				if (it == _queue.end())
+					return false;
+				_current = std::move(*it);
+				_queue.erase(it);
+				_has_current = true;
+			}
+
+			lock.unlock();
+			const bool stepped = static_cast<bool>(_current.step);
+			bool done = true;
+			if (stepped)
+				done = _current.step(_current, 0, slice);
+			else
+				_current.write(_current, 0);
+			lock.lock();
+
+			if (!done)
+				return true;
+			_in_flight -= _current.size;
+			recycle_locked(_current);
+			_current = capture_job();
+			_has_current = false;
+			_released.notify_all();
+			// Steps count their own blocks, a job written whole counts as one
+			if (single_job || (!stepped && !slice.next_block()) || slice.expired())
+				return !_queue.empty();
+		}
+	}
+
+	// Called on a worker once it had nothing to do for `idle_seconds` after a job, so it can give back memory it keeps between jobs. Set before
+	// start, the workers call it without the lock.
+	void set_idle_callback(double idle_seconds, std::function<void(size_t worker)> callback)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_idle_seconds = idle_seconds;
+		_idle_callback = std::move(callback);
+	}
+
+	// Workers pick up new settings before their next job, so they can change while frames are being written
+	void set_qos(const thread_qos &qos)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_qos = qos;
+		_qos_generation++;
+	}
+
+	// Allocates `count` buffers of `buffer_size` bytes up front, so steady state recording does not call the heap
+	void preallocate(size_t buffer_size, size_t count)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (buffer_size != _buffer_size)
+		{
+			_free_buffers.clear();
+			_num_buffers = 0;
+			_buffer_size = buffer_size;
+			_pool_generation++;
+		}
+		for (; _num_buffers < count; ++_num_buffers)
+			_free_buffers.emplace_back(new uint8_t[buffer_size]);
+	}
+	// Frees the preallocated buffers, those still in use are freed when their job is done
+	void release_buffers()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_free_buffers.clear();
+		_num_buffers = 0;
+		_buffer_size = 0;
+		_pool_generation++;
+	}
+	// Gives the job a buffer of at least job.size bytes, from the pool when one is free
+	void allocate(capture_job &job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (job.size <= _buffer_size && !_free_buffers.empty())
+			{
+				job.pool = _pool_generation;
+				job.data = std::move(_free_buffers.back());
+				_free_buffers.pop_back();
+				return;
+			}
+		}
+		job.pool = 0;
+		job.data.reset(new uint8_t[job.size]);
+	}
+
+	// A limit of zero bytes and zero percent means unlimited, with both set the lower one applies
+	void set_budget(uint64_t max_bytes, float max_percent_of_free, budget_policy policy)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_max_bytes = max_bytes;
+		_max_percent = max_percent_of_free;
+		_policy = policy;
+	}
+
+	// Deferrable jobs stay queued while paused, they still count against the budget and are written anyway
+	// as soon as a new frame has to wait for their memory
+	void set_paused(bool paused)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_paused == paused)
+				return;
+			_paused = paused;
+		}
+		_work.notify_all();
+	}
+
+	// Reserves budget for a new frame before its host copy is made and says in which precision to store it
+	admission admit(size_t full_size, size_t half_size)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		bool blocked = false;
+		for (;;)
+		{
+			const uint64_t limit = limit_locked();
+			const auto fits = [this, limit](size_t size) { return limit == 0 || _in_flight == 0 || _in_flight + size <= limit; };
+
+			if (fits(full_size))
+				return reserve_locked(full_size, admission::full);
+
+			if (_policy == budget_policy::drop_newest)
+			{
+				_stats.dropped_frames++;
+				return admission::dropped;
+			}
+			if (_policy == budget_policy::drop_oldest && !_queue.empty())
+			{
+				_in_flight -= _queue.front().size;
+				if (_queue.front().discard)
+					_queue.front().discard(_queue.front());
+				recycle_locked(_queue.front());
+				_queue.pop_front();
+				_stats.dropped_frames++;
+				continue;
+			}
+			if (_policy == budget_policy::degrade && half_size < full_size && fits(half_size))
+			{
+				_stats.degraded_frames++;
+				return reserve_locked(half_size, admission::half);
+			}
+
+			// Nothing left to give up, so wait until the capture thread finished a frame
+			if (!blocked)
+				_stats.blocked_frames++;
+			blocked = true;
+			_waiting_admits++;
+			if (_threads.empty())
+			{
+				// Without threads the frame that waits writes the oldest job itself, or goes over the budget when there is none
+				const bool pending = _has_current || !_queue.empty();
+				if (pending)
+				{
+					lock.unlock();
+					encode_slice unlimited;
+					run_slice(unlimited, true);
+					lock.lock();
+				}
+				_waiting_admits--;
+				if (!pending)
+					return reserve_locked(full_size, admission::full);
+				continue;
+			}
+			_work.notify_all();
+			_released.wait(lock);
+			_waiting_admits--;
+		}
+	}
+	// Gives back a reservation that is not going to be submitted
+	void cancel(size_t size)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_in_flight -= size;
+		}
+		_released.notify_all();
+	}
+	// Gives back the reservation and the buffer of a job that is not going to be submitted
+	void cancel(capture_job &job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_in_flight -= job.size;
+			recycle_locked(job);
+		}
+		_released.notify_all();
+	}
+	// Workers are only started by start(), without them the job waits for run_slice()
+	void submit(capture_job &&job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_queue.push_back(std::move(job));
+		}
+		_work.notify_one();
+	}
+
+	stats get_stats()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		stats result = _stats;
+		result.in_flight_bytes = _in_flight;
+		result.limit_bytes = limit_locked();
+		result.queued_jobs = _queue.size();
+		result.pooled_buffers = _num_buffers;
+		result.free_buffers = _free_buffers.size();
+		result.workers = _threads.size();
+		result.slicing = _has_current;
+		result.slice_progress = _current.progress;
+		for (const int core : _worker_cores)
+			if (core > 0)
+				result.pinned_cores |= 1ull << (core - 1);
+		for (const capture_job &job : _queue)
+			if (job.deferrable)
+			{
+				result.deferred_jobs++;
+				result.deferred_bytes += job.size;
+			}
+		return result;
+	}
+
+private:
+	uint64_t limit_locked() const
+	{
+		uint64_t limit = _max_bytes;
+		if (_max_percent > 0.0f)
+		{
+			// Frames in flight already took their share of the free memory
+			const uint64_t percent_limit = static_cast<uint64_t>((available_physical_memory() + _in_flight) * (_max_percent / 100.0));
+			if (limit == 0 || percent_limit < limit)
+				limit = percent_limit;
+		}
+		return limit;
+	}
+	void recycle_locked(capture_job &job)
+	{
+		// Buffers from a pool that was released or resized in the meantime are simply freed
+		if (job.pool == _pool_generation && job.data != nullptr)
+			_free_buffers.push_back(std::move(job.data));
+		job.data.reset();
+	}
+	admission reserve_locked(size_t size, admission result)
+	{
+		_in_flight += size;
+		if (_in_flight > _stats.peak_bytes)
+			_stats.peak_bytes = _in_flight;
+		return result;
+	}
+
+	// First job that may run now, everything runs when stopping or when a new frame waits for memory
+	std::deque<capture_job>::iterator next_job_locked()
+	{
+		if (!_paused || _stopping || _waiting_admits != 0)
+			return _queue.begin();
+		return std::find_if(_queue.begin(), _queue.end(), [](const capture_job &job) { return !job.deferrable; });
+	}
+
+	void worker(size_t index)
+	{
+		thread_qos_state qos_state;
+		bool idle_pending = false;
+		std::unique_lock<std::mutex> lock(_mutex);
+		for (;;)
+		{
+			std::deque<capture_job>::iterator it;
+			const auto ready = [this, &it]() { it = next_job_locked(); return _stopping || it != _queue.end(); };
+			if (idle_pending && _idle_callback)
+			{
+				if (!_work.wait_for(lock, std::chrono::duration<double>(_idle_seconds), ready))
+				{
+					idle_pending = false;
+					lock.unlock();
+					_idle_callback(index);
+					lock.lock();
+					continue;
+				}
+			}
+			else
+			{
+				_work.wait(lock, ready);
+			}
+			if (it == _queue.end())
+				break; // Only reached when stopping
+
+			capture_job job = std::move(*it);
+			_queue.erase(it);
+			const thread_qos qos = _qos;
+			const uint64_t qos_generation = _qos_generation;
+
+			lock.unlock();
+			const bool applied = qos_state.apply(qos, qos_generation, index);
+			job.write(job, index);
+			lock.lock();
+
+			_in_flight -= job.size;
+			_worker_cores[index] = qos_state.core() + 1;
+			if (!applied)
+				_stats.refused_qos++;
+			recycle_locked(job);
+			_released.notify_all();
+			idle_pending = true;
+		}
+	}
+
+	std::mutex _mutex;
+	std::condition_variable _work;
+	std::condition_variable _released;
+	std::deque<capture_job> _queue;
+	std::vector<std::thread> _threads;
+	bool _stopping = false;
+	bool _paused = false;
+	size_t _waiting_admits = 0;
+
+	std::vector<std::unique_ptr<uint8_t[]>> _free_buffers;
+	size_t _num_buffers = 0;
+	size_t _buffer_size = 0;
+	size_t _pool_generation = 1;
+	size_t _num_workers = 1;
+	capture_job _current; // Job being written in slices
+	bool _has_current = false;
+	thread_qos _qos;
+	uint64_t _qos_generation = 0;
+	int _worker_cores[max_workers] = {}; // One past the core the worker is pinned to, zero when it is not
+	double _idle_seconds = 0.0;
+	std::function<void(size_t worker)> _idle_callback;
+
+	uint64_t _max_bytes = 0;
+	float _max_percent = 0.0f;
+	budget_policy _policy = budget_policy::block;
+	uint64_t _in_flight = 0;
+	stats _stats;
+};
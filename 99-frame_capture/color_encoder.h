@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "miniz.h"
+
+// Lossless encoders for the 8-bit RGBA back buffer, much smaller than a BMP and fast enough for sequences.
+// QOI encodes a frame in one pass over the pixels. PNG splits the frame into horizontal stripes that are deflated on threads of their own,
+// every stripe ends with a sync flush, so they join into one valid deflate stream.
+
+enum class color_format : int
+{
+	bmp,
+	qoi,
+	png
+};
+
+inline constexpr const char *color_format_names[] = { "BMP (uncompressed)", "QOI (fast)", "PNG (multithreaded)" };
+inline constexpr const char *color_format_extensions[] = { ".bmp", ".qoi", ".png" };
+
+inline void color_put_be32(unsigned char *p, uint32_t value)
+{
+	p[0] = static_cast<unsigned char>(value >> 24);
+	p[1] = static_cast<unsigned char>(value >> 16);
+	p[2] = static_cast<unsigned char>(value >> 8);
+	p[3] = static_cast<unsigned char>(value);
+}
+
+// https://qoiformat.org/qoi-specification.pdf, the file goes to `output` in one piece
+template <typename Output>
+bool encode_qoi(const unsigned char *rgba, uint32_t width, uint32_t height, std::vector<unsigned char> &buffer, Output output)
+{
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+	buffer.resize(14 + num_pixels * 5 + 8);
+	unsigned char *p = buffer.data();
+
+	std::memcpy(p, "qoif", 4);
+	color_put_be32(p + 4, width);
+	color_put_be32(p + 8, height);
+	p[12] = 4; // RGBA
+	p[13] = 0; // sRGB
+	p += 14;
+
+	uint32_t index[64] = {};
+	uint32_t previous = 0xFF000000; // Little endian RGBA, opaque black
+	uint32_t run = 0;
+	for (size_t i = 0; i < num_pixels; ++i)
+	{
+		uint32_t pixel;
+		std::memcpy(&pixel, rgba + i * 4, 4);
+		if (pixel == previous)
+		{
+			if (++run == 62)
+			{
+				*p++ = static_cast<unsigned char>(0xC0 | (run - 1));
+				run = 0;
+			}
+			continue;
+		}
+		if (run != 0)
+		{
+			*p++ = static_cast<unsigned char>(0xC0 | (run - 1));
+			run = 0;
+		}
+
+		const uint32_t r = pixel & 0xFF, g = (pixel >> 8) & 0xFF, b = (pixel >> 16) & 0xFF, a = pixel >> 24;
+		const uint32_t hash = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+		if (index[hash] == pixel)
+		{
+			*p++ = static_cast<unsigned char>(hash);
+		}
+		else
+		{
+			index[hash] = pixel;
+			if (a == previous >> 24)
+			{
+				const int dr = static_cast<int8_t>(r - (previous & 0xFF));
+				const int dg = static_cast<int8_t>(g - ((previous >> 8) & 0xFF));
+				const int db = static_cast<int8_t>(b - ((previous >> 16) & 0xFF));
+				const int dr_dg = dr - dg, db_dg = db - dg;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+				{
+					*p++ = static_cast<unsigned char>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+				}
+				else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+				{
+					*p++ = static_cast<unsigned char>(0x80 | (dg + 32));
+					*p++ = static_cast<unsigned char>((dr_dg + 8) << 4 | (db_dg + 8));
+				}
+				else
+				{
+					*p++ = 0xFE;
+					*p++ = static_cast<unsigned char>(r);
+					*p++ = static_cast<unsigned char>(g);
+					*p++ = static_cast<unsigned char>(b);
+				}
+			}
+			else
+			{
+				*p++ = 0xFF;
+				std::memcpy(p, &pixel, 4);
+				p += 4;
+			}
+		}
+		previous = pixel;
+	}
+	if (run != 0)
+		*p++ = static_cast<unsigned char>(0xC0 | (run - 1));
+
+	static const unsigned char end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	std::memcpy(p, end_marker, 8);
+	p += 8;
+	return output(buffer.data(), static_cast<size_t>(p - buffer.data()));
+}
+
+// Adler-32 of two pieces of data joined, from the checksums of the pieces and the length of the second one
+inline uint32_t color_adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t length2)
+{
+	static constexpr uint32_t base = 65521;
+	const uint32_t remainder = static_cast<uint32_t>(length2 % base);
+	uint32_t sum1 = adler1 & 0xFFFF;
+	uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(remainder) * sum1) % base);
+	sum1 += (adler2 & 0xFFFF) + base - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + base - remainder;
+	if (sum1 >= base) sum1 -= base;
+	if (sum1 >= base) sum1 -= base;
+	if (sum2 >= base * 2) sum2 -= base * 2;
+	if (sum2 >= base) sum2 -= base;
+	return sum1 | (sum2 << 16);
+}
+
+// One stripe of a PNG, filtered, deflated and wrapped in an IDAT chunk of its own
+struct png_stripe
+{
+	std::vector<unsigned char> filtered;
+	std::vector<unsigned char> chunk;
+	uint32_t adler = 1;
+};
+
+inline void encode_png_stripe(const unsigned char *rgba, uint32_t width, uint32_t y0, uint32_t y1, bool last, png_stripe &stripe)
+{
+	const size_t row_size = static_cast<size_t>(width) * 4;
+	stripe.filtered.resize((row_size + 1) * (y1 - y0));
+
+	// The Up filter, it needs only the row above, which the first row of a stripe takes from the stripe before
+	unsigned char *dst = stripe.filtered.data();
+	for (uint32_t y = y0; y < y1; ++y, dst += row_size + 1)
+	{
+		const unsigned char *const row = rgba + y * row_size;
+		if (y == 0)
+		{
+			dst[0] = 0;
+			std::memcpy(dst + 1, row, row_size);
+			continue;
+		}
+		const unsigned char *const above = row - row_size;
+		dst[0] = 2;
+		for (size_t x = 0; x < row_size; ++x)
+			dst[1 + x] = static_cast<unsigned char>(row[x] - above[x]);
+	}
+	stripe.adler = static_cast<uint32_t>(mz_adler32(1, stripe.filtered.data(), stripe.filtered.size()));
+
+	// Chunk length and CRC are filled in once the size of the data is known
+	stripe.chunk.assign(8, 0);
+	std::memcpy(stripe.chunk.data() + 4, "IDAT", 4);
+	stripe.chunk.reserve(stripe.filtered.size() / 2);
+
+	const std::unique_ptr<tdefl_compressor> compressor(new tdefl_compressor);
+	tdefl_init(compressor.get(), [](const void *data, int size, void *user) -> mz_bool {
+		std::vector<unsigned char> &chunk = *static_cast<std::vector<unsigned char> *>(user);
+		chunk.insert(chunk.end(), static_cast<const unsigned char *>(data), static_cast<const unsigned char *>(data) + size);
+		return MZ_TRUE;
+	}, &stripe.chunk, static_cast<int>(tdefl_create_comp_flags_from_zip_params(1, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY)));
+	tdefl_compress_buffer(compressor.get(), stripe.filtered.data(), stripe.filtered.size(), last ? TDEFL_FINISH : TDEFL_SYNC_FLUSH);
+
+	const size_t data_size = stripe.chunk.size() - 8;
+	color_put_be32(stripe.chunk.data(), static_cast<uint32_t>(data_size));
+	stripe.chunk.resize(stripe.chunk.size() + 4);
+	color_put_be32(stripe.chunk.data() + 8 + data_size, static_cast<uint32_t>(mz_crc32(MZ_CRC32_INIT, stripe.chunk.data() + 4, data_size + 4)));
+}
+
+// Writes a PNG chunk that is small enough to be put together on the stack
+template <typename Output>
+bool write_png_chunk(const char *type, const unsigned char *data, uint32_t size, Output &output)
+{
+	unsigned char chunk[8 + 13 + 4];
+	color_put_be32(chunk, size);
+	std::memcpy(chunk + 4, type, 4);
+	if (size != 0)
+		std::memcpy(chunk + 8, data, size);
+	color_put_be32(chunk + 8 + size, static_cast<uint32_t>(mz_crc32(MZ_CRC32_INIT, chunk + 4, size + 4)));
+	return output(chunk, 12 + size);
+}
+
+// The zlib header and the Adler-32 at the end of the stream go into IDAT chunks of their own, so the stripes need no copy
+template <typename Output>
+bool encode_png(const unsigned char *rgba, uint32_t width, uint32_t height, uint32_t threads, std::vector<png_stripe> &stripes, Output output)
+{
+	// Stripes of at least 32 rows, fewer would cost more compression than they save time
+	const uint32_t count = std::max(1u, std::min(threads, height / 32));
+	stripes.resize(count);
+
+	std::vector<std::thread> workers;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t y0 = static_cast<uint32_t>(static_cast<uint64_t>(height) * i / count);
+		const uint32_t y1 = static_cast<uint32_t>(static_cast<uint64_t>(height) * (i + 1) / count);
+		if (i + 1 == count)
+			encode_png_stripe(rgba, width, y0, y1, true, stripes[i]);
+		else
+			workers.emplace_back(encode_png_stripe, rgba, width, y0, y1, false, std::ref(stripes[i]));
+	}
+	for (std::thread &worker : workers)
+		worker.join();
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	unsigned char header[13];
+	color_put_be32(header, width);
+	color_put_be32(header + 4, height);
+	header[8] = 8; // Bits per channel
+	header[9] = 6; // RGBA
+	header[10] = header[11] = header[12] = 0;
+	static const unsigned char zlib_header[2] = { 0x78, 0x01 };
+	if (!output(signature, sizeof(signature)) || !write_png_chunk("IHDR", header, 13, output) || !write_png_chunk("IDAT", zlib_header, 2, output))
+		return false;
+
+	uint32_t adler = 1;
+	for (const png_stripe &stripe : stripes)
+	{
+		if (!output(stripe.chunk.data(), stripe.chunk.size()))
+			return false;
+		adler = color_adler32_combine(adler, stripe.adler, stripe.filtered.size());
+	}
+
+	unsigned char trailer[4];
+	color_put_be32(trailer, adler);
+	return write_png_chunk("IDAT", trailer, 4, output) && write_png_chunk("IEND", nullptr, 0, output);
+}
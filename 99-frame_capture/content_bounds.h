@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Bounding box of the texels that differ from the first texel of the frame, like the far plane around a letterboxed picture or an empty sky.
+// The converter compares every texel it loads anyway, one SSE compare and a movemask each, and reports the first and last differing column
+// of every row, so the box costs no pass of its own. Only the channels in the mask count, alpha for depth and RGB for normals.
+struct content_bounds
+{
+	uint32_t min_x = UINT32_MAX, min_y = UINT32_MAX;
+	uint32_t max_x = 0, max_y = 0;
+
+	void begin(const float *first_texel, uint32_t channels, int mask)
+	{
+		std::memset(_background, 0, sizeof(_background));
+		std::memcpy(_background, first_texel, (channels < 4 ? channels : 4) * sizeof(float));
+		_mask = mask;
+#if defined(_M_X64) || defined(__SSE2__)
+		_background_v = _mm_loadu_ps(_background);
+#endif
+	}
+
+	// Texels with NaNs always differ, so they are never cropped away
+	bool differs(const float *texel) const
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		return (_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(texel), _background_v)) & _mask) != 0;
+#else
+		for (int i = 0; i < 4; ++i)
+			if ((_mask & (1 << i)) != 0 && !(texel[i] == _background[i]))
+				return true;
+		return false;
+#endif
+	}
+
+	void add_row(uint32_t y, uint32_t first, uint32_t last)
+	{
+		if (first > last)
+			return;
+		if (y < min_y)
+			min_y = y;
+		max_y = y;
+		if (first < min_x)
+			min_x = first;
+		if (last > max_x)
+			max_x = last;
+	}
+
+	bool empty() const { return min_y > max_y; }
+
+private:
+	float _background[4] = {};
+	int _mask = 0xF;
+#if defined(_M_X64) || defined(__SSE2__)
+	__m128 _background_v = _mm_setzero_ps();
+#endif
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Fast non-cryptographic hash to notice frames that did not change. A step takes 16 bytes, one RGBA32F texel, in two 64-bit lanes: every
+// lane is xored with a key, the product of its two 32-bit halves and the lane itself are added to the accumulator, like XXH3 does. Steps go
+// round robin to four stripes with an accumulator and key each, so update() runs four steps that do not wait for each other and keeps up
+// with memory. The keys advance with every step of their stripe, so moved content changes the hash. SSE2 is always there on x64, the scalar
+// path gives the same result.
+class content_hash
+{
+public:
+	content_hash()
+	{
+		static const uint64_t acc[stripes * 2] = {
+			0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull,
+			0x452821E638D01377ull, 0xBE5466CF34E90C6Cull, 0xC0AC29B7C97C50DDull, 0x3F84D5B5B5470917ull };
+		static const uint64_t key[stripes * 2] = {
+			0x9216D5D98979FB1Bull, 0xD1310BA698DFB5ACull, 0x2FFD72DBD01ADFB7ull, 0xB8E1AFED6A267E96ull,
+			0xBA7C9045F12C7F99ull, 0x24A19947B3916CF7ull, 0x0801F2E2858EFC16ull, 0x636920D871574E69ull };
+#if defined(_M_X64) || defined(__SSE2__)
+		for (int s = 0; s < stripes; ++s)
+		{
+			_acc[s] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + s * 2));
+			_key[s] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(key + s * 2));
+		}
+#else
+		std::memcpy(_acc, acc, sizeof(_acc));
+		std::memcpy(_key, key, sizeof(_key));
+#endif
+	}
+
+	// Hashes 16 bytes into the next stripe
+	void step(const void *data)
+	{
+		const int s = static_cast<int>(_steps++ % stripes);
+#if defined(_M_X64) || defined(__SSE2__)
+		round(_acc[s], _key[s], _mm_loadu_si128(static_cast<const __m128i *>(data)));
+#else
+		round(_acc + s * 2, _key + s * 2, static_cast<const unsigned char *>(data));
+#endif
+	}
+	// Same result as calling step for every 16 bytes, the tail is padded with zeros
+	void update(const void *data, size_t size)
+	{
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		for (; size >= 16 && _steps % stripes != 0; size -= 16, p += 16)
+			step(p);
+
+		// Whole rounds of all stripes, with the state in registers
+		const size_t rounds = size / (16 * stripes);
+#if defined(_M_X64) || defined(__SSE2__)
+		__m128i a0 = _acc[0], a1 = _acc[1], a2 = _acc[2], a3 = _acc[3];
+		__m128i k0 = _key[0], k1 = _key[1], k2 = _key[2], k3 = _key[3];
+		for (size_t i = 0; i < rounds; ++i, p += 16 * stripes)
+		{
+			round(a0, k0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+			round(a1, k1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16)));
+			round(a2, k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32)));
+			round(a3, k3, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48)));
+		}
+		_acc[0] = a0; _acc[1] = a1; _acc[2] = a2; _acc[3] = a3;
+		_key[0] = k0; _key[1] = k1; _key[2] = k2; _key[3] = k3;
+#else
+		for (size_t i = 0; i < rounds; ++i, p += 16 * stripes)
+			for (int s = 0; s < stripes; ++s)
+				round(_acc + s * 2, _key + s * 2, p + s * 16);
+#endif
+		_steps += rounds * stripes;
+		size -= rounds * 16 * stripes;
+
+		for (; size >= 16; size -= 16, p += 16)
+			step(p);
+		if (size != 0)
+		{
+			unsigned char tail[16] = {};
+			std::memcpy(tail, p, size);
+			step(tail);
+		}
+	}
+
+	uint64_t digest() const
+	{
+		uint64_t acc[stripes * 2];
+#if defined(_M_X64) || defined(__SSE2__)
+		for (int s = 0; s < stripes; ++s)
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(acc + s * 2), _acc[s]);
+#else
+		std::memcpy(acc, _acc, sizeof(acc));
+#endif
+		uint64_t h = _steps * 0x9E3779B185EBCA87ull;
+		for (int i = 0; i < stripes * 2; ++i)
+			h = (h ^ mix(acc[i])) * 0xC2B2AE3D27D4EB4Full;
+		return mix(h);
+	}
+
+private:
+	static constexpr int stripes = 4;
+	static constexpr uint64_t key_step = 0x9E3779B97F4A7C15ull;
+
+#if defined(_M_X64) || defined(__SSE2__)
+	static void round(__m128i &acc, __m128i &key, __m128i v)
+	{
+		const __m128i k = _mm_xor_si128(v, key);
+		acc = _mm_add_epi64(acc, _mm_add_epi64(_mm_mul_epu32(k, _mm_shuffle_epi32(k, _MM_SHUFFLE(2, 3, 0, 1))), v));
+		key = _mm_add_epi64(key, _mm_set1_epi64x(static_cast<long long>(key_step)));
+	}
+#else
+	static void round(uint64_t *acc, uint64_t *key, const unsigned char *data)
+	{
+		for (int lane = 0; lane < 2; ++lane)
+		{
+			uint64_t v;
+			std::memcpy(&v, data + lane * 8, 8);
+			const uint64_t k = v ^ key[lane];
+			acc[lane] += (k & 0xFFFFFFFFull) * (k >> 32) + v;
+			key[lane] += key_step;
+		}
+	}
+#endif
+
+	static uint64_t mix(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	uint64_t _steps = 0;
+#if defined(_M_X64) || defined(__SSE2__)
+	__m128i _acc[stripes], _key[stripes];
+#else
+	uint64_t _acc[stripes * 2], _key[stripes * 2];
+#endif
+};
+
+// Sums of the texels of a row, taken in the inner loop of a conversion, where even the hash above costs about as much as the conversion. Like
+// Fletcher's checksum there is a running sum of the texels and a sum of the running sums, which weights every texel by how far it is from the
+// end of the row, so moved content changes it. That is two integer adds per texel, with no multiply, which run alongside the loads and stores
+// of the conversion. Every 32-bit lane only sees its own channel, so channels that are not exported are masked out once per row in fold(),
+// which steps the hash with both sums of the row. The hash mixes the rows properly, the sums only have to tell texels of one row apart.
+class content_row_sum
+{
+public:
+	// Bit c of `channel_mask` takes channel c of the RGBA32F texels
+	explicit content_row_sum(uint32_t channel_mask)
+	{
+		for (int c = 0; c < 4; ++c)
+			_mask[c] = (channel_mask & (1u << c)) != 0 ? ~0u : 0u;
+#if defined(_M_X64) || defined(__SSE2__)
+		_mask_v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_mask));
+#endif
+		reset();
+	}
+
+	void add(const float *texel)
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		_sum = _mm_add_epi32(_sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(texel)));
+		_weighted = _mm_add_epi32(_weighted, _sum);
+#else
+		for (int c = 0; c < 4; ++c)
+		{
+			uint32_t v;
+			std::memcpy(&v, texel + c, sizeof(v));
+			_sum[c] += v;
+			_weighted[c] += _sum[c];
+		}
+#endif
+	}
+
+	// Hashes the sums of the row and starts the next one
+	void fold(content_hash &hash)
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		const __m128i sums[2] = { _mm_and_si128(_sum, _mask_v), _mm_and_si128(_weighted, _mask_v) };
+#else
+		uint32_t sums[2][4];
+		for (int c = 0; c < 4; ++c)
+		{
+			sums[0][c] = _sum[c] & _mask[c];
+			sums[1][c] = _weighted[c] & _mask[c];
+		}
+#endif
+		hash.step(&sums[0]);
+		hash.step(&sums[1]);
+		reset();
+	}
+
+private:
+	void reset()
+	{
+#if defined(_M_X64) || defined(__SSE2__)
+		_sum = _weighted = _mm_setzero_si128();
+#else
+		std::memset(_sum, 0, sizeof(_sum));
+		std::memset(_weighted, 0, sizeof(_weighted));
+#endif
+	}
+
+	uint32_t _mask[4];
+#if defined(_M_X64) || defined(__SSE2__)
+	__m128i _mask_v, _sum, _weighted;
+#else
+	uint32_t _sum[4], _weighted[4];
+#endif
+};
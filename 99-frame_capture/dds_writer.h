@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// Textures stored as they are in GPU memory behind a DDS header with the DX10 extension, which names the DXGI format.
+// Nothing is converted, a capture costs about as much as copying the rows.
+
+static constexpr uint32_t dds_magic = 0x20534444; // "DDS "
+static constexpr size_t dds_header_size = 4 + 124 + 20;
+
+// Subset of DXGI_FORMAT, the values of reshade::api::format are the same
+enum dds_format : uint32_t
+{
+	dds_format_r32g32b32a32_float = 2,
+	dds_format_r32_float = 41
+};
+
+// Writes the dds_header_size bytes of the header of a 2D texture without mipmaps, `row_size` is the pitch of the rows in the file
+inline void write_dds_header(void *out, uint32_t dxgi_format, uint32_t width, uint32_t height, uint32_t row_size)
+{
+	uint32_t header[dds_header_size / 4] = {};
+	header[0] = dds_magic;
+	header[1] = 124; // dwSize
+	header[2] = 0x1 | 0x2 | 0x4 | 0x8 | 0x1000; // DDSD_CAPS, DDSD_HEIGHT, DDSD_WIDTH, DDSD_PITCH, DDSD_PIXELFORMAT
+	header[3] = height;
+	header[4] = width;
+	header[5] = row_size; // dwPitchOrLinearSize
+	header[7] = 1; // dwMipMapCount
+	header[19] = 32; // ddspf.dwSize
+	header[20] = 0x4; // DDPF_FOURCC
+	header[21] = 0x30315844; // "DX10"
+	header[27] = 0x1000; // DDSCAPS_TEXTURE
+	header[32] = dxgi_format;
+	header[33] = 3; // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+	header[35] = 1; // arraySize
+	std::memcpy(out, header, dds_header_size);
+}
+
+// Reads the header of a file written with write_dds_header, the pixel data follows right after it
+inline bool read_dds_header(std::ifstream &file, uint32_t &dxgi_format, uint32_t &width, uint32_t &height, uint32_t &row_size)
+{
+	uint32_t header[dds_header_size / 4] = {};
+	file.read(reinterpret_cast<char *>(header), dds_header_size);
+	if (!file || header[0] != dds_magic || header[1] != 124 || header[21] != 0x30315844 || header[33] != 3)
+		return false;
+	height = header[3];
+	width = header[4];
+	row_size = header[5];
+	dxgi_format = header[32];
+	return true;
+}
+
+// Copies rows that are `src_pitch` apart, like the 256 byte aligned rows of a D3D12 readback, to rows of `row_size`
+inline void copy_dds_rows(void *dst, const void *src, uint32_t src_pitch, uint32_t row_size, uint32_t height)
+{
+	if (src_pitch == row_size)
+	{
+		std::memcpy(dst, src, static_cast<size_t>(row_size) * height);
+		return;
+	}
+	for (uint32_t y = 0; y < height; ++y)
+		std::memcpy(static_cast<unsigned char *>(dst) + static_cast<size_t>(y) * row_size, static_cast<const unsigned char *>(src) + static_cast<size_t>(y) * src_pitch, row_size);
+}
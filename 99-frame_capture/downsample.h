@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Depth and normals exported at a half or a quarter of the resolution. Every 2x2 or 4x4 block of the export texture is reduced to one texel
+// while it is converted, so the full resolution planes are never written. Depth takes the closest, farthest or mean value of the block,
+// as an average would put a depth between foreground and background on silhouettes. Normals are averaged and scaled back to unit length.
+enum class export_scale : int
+{
+	full,
+	half,
+	quarter
+};
+
+inline constexpr const char *export_scale_names[] = { "Full resolution", "Half (2x2 blocks)", "Quarter (4x4 blocks)" };
+
+// Depth of the export is linear and grows away from the camera, so the closest texel of a block is the smallest
+enum class depth_reduction : int
+{
+	closest,
+	farthest,
+	average
+};
+
+inline constexpr const char *depth_reduction_names[] = { "Closest to camera (min)", "Farthest (max)", "Average" };
+
+inline uint32_t export_scale_factor(export_scale scale)
+{
+	return scale == export_scale::quarter ? 4 : scale == export_scale::half ? 2 : 1;
+}
+
+// Blocks at the right and bottom edge of frames that do not divide evenly only cover what is left
+inline uint32_t scaled_size(uint32_t size, uint32_t factor)
+{
+	return (size + factor - 1) / factor;
+}
+
+// Reduces the block of `columns` texels at `x` of each of the `row_count` rows to `out`. Texels have `channels` floats, depth is in the last one.
+// With RGBA32F, which the export texture is, a texel is one SSE register and the whole block is reduced with vertical min, max or add.
+inline void reduce_block(const float *const *rows, uint32_t row_count, uint32_t x, uint32_t columns, uint32_t channels, bool depth, depth_reduction reduction, float out[4])
+{
+	const float scale = 1.0f / static_cast<float>(row_count * columns);
+	const bool average = !depth || reduction == depth_reduction::average;
+#if defined(_M_X64) || defined(__SSE2__)
+	if (channels == 4)
+	{
+		__m128 acc = _mm_loadu_ps(rows[0] + static_cast<size_t>(x) * 4);
+		for (uint32_t r = 0; r < row_count; ++r)
+		{
+			const float *const src = rows[r] + static_cast<size_t>(x) * 4;
+			for (uint32_t c = r == 0 ? 1 : 0; c < columns; ++c)
+			{
+				const __m128 v = _mm_loadu_ps(src + c * 4);
+				acc = average ? _mm_add_ps(acc, v) : reduction == depth_reduction::closest ? _mm_min_ps(acc, v) : _mm_max_ps(acc, v);
+			}
+		}
+		if (average)
+			acc = _mm_mul_ps(acc, _mm_set1_ps(scale));
+		_mm_storeu_ps(out, acc);
+	}
+	else
+#endif
+	{
+		float acc[4] = {};
+		for (uint32_t i = 0; i < channels && i < 4; ++i)
+			acc[i] = rows[0][static_cast<size_t>(x) * channels + i];
+		for (uint32_t r = 0; r < row_count; ++r)
+		{
+			const float *const src = rows[r] + static_cast<size_t>(x) * channels;
+			for (uint32_t c = r == 0 ? 1 : 0; c < columns; ++c)
+			{
+				for (uint32_t i = 0; i < channels && i < 4; ++i)
+				{
+					const float v = src[c * channels + i];
+					acc[i] = average ? acc[i] + v : reduction == depth_reduction::closest ? std::min(acc[i], v) : std::max(acc[i], v);
+				}
+			}
+		}
+		for (uint32_t i = 0; i < 4; ++i)
+			out[i] = average ? acc[i] * scale : acc[i];
+	}
+
+	if (!depth)
+	{
+		const float length = std::sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+		if (length > 0.0f)
+		{
+			out[0] /= length;
+			out[1] /= length;
+			out[2] /= length;
+		}
+	}
+}
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <vector>
+#include <reshade_api_pipeline.hpp>
+#include <reshade_api_resource.hpp>
+
+// Add-on events of a game recorded to a compact binary trace, so the per-event work of the add-on can be measured and regressed off the game machine.
+// A trace starts with "FCEV" and a version, then one record per event: its type as a byte followed by its fields as LEB128 varints.
+// Command events name their command list only when it differs from the one of the previous command event, which most of them do not.
+
+enum class trace_event : uint8_t
+{
+	init_resource = 1,
+	destroy_resource,
+	init_resource_view,
+	destroy_resource_view,
+	bind_render_targets_and_depth_stencil,
+	bind_viewports,
+	clear_depth_stencil_view,
+	draw,
+	draw_indexed,
+	draw_or_dispatch_indirect,
+	present
+};
+
+static constexpr uint32_t trace_event_count = 12;
+inline constexpr const char *trace_event_names[trace_event_count] = { "", "init_resource", "destroy_resource", "init_resource_view", "destroy_resource_view", "bind_render_targets_and_depth_stencil",
+	"bind_viewports", "clear_depth_stencil_view", "draw", "draw_indexed", "draw_or_dispatch_indirect", "present" };
+
+// One event with every field any of them has, the ones of other events are left alone
+struct trace_record
+{
+	static constexpr uint32_t max_views = 8;
+	static constexpr uint32_t max_viewports = 16;
+
+	trace_event type = trace_event::present;
+	uint64_t object = 0; // Command list of command events, command queue of presents
+	uint64_t handle = 0; // Resource, view, depth-stencil view or indirect buffer
+	uint64_t parent = 0; // Resource of a view, swap chain of a present
+	reshade::api::resource_desc desc;
+	reshade::api::resource_view_desc view_desc;
+	reshade::api::resource_usage usage = reshade::api::resource_usage::undefined;
+	uint32_t count = 0; // Render target views or viewports
+	uint32_t first = 0;
+	uint64_t views[max_views] = {};
+	reshade::api::viewport viewports[max_viewports] = {};
+	uint32_t args[5] = {}; // Of draws, draw_indexed keeps its vertex offset as a signed value
+	uint64_t offset = 0;
+	bool has_depth = false;
+	bool has_stencil = false;
+	float depth = 0.0f;
+	uint8_t stencil = 0;
+	uint32_t rect_count = 0;
+};
+
+class event_trace_writer
+{
+public:
+	static constexpr uint32_t version = 1;
+
+	bool open(const std::filesystem::path &path)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		close_locked();
+		_file.open(path, std::ios::binary | std::ios::trunc);
+		if (!_file.is_open())
+			return false;
+		_file.write("FCEV", 4);
+		_file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+		_last_command_list = 0;
+		_events = 0;
+		_bytes = 8;
+		_open = true;
+		return true;
+	}
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		close_locked();
+	}
+	// Checked by every hook before anything else, so hooks cost a load while nothing is recorded
+	bool is_open() const { return _open.load(std::memory_order_relaxed); }
+	// Read by the overlay without the lock, bytes counts records still in the buffer as well
+	uint64_t events() const { return _events.load(std::memory_order_relaxed); }
+	uint64_t bytes() const { return _bytes.load(std::memory_order_relaxed); }
+
+	void write(const trace_record &record)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_open)
+			return;
+
+		const size_t start = _buffer.size();
+		put(static_cast<uint8_t>(record.type));
+		switch (record.type)
+		{
+		case trace_event::init_resource:
+			put_varint(record.handle);
+			put_varint(static_cast<uint64_t>(record.desc.type));
+			if (record.desc.type == reshade::api::resource_type::buffer)
+			{
+				put_varint(record.desc.buffer.size);
+				put_varint(record.desc.buffer.stride);
+			}
+			else
+			{
+				put_varint(record.desc.texture.width);
+				put_varint(record.desc.texture.height);
+				put_varint(record.desc.texture.depth_or_layers);
+				put_varint(record.desc.texture.levels);
+				put_varint(static_cast<uint64_t>(record.desc.texture.format));
+				put_varint(record.desc.texture.samples);
+			}
+			put_varint(static_cast<uint64_t>(record.desc.heap));
+			put_varint(static_cast<uint64_t>(record.desc.usage));
+			put_varint(static_cast<uint64_t>(record.desc.flags));
+			put_varint(static_cast<uint64_t>(record.usage));
+			break;
+		case trace_event::destroy_resource:
+		case trace_event::destroy_resource_view:
+			put_varint(record.handle);
+			break;
+		case trace_event::init_resource_view:
+		{
+			put_varint(record.handle);
+			put_varint(record.parent);
+			put_varint(static_cast<uint64_t>(record.usage));
+			put_varint(static_cast<uint64_t>(record.view_desc.type));
+			put_varint(static_cast<uint64_t>(record.view_desc.format));
+			// Both members of the union as two words, whichever of them is used
+			uint64_t words[2];
+			std::memcpy(words, &record.view_desc.buffer, sizeof(words));
+			put_varint(words[0]);
+			put_varint(words[1]);
+			break;
+		}
+		case trace_event::bind_render_targets_and_depth_stencil:
+			put_command_list(record.object);
+			put_varint(record.count);
+			for (uint32_t i = 0; i < record.count && i < trace_record::max_views; ++i)
+				put_varint(record.views[i]);
+			put_varint(record.handle);
+			break;
+		case trace_event::bind_viewports:
+			put_command_list(record.object);
+			put_varint(record.first);
+			put_varint(record.count);
+			for (uint32_t i = 0; i < record.count && i < trace_record::max_viewports; ++i)
+				put_bytes(&record.viewports[i], sizeof(reshade::api::viewport));
+			break;
+		case trace_event::clear_depth_stencil_view:
+			put_command_list(record.object);
+			put_varint(record.handle);
+			put((record.has_depth ? 1 : 0) | (record.has_stencil ? 2 : 0));
+			if (record.has_depth)
+				put_bytes(&record.depth, sizeof(record.depth));
+			if (record.has_stencil)
+				put(record.stencil);
+			put_varint(record.rect_count);
+			break;
+		case trace_event::draw:
+		case trace_event::draw_indexed:
+			put_command_list(record.object);
+			for (uint32_t i = 0; i < (record.type == trace_event::draw ? 4u : 5u); ++i)
+				put_varint(record.type == trace_event::draw_indexed && i == 3 ? zigzag(static_cast<int32_t>(record.args[i])) : record.args[i]);
+			break;
+		case trace_event::draw_or_dispatch_indirect:
+			put_command_list(record.object);
+			put_varint(record.args[0]); // Indirect command type
+			put_varint(record.handle);
+			put_varint(record.offset);
+			put_varint(record.args[1]);
+			put_varint(record.args[2]);
+			break;
+		case trace_event::present:
+			put_varint(record.object);
+			put_varint(record.parent);
+			break;
+		}
+
+		_events.fetch_add(1, std::memory_order_relaxed);
+		_bytes.fetch_add(_buffer.size() - start, std::memory_order_relaxed);
+		if (_buffer.size() >= flush_size)
+			flush_locked();
+	}
+
+private:
+	static constexpr size_t flush_size = 1 << 20;
+
+	static uint64_t zigzag(int32_t value) { return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31); }
+
+	void put(uint8_t value) { _buffer.push_back(value); }
+	void put_bytes(const void *data, size_t size)
+	{
+		const uint8_t *const bytes = static_cast<const uint8_t *>(data);
+		_buffer.insert(_buffer.end(), bytes, bytes + size);
+	}
+	void put_varint(uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			_buffer.push_back(static_cast<uint8_t>(value) | 0x80);
+			value >>= 7;
+		}
+		_buffer.push_back(static_cast<uint8_t>(value));
+	}
+	// Zero stands for the command list of the previous command event
+	void put_command_list(uint64_t handle)
+	{
+		put_varint(handle == _last_command_list ? 0 : handle);
+		_last_command_list = handle;
+	}
+
+	void flush_locked()
+	{
+		_file.write(reinterpret_cast<const char *>(_buffer.data()), _buffer.size());
+		_buffer.clear();
+	}
+	void close_locked()
+	{
+		if (!_open)
+			return;
+		flush_locked();
+		_file.close();
+		_open = false;
+	}
+
+	std::mutex _mutex;
+	std::ofstream _file;
+	std::vector<uint8_t> _buffer;
+	std::atomic<bool> _open { false };
+	uint64_t _last_command_list = 0;
+	std::atomic<uint64_t> _events { 0 };
+	std::atomic<uint64_t> _bytes { 0 };
+};
+
+// Reads a whole trace into memory and hands out its records in order
+class event_trace_reader
+{
+public:
+	bool open(const std::filesystem::path &path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+			return false;
+		_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		uint32_t file_version = 0;
+		if (_data.size() < 8 || std::memcmp(_data.data(), "FCEV", 4) != 0)
+			return false;
+		std::memcpy(&file_version, _data.data() + 4, sizeof(file_version));
+		_pos = 8;
+		_last_command_list = 0;
+		return file_version == event_trace_writer::version;
+	}
+	size_t size() const { return _data.size(); }
+	bool at_end() const { return _pos >= _data.size(); }
+	void rewind()
+	{
+		_pos = 8;
+		_last_command_list = 0;
+	}
+
+	// False at the end of the trace or at a record that was cut off
+	bool next(trace_record &record)
+	{
+		if (_pos >= _data.size())
+			return false;
+		const uint8_t type = _data[_pos++];
+		if (type == 0 || type >= trace_event_count)
+			return false;
+		record.type = static_cast<trace_event>(type);
+		_ok = true;
+
+		switch (record.type)
+		{
+		case trace_event::init_resource:
+			record.handle = get_varint();
+			record.desc.type = static_cast<reshade::api::resource_type>(get_varint());
+			if (record.desc.type == reshade::api::resource_type::buffer)
+			{
+				record.desc.buffer.size = get_varint();
+				record.desc.buffer.stride = static_cast<uint32_t>(get_varint());
+			}
+			else
+			{
+				record.desc.texture.width = static_cast<uint32_t>(get_varint());
+				record.desc.texture.height = static_cast<uint32_t>(get_varint());
+				record.desc.texture.depth_or_layers = static_cast<uint16_t>(get_varint());
+				record.desc.texture.levels = static_cast<uint16_t>(get_varint());
+				record.desc.texture.format = static_cast<reshade::api::format>(get_varint());
+				record.desc.texture.samples = static_cast<uint16_t>(get_varint());
+			}
+			record.desc.heap = static_cast<reshade::api::memory_heap>(get_varint());
+			record.desc.usage = static_cast<reshade::api::resource_usage>(get_varint());
+			record.desc.flags = static_cast<reshade::api::resource_flags>(get_varint());
+			record.usage = static_cast<reshade::api::resource_usage>(get_varint());
+			break;
+		case trace_event::destroy_resource:
+		case trace_event::destroy_resource_view:
+			record.handle = get_varint();
+			break;
+		case trace_event::init_resource_view:
+		{
+			record.handle = get_varint();
+			record.parent = get_varint();
+			record.usage = static_cast<reshade::api::resource_usage>(get_varint());
+			record.view_desc.type = static_cast<reshade::api::resource_view_type>(get_varint());
+			record.view_desc.format = static_cast<reshade::api::format>(get_varint());
+			uint64_t words[2];
+			words[0] = get_varint();
+			words[1] = get_varint();
+			std::memcpy(&record.view_desc.buffer, words, sizeof(words));
+			break;
+		}
+		case trace_event::bind_render_targets_and_depth_stencil:
+			record.object = get_command_list();
+			record.count = static_cast<uint32_t>(get_varint());
+			for (uint32_t i = 0; i < record.count; ++i)
+			{
+				const uint64_t view = get_varint();
+				if (i < trace_record::max_views)
+					record.views[i] = view;
+			}
+			record.count = std::min(record.count, trace_record::max_views);
+			record.handle = get_varint();
+			break;
+		case trace_event::bind_viewports:
+			record.object = get_command_list();
+			record.first = static_cast<uint32_t>(get_varint());
+			record.count = static_cast<uint32_t>(get_varint());
+			record.count = std::min(record.count, trace_record::max_viewports);
+			for (uint32_t i = 0; i < record.count; ++i)
+				get_bytes(&record.viewports[i], sizeof(reshade::api::viewport));
+			break;
+		case trace_event::clear_depth_stencil_view:
+		{
+			record.object = get_command_list();
+			record.handle = get_varint();
+			uint8_t flags = 0;
+			get_bytes(&flags, 1);
+			record.has_depth = (flags & 1) != 0;
+			record.has_stencil = (flags & 2) != 0;
+			if (record.has_depth)
+				get_bytes(&record.depth, sizeof(record.depth));
+			if (record.has_stencil)
+				get_bytes(&record.stencil, 1);
+			record.rect_count = static_cast<uint32_t>(get_varint());
+			break;
+		}
+		case trace_event::draw:
+		case trace_event::draw_indexed:
+			record.object = get_command_list();
+			for (uint32_t i = 0; i < (record.type == trace_event::draw ? 4u : 5u); ++i)
+			{
+				const uint64_t value = get_varint();
+				record.args[i] = static_cast<uint32_t>(record.type == trace_event::draw_indexed && i == 3 ? static_cast<uint32_t>(static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1)) : value);
+			}
+			break;
+		case trace_event::draw_or_dispatch_indirect:
+			record.object = get_command_list();
+			record.args[0] = static_cast<uint32_t>(get_varint());
+			record.handle = get_varint();
+			record.offset = get_varint();
+			record.args[1] = static_cast<uint32_t>(get_varint());
+			record.args[2] = static_cast<uint32_t>(get_varint());
+			break;
+		case trace_event::present:
+			record.object = get_varint();
+			record.parent = get_varint();
+			break;
+		}
+		return _ok;
+	}
+
+private:
+	uint64_t get_varint()
+	{
+		uint64_t value = 0;
+		for (uint32_t shift = 0; shift < 64; shift += 7)
+		{
+			if (_pos >= _data.size())
+				break;
+			const uint8_t byte = _data[_pos++];
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return value;
+		}
+		_ok = false;
+		return 0;
+	}
+	void get_bytes(void *data, size_t size)
+	{
+		if (_pos + size > _data.size())
+		{
+			_ok = false;
+			_pos = _data.size();
+			return;
+		}
+		std::memcpy(data, _data.data() + _pos, size);
+		_pos += size;
+	}
+	uint64_t get_command_list()
+	{
+		const uint64_t handle = get_varint();
+		if (handle != 0)
+			_last_command_list = handle;
+		return _last_command_list;
+	}
+
+	std::vector<uint8_t> _data;
+	size_t _pos = 0;
+	uint64_t _last_command_list = 0;
+	bool _ok = true;
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "tinyexr.h"
+
+// Compression modes exposed in the settings, "Auto" picks one of the fixed codecs per frame
+enum class exr_compression : int
+{
+	none,
+	rle,
+	zip,
+	piz,
+	automatic
+};
+
+inline constexpr const char *exr_compression_names[] = { "None", "RLE", "ZIP", "PIZ", "Auto" };
+
+inline int exr_compression_to_tinyexr(exr_compression compression)
+{
+	switch (compression)
+	{
+	case exr_compression::rle:
+		return TINYEXR_COMPRESSIONTYPE_RLE;
+	case exr_compression::zip:
+		return TINYEXR_COMPRESSIONTYPE_ZIP;
+	case exr_compression::piz:
+		return TINYEXR_COMPRESSIONTYPE_PIZ;
+	default:
+		return TINYEXR_COMPRESSIONTYPE_NONE;
+	}
+}
+
+// Budget for the automatic mode, zero disables the respective limit
+struct exr_auto_target
+{
+	float max_ms = 0.0f;
+	uint64_t max_bytes = 0;
+};
+
+struct exr_content_stats
+{
+	float run_fraction = 0.0f; // Share of predicted bytes that sit in runs of three or more
+	float duplicate_fraction = 0.0f; // Share of channel lines that repeat another channel of the same line (depth is written to all three)
+	float entropy = 8.0f; // Order-0 entropy in bits per byte of the remaining bytes
+	float rle_ratio = 1.0f; // Exact RLE output size of the sampled blocks divided by their input size
+	uint64_t sampled_bytes = 0;
+};
+
+// Weighted order-0 entropy over a set of histograms, one per byte lane of a float or half
+inline double exr_lane_entropy(const uint64_t (&histogram)[4][256])
+{
+	uint64_t total = 0;
+	double entropy = 0.0;
+	for (const auto &lane : histogram)
+	{
+		uint64_t lane_total = 0;
+		for (uint64_t count : lane)
+			lane_total += count;
+		for (uint64_t count : lane)
+			if (count != 0)
+				entropy -= count * std::log2(static_cast<double>(count) / lane_total);
+		total += lane_total;
+	}
+	return total != 0 ? entropy / total : 8.0;
+}
+
+// Samples a few 32 scanline blocks of the planar channels and runs the same byte reorder and predictor
+// that the RLE and ZIP compressors in tinyexr apply, so the statistics describe what the codecs actually see.
+// Values are 4 byte floats or 2 byte halfs.
+inline exr_content_stats exr_sample_content(const unsigned char *const *planes, int value_size, int num_channels, int width, int height, int num_samples = 8)
+{
+	exr_content_stats stats;
+	if (width <= 0 || height <= 0 || num_channels <= 0 || (value_size != 2 && value_size != 4))
+		return stats;
+	const size_t lane_mask = static_cast<size_t>(value_size) - 1;
+
+	const int block_lines = 32;
+	const int num_blocks = (height + block_lines - 1) / block_lines;
+	if (num_samples > num_blocks)
+		num_samples = num_blocks;
+
+	const size_t channel_line_size = static_cast<size_t>(width) * value_size;
+	const size_t line_size = channel_line_size * num_channels;
+
+	std::vector<unsigned char> block;
+	std::vector<unsigned char> reordered;
+	// Exponent and mantissa bytes behave very differently, so keep one histogram per byte lane,
+	// for the raw bytes as well as for the predicted ones and use whichever codes smaller
+	uint64_t raw_histogram[4][256] = {};
+	uint64_t predicted_histogram[4][256] = {};
+	uint64_t run_bytes = 0, rle_bytes = 0, duplicate_bytes = 0, total_bytes = 0;
+
+	for (int s = 0; s < num_samples; ++s)
+	{
+		const int block_index = num_samples > 1 ? (s * (num_blocks - 1)) / (num_samples - 1) : 0;
+		const int start_y = block_index * block_lines;
+		const int num_lines = std::min(block_lines, height - start_y);
+
+		// Scanline layout of an EXR block: each line holds all channels one after another
+		block.resize(line_size * num_lines);
+		for (int y = 0; y < num_lines; ++y)
+		{
+			for (int c = 0; c < num_channels; ++c)
+			{
+				const unsigned char *const src = planes[c] + static_cast<size_t>(start_y + y) * channel_line_size;
+				unsigned char *const dst = block.data() + y * line_size + c * channel_line_size;
+				std::memcpy(dst, src, channel_line_size);
+
+				bool duplicate = false;
+				for (int prev = 0; prev < c && !duplicate; ++prev)
+					duplicate = std::memcmp(dst, dst - (c - prev) * channel_line_size, channel_line_size) == 0;
+
+				if (duplicate)
+					duplicate_bytes += channel_line_size;
+				else
+					for (size_t i = 0; i < channel_line_size; ++i)
+						raw_histogram[i & lane_mask][dst[i]]++;
+			}
+		}
+
+		const size_t size = block.size();
+		const size_t half = (size + 1) / 2;
+		reordered.resize(size);
+		for (size_t i = 0, t1 = 0, t2 = half; i < size; ++i)
+			reordered[(i & 1) ? t2++ : t1++] = block[i];
+		for (size_t i = size - 1; i > 0; --i)
+			reordered[i] = static_cast<unsigned char>(int(reordered[i]) - int(reordered[i - 1]) + (128 + 256));
+
+		// Byte lane within the source value of a reordered position
+		const auto lane = [half, lane_mask](size_t j) { return (j < half ? 2 * j : 2 * (j - half) + 1) & lane_mask; };
+
+		// Walk the predicted bytes like rleCompress does to get the exact RLE size
+		size_t i = 0;
+		while (i < size)
+		{
+			size_t run = 1;
+			while (i + run < size && reordered[i + run] == reordered[i] && run < 128)
+				++run;
+
+			if (run >= 3)
+			{
+				run_bytes += run;
+				rle_bytes += 2;
+				i += run;
+			}
+			else
+			{
+				size_t literal = 1;
+				predicted_histogram[lane(i)][reordered[i]]++;
+				while (i + literal < size && literal < 127 &&
+					!(i + literal + 2 < size && reordered[i + literal] == reordered[i + literal + 1] && reordered[i + literal] == reordered[i + literal + 2]))
+				{
+					predicted_histogram[lane(i + literal)][reordered[i + literal]]++;
+					++literal;
+				}
+				rle_bytes += literal + 1;
+				i += literal;
+			}
+		}
+
+		total_bytes += size;
+	}
+
+	if (total_bytes == 0)
+		return stats;
+
+	stats.run_fraction = static_cast<float>(static_cast<double>(run_bytes) / total_bytes);
+	stats.duplicate_fraction = static_cast<float>(static_cast<double>(duplicate_bytes) / total_bytes);
+	stats.entropy = static_cast<float>(std::min(exr_lane_entropy(raw_histogram), exr_lane_entropy(predicted_histogram)));
+	stats.rle_ratio = std::min(1.0f, static_cast<float>(static_cast<double>(rle_bytes) / total_bytes));
+	stats.sampled_bytes = total_bytes;
+	return stats;
+}
+inline exr_content_stats exr_sample_content(const float *const *planes, int num_channels, int width, int height, int num_samples = 8)
+{
+	const unsigned char *byte_planes[4] = {};
+	for (int c = 0; c < num_channels && c < 4; ++c)
+		byte_planes[c] = reinterpret_cast<const unsigned char *>(planes[c]);
+	return exr_sample_content(byte_planes, 4, std::min(num_channels, 4), width, height, num_samples);
+}
+
+// Cost model for the fixed codecs, calibrated from the real encodes of previous captures
+struct exr_codec_model
+{
+	// Single threaded encode cost in milliseconds per MB of raw pixel data
+	float ms_per_mb[4] = { 0.4f, 2.5f, 22.0f, 9.0f };
+	// Correction of the estimated compression ratio against the measured one
+	float ratio_scale[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+	float estimate_ratio(exr_compression compression, const exr_content_stats &stats) const
+	{
+		float ratio = 1.0f;
+		switch (compression)
+		{
+		case exr_compression::rle:
+			ratio = stats.rle_ratio;
+			break;
+		case exr_compression::zip:
+			// Deflate collapses runs and repeated channel lines almost for free and Huffman codes the rest close to its order-0 entropy
+			ratio = (1.0f - stats.duplicate_fraction) * ((1.0f - stats.run_fraction) * (stats.entropy / 8.0f) + stats.run_fraction * 0.02f) + stats.duplicate_fraction * 0.01f;
+			break;
+		case exr_compression::piz:
+			// PIZ works on 16-bit words after a wavelet pass, which gains less on runs but more on smooth gradients
+			ratio = (1.0f - stats.run_fraction * 0.9f) * (stats.entropy / 8.0f) * 0.92f + stats.run_fraction * 0.04f;
+			break;
+		default:
+			break;
+		}
+		return std::min(1.0f, std::max(0.01f, ratio * ratio_scale[static_cast<int>(compression)]));
+	}
+	float estimate_ms(exr_compression compression, const exr_content_stats &stats, uint64_t raw_bytes) const
+	{
+		float speedup = 1.0f;
+		// Long runs are cheap for deflate's matcher
+		if (compression == exr_compression::zip)
+			speedup += 2.0f * stats.run_fraction;
+		return ms_per_mb[static_cast<int>(compression)] * (raw_bytes / (1024.0f * 1024.0f)) / speedup;
+	}
+
+	void update(exr_compression compression, const exr_content_stats &stats, uint64_t raw_bytes, uint64_t out_bytes, float ms)
+	{
+		const int i = static_cast<int>(compression);
+		if (raw_bytes == 0 || i < 0 || i > 3)
+			return;
+
+		const float mb = raw_bytes / (1024.0f * 1024.0f);
+		float speedup = 1.0f;
+		if (compression == exr_compression::zip)
+			speedup += 2.0f * stats.run_fraction;
+		ms_per_mb[i] = 0.75f * ms_per_mb[i] + 0.25f * (ms * speedup / mb);
+
+		const float estimated = estimate_ratio(compression, stats) / ratio_scale[i];
+		const float measured = static_cast<float>(static_cast<double>(out_bytes) / raw_bytes);
+		if (estimated > 0.0f)
+			ratio_scale[i] = std::min(4.0f, std::max(0.25f, 0.75f * ratio_scale[i] + 0.25f * (measured / estimated)));
+	}
+};
+
+struct exr_codec_decision
+{
+	exr_compression compression = exr_compression::piz;
+	exr_content_stats stats;
+	float estimated_ms = 0.0f;
+	uint64_t estimated_bytes = 0;
+	char reason[160] = "";
+};
+
+// Picks the codec for one frame:
+// - with a time limit the smallest output among the codecs that fit it (or the fastest if none does)
+// - with a size limit the fastest codec among the ones that fit it (or the smallest if none does)
+// - without limits the lowest combined cost, counting every MB written as 2 ms of disk time
+inline exr_codec_decision exr_choose_codec(const exr_content_stats &stats, uint64_t raw_bytes, const exr_auto_target &target, const exr_codec_model &model)
+{
+	static const exr_compression candidates[] = { exr_compression::rle, exr_compression::zip, exr_compression::piz, exr_compression::none };
+
+	float ms[4];
+	uint64_t bytes[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		ms[i] = model.estimate_ms(candidates[i], stats, raw_bytes);
+		bytes[i] = static_cast<uint64_t>(model.estimate_ratio(candidates[i], stats) * raw_bytes);
+	}
+
+	int best = -1;
+	const char *rule = "";
+	const bool limit_ms = target.max_ms > 0.0f;
+	const bool limit_bytes = target.max_bytes != 0;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		// Uncompressed output is only a last resort when nothing else meets a time limit
+		if (candidates[i] == exr_compression::none)
+			continue;
+		if ((limit_ms && ms[i] > target.max_ms) || (limit_bytes && bytes[i] > target.max_bytes))
+			continue;
+
+		if (best < 0 ||
+			(limit_ms && bytes[i] < bytes[best]) ||
+			(!limit_ms && limit_bytes && ms[i] < ms[best]) ||
+			(!limit_ms && !limit_bytes && ms[i] + 2.0f * bytes[i] / (1024.0f * 1024.0f) < ms[best] + 2.0f * bytes[best] / (1024.0f * 1024.0f)))
+			best = i;
+	}
+
+	if (best >= 0)
+	{
+		rule = limit_ms ? (limit_bytes ? "smallest within time and size limit" : "smallest within time limit") : (limit_bytes ? "fastest within size limit" : "lowest encode + write cost");
+	}
+	else if (limit_ms)
+	{
+		best = 0;
+		for (int i = 1; i < 4; ++i)
+			if (ms[i] < ms[best])
+				best = i;
+		rule = "no codec meets the time limit, fastest";
+	}
+	else
+	{
+		best = 0;
+		for (int i = 1; i < 3; ++i)
+			if (bytes[i] < bytes[best])
+				best = i;
+		rule = "no codec meets the size limit, smallest";
+	}
+
+	exr_codec_decision decision;
+	decision.compression = candidates[best];
+	decision.stats = stats;
+	decision.estimated_ms = ms[best];
+	decision.estimated_bytes = bytes[best];
+	std::snprintf(decision.reason, sizeof(decision.reason), "%s (runs %.0f%%, repeated channels %.0f%%, entropy %.2f bit, est. %.1f ms, %.1f MB)",
+		rule, stats.run_fraction * 100.0f, stats.duplicate_fraction * 100.0f, stats.entropy, ms[best], bytes[best] / (1024.0f * 1024.0f));
+	return decision;
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include "miniz.h"
+#include "exr_codec.h"
+#include "exr_writer.h"
+
+// Writes an EXR of three channels, B, G and R, chunk by chunk straight to the file, so neither the frame nor the encoded file is ever held in
+// memory and writing can stop after any chunk and go on later. The offset table is reserved after the header and filled in by finish(), which
+// is possible because chunks are independent. Chunks are stored uncompressed, RLE or ZIP compressed like OpenEXR does: the bytes are split
+// into even and odd halves and delta predicted first. PIZ has no form that works chunk by chunk here and is written as ZIP.
+class exr_stream_writer
+{
+public:
+	~exr_stream_writer() { finish(); }
+
+	uint64_t file_bytes() const { return _file_bytes; }
+
+	static int chunk_compression(exr_compression compression)
+	{
+		return compression == exr_compression::none ? TINYEXR_COMPRESSIONTYPE_NONE :
+			compression == exr_compression::rle ? TINYEXR_COMPRESSIONTYPE_RLE : TINYEXR_COMPRESSIONTYPE_ZIP;
+	}
+
+protected:
+	// Writes the header, `tile_size` zero for scanlines, and reserves the offset table of `chunk_count` chunks
+	bool begin(const std::filesystem::path &path, int width, int height, bool half, int compression, const exr_window &window, int tile_size, size_t chunk_count)
+	{
+		_file.open(path, std::ios::binary | std::ios::trunc);
+		if (!_file)
+			return false;
+		_compression = compression;
+		_offsets.assign(chunk_count, 0);
+		_file_bytes = 0;
+
+		// Version 2, with the single part tiled bit for tiles
+		const uint32_t magic = 20000630, version = tile_size > 0 ? 2 | 0x200 : 2;
+		write_value(magic);
+		write_value(version);
+
+		std::vector<unsigned char> channels;
+		for (const char *name : { "B", "G", "R" })
+		{
+			channels.insert(channels.end(), name, name + 2);
+			const int32_t pixel_type = half ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT, sampling = 1;
+			append(channels, pixel_type);
+			channels.insert(channels.end(), 4, 0); // pLinear and reserved
+			append(channels, sampling);
+			append(channels, sampling);
+		}
+		channels.push_back(0);
+		write_attribute("channels", "chlist", channels.data(), channels.size());
+
+		const unsigned char compression_type = static_cast<unsigned char>(compression);
+		write_attribute("compression", "compression", &compression_type, 1);
+		const int32_t data_window[4] = { window.x, window.y, window.x + width - 1, window.y + height - 1 };
+		write_attribute("dataWindow", "box2i", data_window, sizeof(data_window));
+		const int32_t display_window[4] = { 0, 0, (window.cropped() ? window.display_width : width) - 1, (window.cropped() ? window.display_height : height) - 1 };
+		write_attribute("displayWindow", "box2i", display_window, sizeof(display_window));
+		const unsigned char line_order = 0;
+		write_attribute("lineOrder", "lineOrder", &line_order, 1);
+		const float pixel_aspect_ratio = 1.0f, screen_window_center[2] = { 0.0f, 0.0f }, screen_window_width = 1.0f;
+		write_attribute("pixelAspectRatio", "float", &pixel_aspect_ratio, sizeof(pixel_aspect_ratio));
+		write_attribute("screenWindowCenter", "v2f", screen_window_center, sizeof(screen_window_center));
+		write_attribute("screenWindowWidth", "float", &screen_window_width, sizeof(screen_window_width));
+		if (tile_size > 0)
+		{
+			unsigned char tiles[9];
+			const uint32_t tile_dimension = static_cast<uint32_t>(tile_size);
+			std::memcpy(tiles, &tile_dimension, 4);
+			std::memcpy(tiles + 4, &tile_dimension, 4);
+			tiles[8] = 0; // One level, rounding down
+			write_attribute("tiles", "tiledesc", tiles, sizeof(tiles));
+		}
+		_file.put(0);
+
+		_table_pos = static_cast<uint64_t>(_file.tellp());
+		const std::vector<char> table(_offsets.size() * sizeof(uint64_t), 0);
+		_file.write(table.data(), static_cast<std::streamsize>(table.size()));
+		return !!_file;
+	}
+
+	// Encodes `_raw` as chunk `index`, which starts with the coordinates that identify it, the first line or the tile position and level
+	bool write_chunk(size_t index, const int32_t *coordinates, size_t coordinate_count)
+	{
+		const std::vector<unsigned char> &data = encode_chunk();
+		_offsets[index] = static_cast<uint64_t>(_file.tellp());
+		_file.write(reinterpret_cast<const char *>(coordinates), static_cast<std::streamsize>(coordinate_count * sizeof(int32_t)));
+		write_value(static_cast<int32_t>(data.size()));
+		_file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+		return !!_file;
+	}
+
+	// Fills in the offset table, false when the file could not be written
+	bool finish()
+	{
+		if (!_file.is_open())
+			return false;
+		_file.seekp(static_cast<std::streamoff>(_table_pos));
+		_file.write(reinterpret_cast<const char *>(_offsets.data()), static_cast<std::streamsize>(_offsets.size() * sizeof(uint64_t)));
+		_file.seekp(0, std::ios::end);
+		_file_bytes = static_cast<uint64_t>(_file.tellp());
+		const bool written = !!_file;
+		_file.close();
+		return written;
+	}
+
+	bool is_open() const { return _file.is_open(); }
+
+	std::vector<unsigned char> _raw;
+
+private:
+	template <typename T>
+	void write_value(const T &value) { _file.write(reinterpret_cast<const char *>(&value), sizeof(T)); }
+	template <typename T>
+	static void append(std::vector<unsigned char> &bytes, const T &value) { bytes.insert(bytes.end(), reinterpret_cast<const unsigned char *>(&value), reinterpret_cast<const unsigned char *>(&value) + sizeof(T)); }
+
+	void write_attribute(const char *name, const char *type, const void *value, size_t size)
+	{
+		_file.write(name, static_cast<std::streamsize>(std::strlen(name) + 1));
+		_file.write(type, static_cast<std::streamsize>(std::strlen(type) + 1));
+		write_value(static_cast<int32_t>(size));
+		_file.write(static_cast<const char *>(value), static_cast<std::streamsize>(size));
+	}
+
+	// The chunk data, raw when compression does not make it smaller, which readers recognize by its size
+	const std::vector<unsigned char> &encode_chunk()
+	{
+		if (_compression == TINYEXR_COMPRESSIONTYPE_NONE || _raw.empty())
+			return _raw;
+
+		const size_t size = _raw.size();
+		_predicted.resize(size);
+		for (size_t i = 0, t1 = 0, t2 = (size + 1) / 2; i < size; ++i)
+			_predicted[(i & 1) ? t2++ : t1++] = _raw[i];
+		for (size_t i = size - 1; i > 0; --i)
+			_predicted[i] = static_cast<unsigned char>(_predicted[i] - _predicted[i - 1] + 128);
+
+		if (_compression == TINYEXR_COMPRESSIONTYPE_ZIP)
+		{
+			mz_ulong compressed_size = mz_compressBound(static_cast<mz_ulong>(size));
+			_compressed.resize(compressed_size);
+			if (mz_compress(_compressed.data(), &compressed_size, _predicted.data(), static_cast<mz_ulong>(size)) != MZ_OK || compressed_size >= size)
+				return _raw;
+			_compressed.resize(compressed_size);
+			return _compressed;
+		}
+
+		// Runs of three to 128 equal bytes become a count and the byte, everything else a negative count and the literal bytes
+		_compressed.resize(size + size / 64 + 2);
+		const signed char *const in = reinterpret_cast<const signed char *>(_predicted.data());
+		signed char *out = reinterpret_cast<signed char *>(_compressed.data());
+		const signed char *const in_end = in + size;
+		const signed char *run_start = in, *run_end = in + 1;
+		while (run_start < in_end)
+		{
+			while (run_end < in_end && *run_start == *run_end && run_end - run_start - 1 < 127)
+				++run_end;
+			if (run_end - run_start >= 3)
+			{
+				*out++ = static_cast<signed char>(run_end - run_start - 1);
+				*out++ = *run_start;
+				run_start = run_end;
+			}
+			else
+			{
+				while (run_end < in_end && ((run_end + 1 >= in_end || *run_end != *(run_end + 1)) || (run_end + 2 >= in_end || *(run_end + 1) != *(run_end + 2))) && run_end - run_start < 127)
+					++run_end;
+				*out++ = static_cast<signed char>(run_start - run_end);
+				while (run_start < run_end)
+					*out++ = *run_start++;
+			}
+			++run_end;
+		}
+		const size_t compressed_size = static_cast<size_t>(out - reinterpret_cast<signed char *>(_compressed.data()));
+		if (compressed_size >= size)
+			return _raw;
+		_compressed.resize(compressed_size);
+		return _compressed;
+	}
+
+	std::ofstream _file;
+	int _compression = TINYEXR_COMPRESSIONTYPE_ZIP;
+	uint64_t _table_pos = 0;
+	uint64_t _file_bytes = 0;
+	std::vector<uint64_t> _offsets;
+	std::vector<unsigned char> _predicted, _compressed;
+};
+
+// Scanline EXR written a block of lines at a time, as many as the compression puts into one chunk, so a frame can be encoded over several
+// calls that each take a bounded time
+class exr_scanline_writer : public exr_stream_writer
+{
+public:
+	bool open(const std::filesystem::path &path, int width, int height, bool half, exr_compression compression, const exr_window &window = {})
+	{
+		if (width <= 0 || height <= 0)
+			return false;
+		_width = width;
+		_height = height;
+		_half = half;
+		_window_y = window.y;
+		_next_block = 0;
+		const int chunk = chunk_compression(compression);
+		_block_lines = chunk == TINYEXR_COMPRESSIONTYPE_ZIP ? 16 : 1;
+		return begin(path, width, height, half, chunk, window, 0, static_cast<size_t>(blocks()));
+	}
+
+	// Encodes the next block of lines. Line y of plane c starts at `planes + c * plane_pitch + y * row_pitch` bytes, so the planes can be
+	// a crop of larger ones.
+	bool write_block(const unsigned char *planes, size_t plane_pitch, size_t row_pitch)
+	{
+		if (!is_open() || done())
+			return false;
+		const int y0 = _next_block * _block_lines;
+		const int lines = std::min(_block_lines, _height - y0);
+		const size_t line_size = static_cast<size_t>(_width) * (_half ? sizeof(uint16_t) : sizeof(float));
+
+		// Lines one after another, each holding the channels in the order of their names
+		_raw.resize(line_size * 3 * lines);
+		unsigned char *dst = _raw.data();
+		for (int y = y0; y < y0 + lines; ++y)
+			for (size_t channel = 0; channel < 3; ++channel, dst += line_size)
+				std::memcpy(dst, planes + channel * plane_pitch + static_cast<size_t>(y) * row_pitch, line_size);
+
+		const int32_t line = _window_y + y0;
+		return write_chunk(static_cast<size_t>(_next_block++), &line, 1);
+	}
+
+	// Fills in the offset table, false when not every block was written or the file could not be written
+	bool close()
+	{
+		const bool complete = done();
+		return finish() && complete;
+	}
+
+	int blocks() const { return (_height + _block_lines - 1) / _block_lines; }
+	int blocks_written() const { return _next_block; }
+	bool done() const { return _next_block >= blocks(); }
+
+private:
+	int _width = 0, _height = 0;
+	bool _half = false;
+	int _window_y = 0;
+	int _block_lines = 1;
+	int _next_block = 0;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include "exr_stream_writer.h"
+
+// Writes a tiled EXR of float channels one band of tile rows at a time, so the frame only has to be read back and converted a band at a time
+class exr_tiled_writer : public exr_stream_writer
+{
+public:
+	bool open(const std::filesystem::path &path, int width, int height, int tile_size, exr_compression compression, const exr_window &window = {})
+	{
+		if (width <= 0 || height <= 0 || tile_size <= 0)
+			return false;
+		_width = width;
+		_height = height;
+		_tile_size = tile_size;
+		_next_tile_y = 0;
+		_tiles_x = (width + tile_size - 1) / tile_size;
+		_tiles_y = (height + tile_size - 1) / tile_size;
+		return begin(path, width, height, false, chunk_compression(compression), window, tile_size, static_cast<size_t>(_tiles_x) * _tiles_y);
+	}
+
+	// Encodes the next row of tiles. `planes` holds the B, G and R planes of the band one after another, `_width` floats per row and
+	// a tile size of rows each, fewer only for the last band.
+	bool write_band(const float *planes, int band_height)
+	{
+		if (!is_open() || _next_tile_y >= _tiles_y || band_height != std::min(_tile_size, _height - _next_tile_y * _tile_size))
+			return false;
+
+		const size_t plane_values = static_cast<size_t>(_width) * band_height;
+		for (int tile_x = 0; tile_x < _tiles_x; ++tile_x)
+		{
+			const int x = tile_x * _tile_size;
+			const int tile_width = std::min(_tile_size, _width - x);
+
+			// Tile data is line after line, each holding the channels one after another in the order of their names
+			const size_t line_values = static_cast<size_t>(tile_width);
+			_raw.resize(line_values * 3 * band_height * sizeof(float));
+			unsigned char *dst = _raw.data();
+			for (int y = 0; y < band_height; ++y)
+				for (size_t channel = 0; channel < 3; ++channel, dst += line_values * sizeof(float))
+					std::memcpy(dst, planes + channel * plane_values + static_cast<size_t>(y) * _width + x, line_values * sizeof(float));
+
+			const int32_t coordinates[4] = { tile_x, _next_tile_y, 0, 0 };
+			if (!write_chunk(static_cast<size_t>(_next_tile_y) * _tiles_x + tile_x, coordinates, 4))
+				return false;
+		}
+		_next_tile_y++;
+		return true;
+	}
+
+	// Fills in the offset table, false when not every band was written or the file could not be written
+	bool close()
+	{
+		const bool complete = _next_tile_y == _tiles_y;
+		return finish() && complete;
+	}
+
+private:
+	int _width = 0, _height = 0, _tile_size = 0;
+	int _tiles_x = 0, _tiles_y = 0, _next_tile_y = 0;
+};
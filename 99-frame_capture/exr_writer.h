@@ -0,0 +1,226 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "tinyexr.h"
+#include "exr_codec.h"
+#include "capture_arena.h"
+
+// What happened to one exported file, shown in the overlay
+struct capture_trace
+{
+	bool valid = false;
+	exr_compression compression = exr_compression::none;
+	bool automatic = false;
+	char reason[160] = "";
+	float encode_ms = 0.0f;
+	uint64_t raw_bytes = 0;
+	uint64_t file_bytes = 0;
+	bool half = false; // Degraded to half precision to fit the memory budget
+};
+
+// Where the planes sit in the full frame when they are a crop of it. The data window of the file is set to the crop and the display window
+// to the full frame, so readers put the crop back in its place.
+struct exr_window
+{
+	int x = 0;
+	int y = 0;
+	int display_width = 0; // Zero for planes that are the full frame
+	int display_height = 0;
+
+	bool cropped() const { return display_width != 0; }
+};
+
+struct exr_write_settings
+{
+	exr_compression compression = exr_compression::piz;
+	exr_auto_target target;
+	exr_window window;
+};
+
+// tinyexr always writes a data and display window of the image size at the origin. Rewrites both in the encoded file and moves the line
+// of every chunk by the window offset, none of which changes the size of anything, so the offset table stays valid.
+inline bool exr_apply_window(unsigned char *file, size_t size, int width, int height, const exr_window &window)
+{
+	const auto read_int = [file](size_t pos) { int32_t value; std::memcpy(&value, file + pos, sizeof(value)); return value; };
+	const auto write_int = [file](size_t pos, int32_t value) { std::memcpy(file + pos, &value, sizeof(value)); };
+
+	// Attributes are a name, a type, a size and the value, up to an empty name
+	size_t pos = 8;
+	while (pos < size && file[pos] != '\0')
+	{
+		const char *const name = reinterpret_cast<const char *>(file + pos);
+		const size_t name_length = strnlen(name, size - pos);
+		const size_t type_pos = pos + name_length + 1;
+		const size_t type_length = type_pos < size ? strnlen(reinterpret_cast<const char *>(file + type_pos), size - type_pos) : 0;
+		const size_t value_pos = type_pos + type_length + 1 + sizeof(int32_t);
+		if (value_pos > size)
+			return false;
+		const int32_t value_size = read_int(value_pos - sizeof(int32_t));
+		if (value_size < 0 || value_pos + value_size > size)
+			return false;
+
+		if (value_size == 16 && std::strcmp(name, "dataWindow") == 0)
+		{
+			write_int(value_pos, window.x);
+			write_int(value_pos + 4, window.y);
+			write_int(value_pos + 8, window.x + width - 1);
+			write_int(value_pos + 12, window.y + height - 1);
+		}
+		else if (value_size == 16 && std::strcmp(name, "displayWindow") == 0)
+		{
+			write_int(value_pos, 0);
+			write_int(value_pos + 4, 0);
+			write_int(value_pos + 8, window.display_width - 1);
+			write_int(value_pos + 12, window.display_height - 1);
+		}
+		pos = value_pos + value_size;
+	}
+
+	// The offset table follows the header and ends where the first chunk starts, every chunk begins with its first line
+	const size_t table_pos = pos + 1;
+	if (table_pos + sizeof(uint64_t) > size)
+		return false;
+	uint64_t first_chunk;
+	std::memcpy(&first_chunk, file + table_pos, sizeof(first_chunk));
+	if (first_chunk < table_pos || first_chunk > size)
+		return false;
+	for (size_t entry = table_pos; entry < first_chunk; entry += sizeof(uint64_t))
+	{
+		uint64_t chunk;
+		std::memcpy(&chunk, file + entry, sizeof(chunk));
+		if (chunk + sizeof(int32_t) > size)
+			return false;
+		write_int(static_cast<size_t>(chunk), read_int(static_cast<size_t>(chunk)) + window.y);
+	}
+	return true;
+}
+
+// Encodes three planes stored one after another, each holding floats or halfs, as B, G and R channels and hands the encoded file to `output`.
+// Every buffer of the encoder comes from the arena, which is reset afterwards. The model learns from the measured encode.
+template <typename Output>
+inline bool encode_exr_planes(const unsigned char *planes, bool half, int width, int height, const exr_write_settings &settings,
+	capture_arena &arena, exr_codec_model &model, capture_trace &trace, Output output)
+{
+	EXRHeader header;
+	InitEXRHeader(&header);
+
+	EXRImage image;
+	InitEXRImage(&image);
+
+	image.num_channels = 3;
+
+	const int value_size = half ? sizeof(uint16_t) : sizeof(float);
+	const size_t plane_size = static_cast<size_t>(width) * height * value_size;
+
+	// Must be BGR(A) order, since most of EXR viewers expect this channel order.
+	const unsigned char *image_ptr[3];
+	image_ptr[0] = planes; // B
+	image_ptr[1] = planes + plane_size; // G
+	image_ptr[2] = planes + plane_size * 2; // R
+
+	image.images = const_cast<unsigned char **>(image_ptr);
+	image.width = width;
+	image.height = height;
+
+	const uint64_t raw_bytes = plane_size * 3;
+
+	// Room for the encoded chunks, the output file and the per-chunk scratch of tinyexr, only grows when the resolution does
+	const size_t chunk_bytes = static_cast<size_t>(width) * 32 * 3 * value_size;
+	arena.reserve(raw_bytes * 2 + raw_bytes / 4 + chunk_bytes * 8);
+
+	trace = capture_trace();
+	trace.raw_bytes = raw_bytes;
+	trace.compression = settings.compression;
+
+	exr_content_stats stats;
+	if (trace.compression == exr_compression::automatic)
+	{
+		stats = exr_sample_content(image_ptr, value_size, 3, width, height);
+		const exr_codec_decision decision = exr_choose_codec(stats, raw_bytes, settings.target, model);
+
+		trace.automatic = true;
+		trace.compression = decision.compression;
+		std::snprintf(trace.reason, sizeof(trace.reason), "%s", decision.reason);
+	}
+
+	header.compression_type = exr_compression_to_tinyexr(trace.compression);
+
+	EXRChannelInfo channels[3] = {};
+	std::strcpy(channels[0].name, "B");
+	std::strcpy(channels[1].name, "G");
+	std::strcpy(channels[2].name, "R");
+	int pixel_types[3];
+	for (int &type : pixel_types)
+		type = half ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT;
+
+	header.num_channels = 3;
+	header.channels = channels;
+	header.pixel_types = pixel_types; // pixel type of input image
+	header.requested_pixel_types = pixel_types; // pixel type of output image to be stored in .EXR
+
+	const auto encode_start = std::chrono::high_resolution_clock::now();
+
+	// Let tinyexr take its chunk buffers and the output from the arena as well
+	EXRAllocator allocator;
+	allocator.allocate = [](void *userdata, size_t size, int scratch) {
+		capture_arena *const arena = static_cast<capture_arena *>(userdata);
+		return scratch ? arena->allocate_scratch(size) : arena->allocate(size);
+	};
+	allocator.deallocate = [](void *userdata, void *ptr, int scratch) {
+		static_cast<capture_arena *>(userdata)->deallocate(ptr, scratch != 0);
+	};
+	allocator.userdata = &arena;
+	SetEXREncodeAllocator(&allocator);
+
+	const char *err = nullptr;
+	unsigned char *memory = nullptr;
+	const size_t memory_size = SaveEXRImageToMemory(&image, &header, &memory, &err);
+
+	SetEXREncodeAllocator(nullptr);
+
+	trace.encode_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - encode_start).count();
+
+	if (memory_size == 0 || (settings.window.cropped() && !exr_apply_window(memory, memory_size, width, height, settings.window)))
+	{
+		FreeEXRErrorMessage(err);
+		arena.reset();
+		return false;
+	}
+
+	const bool written = output(static_cast<const unsigned char *>(memory), memory_size);
+	arena.deallocate(memory, false);
+	arena.reset();
+
+	if (!written)
+		return false;
+
+	trace.file_bytes = memory_size;
+	trace.half = half;
+	trace.valid = true;
+
+	// Feed the measured cost back so the automatic mode keeps learning this machine and content
+	if (trace.compression != exr_compression::none)
+	{
+		if (!trace.automatic)
+			stats = exr_sample_content(image_ptr, value_size, 3, width, height, 2);
+		model.update(trace.compression, stats, raw_bytes, memory_size, trace.encode_ms);
+	}
+
+	return true;
+}
+
+inline bool write_exr_planes(const unsigned char *planes, bool half, int width, int height, const std::filesystem::path &path,
+	const exr_write_settings &settings, capture_arena &arena, exr_codec_model &model, capture_trace &trace)
+{
+	return encode_exr_planes(planes, half, width, height, settings, arena, model, trace, [&path](const unsigned char *data, size_t size) {
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+		return !!file;
+	});
+}
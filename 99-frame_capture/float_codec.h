@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Very fast lossless codec for interleaved 32-bit float images, meant to keep many frames in memory.
+// Every value is predicted from its left neighbour of the same channel (from the one above at the start of a row),
+// the difference of the order preserving integer forms is zigzag coded and stored with 0, 2, 3 or 4 bytes.
+// Single byte differences are rare in float data, while dropping them to two bytes frees a class for three.
+// The 2-bit size classes of four values share one tag byte, all tags come before the value bytes, so both loops stay branch light.
+
+static constexpr unsigned char float_codec_class_bytes[4] = { 0, 2, 3, 4 };
+
+// Upper bound of the encoded size of `num_values` floats
+inline size_t float_codec_bound(size_t num_values)
+{
+	return (num_values + 3) / 4 + num_values * 4;
+}
+
+inline uint32_t float_codec_to_ordered(uint32_t bits)
+{
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+inline uint32_t float_codec_from_ordered(uint32_t ordered)
+{
+	return (ordered & 0x80000000u) ? ordered & 0x7FFFFFFFu : ~ordered;
+}
+
+// Encodes `height` rows of `width` pixels with `channels` floats each, rows are `row_pitch` bytes apart. Returns the encoded size.
+inline size_t float_codec_encode(const void *src, size_t row_pitch, int width, int height, int channels, unsigned char *dst)
+{
+	const size_t num_values = static_cast<size_t>(width) * height * channels;
+	unsigned char *tags = dst;
+	unsigned char *out = dst + (num_values + 3) / 4;
+	std::memset(tags, 0, (num_values + 3) / 4);
+
+	size_t index = 0;
+	const unsigned char *prev_row = nullptr;
+	for (int y = 0; y < height; ++y)
+	{
+		const unsigned char *const row = static_cast<const unsigned char *>(src) + y * row_pitch;
+		for (int i = 0; i < width * channels; ++i, ++index)
+		{
+			uint32_t bits, pred_bits = 0;
+			std::memcpy(&bits, row + i * 4, 4);
+			if (i >= channels)
+				std::memcpy(&pred_bits, row + (i - channels) * 4, 4);
+			else if (prev_row != nullptr)
+				std::memcpy(&pred_bits, prev_row + i * 4, 4);
+
+			const uint32_t delta = float_codec_to_ordered(bits) - float_codec_to_ordered(pred_bits);
+			const uint32_t zigzag = (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+
+			const unsigned int size_class = zigzag == 0 ? 0 : zigzag < 0x10000 ? 1 : zigzag < 0x1000000 ? 2 : 3;
+			tags[index >> 2] |= static_cast<unsigned char>(size_class << ((index & 3) * 2));
+
+			// Little endian store, only the bytes of the size class are kept
+			const unsigned char bytes[4] = { static_cast<unsigned char>(zigzag), static_cast<unsigned char>(zigzag >> 8), static_cast<unsigned char>(zigzag >> 16), static_cast<unsigned char>(zigzag >> 24) };
+			std::memcpy(out, bytes, 4);
+			out += float_codec_class_bytes[size_class];
+		}
+		prev_row = row;
+	}
+
+	return static_cast<size_t>(out - dst);
+}
+
+// Decodes into tightly packed rows of `width * channels` floats
+inline void float_codec_decode(const unsigned char *src, int width, int height, int channels, float *dst)
+{
+	const size_t num_values = static_cast<size_t>(width) * height * channels;
+	const unsigned char *const tags = src;
+	const unsigned char *in = src + (num_values + 3) / 4;
+	const size_t row_values = static_cast<size_t>(width) * channels;
+
+	uint32_t *const out = reinterpret_cast<uint32_t *>(dst);
+	for (size_t index = 0; index < num_values; ++index)
+	{
+		const unsigned int size_class = (tags[index >> 2] >> ((index & 3) * 2)) & 3;
+
+		uint32_t zigzag = 0;
+		switch (size_class)
+		{
+		case 3:
+			zigzag = static_cast<uint32_t>(in[0]) | static_cast<uint32_t>(in[1]) << 8 | static_cast<uint32_t>(in[2]) << 16 | static_cast<uint32_t>(in[3]) << 24;
+			break;
+		case 2:
+			zigzag = static_cast<uint32_t>(in[0]) | static_cast<uint32_t>(in[1]) << 8 | static_cast<uint32_t>(in[2]) << 16;
+			break;
+		case 1:
+			zigzag = static_cast<uint32_t>(in[0]) | static_cast<uint32_t>(in[1]) << 8;
+			break;
+		}
+		in += float_codec_class_bytes[size_class];
+
+		const uint32_t delta = (zigzag >> 1) ^ (0u - (zigzag & 1));
+
+		const size_t i = index % row_values;
+		uint32_t pred_bits = 0;
+		if (i >= static_cast<size_t>(channels))
+			pred_bits = out[index - channels];
+		else if (index >= row_values)
+			pred_bits = out[index - row_values];
+
+		out[index] = float_codec_from_ordered(float_codec_to_ordered(pred_bits) + delta);
+	}
+}
@@ -4,31 +4,22 @@
 
 #define ImTextureID unsigned long long
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-
-#define TINYEXR_IMPLEMENTATION
-
 #include <imgui.h>
 #include <reshade.hpp>
 #include <vector>
 #include <cstring>
 #include <algorithm>
+#include <cmath>
 #include <unordered_map>
+#include <mutex>
+#include <string>
 #include "FormatEnum.h"
-#include <filesystem>
-#include <stb_image_write.h>
-#include "stb_image.h"
-
-#include "tinyexr.h"
-#include "miniz.c"
-#include "miniz.h"
-
-static bool enableCapturing = false;
-static bool enableDepthExp = false;
-static bool enableNormalExp = false;
+#include "capture_core.h"
 
 static bool doOnce = false;
 static int windowSize[2] = { 320, 560 };
+// Whether the event hooks were registered at startup, the setting only takes effect on the next one
+static bool eventHooksRegistered = false;
 
 using namespace reshade::api;
 
@@ -92,42 +83,66 @@ struct __declspec(uuid("7c6363c7-f94e-437a-9160-141782c44a98")) state_tracking_i
 	std::unordered_map<resource, unsigned int, depth_stencil_hash> display_count_per_depth_stencil;
 };
 
-struct __declspec(uuid("eadae23a-4009-4d32-8557-0af07e45f409")) stored_buffers_inst
-{
-	resource export_texture_r = { 0 };
-	resource_desc export_texture_rd;
-	resource_view export_texture_rv = { 0 };
-	void update(resource sr, resource_desc srd, resource_view srv)
-	{
-		export_texture_r = sr;
-		export_texture_rd = srd;
-		export_texture_rv = srv;
-	}
-	void reset()
-	{
-		export_texture_r = { 0 };
-		export_texture_rv = { 0 };
-	}
-};
-
-
-enum type
-{
-	depth,
-	normal
-};
-
-
 static void on_init_device(device* device)
 {
 	reshade::config_get_value(nullptr, "ADDON", "FC_EnableCapture", enableCapturing);
 	reshade::config_get_value(nullptr, "ADDON", "FC_ExportDepth", enableDepthExp);
 	reshade::config_get_value(nullptr, "ADDON", "FC_ExportNormal", enableNormalExp);
+	reshade::config_get_value(nullptr, "ADDON", "FC_Compression", exportCompression);
+	reshade::config_get_value(nullptr, "ADDON", "FC_AutoMaxMs", autoMaxMs);
+	reshade::config_get_value(nullptr, "ADDON", "FC_AutoMaxMB", autoMaxMB);
+	reshade::config_get_value(nullptr, "ADDON", "FC_ExportFileType", exportFileType);
+	reshade::config_get_value(nullptr, "ADDON", "FC_ColorFormat", colorFormat);
+	reshade::config_get_value(nullptr, "ADDON", "FC_PngThreads", pngThreads);
+	reshade::config_get_value(nullptr, "ADDON", "FC_NpyHalf", npyHalf);
+	reshade::config_get_value(nullptr, "ADDON", "FC_NpyPreallocate", npyPreallocate);
+	reshade::config_get_value(nullptr, "ADDON", "FC_ExportScale", exportScale);
+	reshade::config_get_value(nullptr, "ADDON", "FC_DepthReduction", depthReduction);
+	reshade::config_get_value(nullptr, "ADDON", "FC_CropBorders", cropBorders);
+	reshade::config_get_value(nullptr, "ADDON", "FC_TiledExr", tiledExr);
+	reshade::config_get_value(nullptr, "ADDON", "FC_TileSize", tileSize);
+	reshade::config_get_value(nullptr, "ADDON", "FC_BackBufferExr", backBufferExr);
+	reshade::config_get_value(nullptr, "ADDON", "FC_BackBufferTransfer", backBufferTransfer);
+	reshade::config_get_value(nullptr, "ADDON", "FC_RegionMode", regionMode);
+	reshade::config_get_value(nullptr, "ADDON", "FC_RegionLeft", regionRect[0]);
+	reshade::config_get_value(nullptr, "ADDON", "FC_RegionTop", regionRect[1]);
+	reshade::config_get_value(nullptr, "ADDON", "FC_RegionRight", regionRect[2]);
+	reshade::config_get_value(nullptr, "ADDON", "FC_RegionBottom", regionRect[3]);
+	reshade::config_get_value(nullptr, "ADDON", "FC_CaptureMode", captureMode);
+	reshade::config_get_value(nullptr, "ADDON", "FC_SequenceInterval", sequenceInterval);
+	reshade::config_get_value(nullptr, "ADDON", "FC_BurstLength", burstLength);
+	reshade::config_get_value(nullptr, "ADDON", "FC_SequenceFormat", sequenceFormat);
+	reshade::config_get_value(nullptr, "ADDON", "FC_KeyframeInterval", keyframeInterval);
+	reshade::config_get_value(nullptr, "ADDON", "FC_SkipUnchanged", skipUnchanged);
+	reshade::config_get_value(nullptr, "ADDON", "FC_StreamSlots", streamSlots);
+	reshade::config_get_value(nullptr, "ADDON", "FC_EncodeThreads", encodeThreads);
+	reshade::config_get_value(nullptr, "ADDON", "FC_PresentEncoding", presentEncoding);
+	reshade::config_get_value(nullptr, "ADDON", "FC_SliceBudgetUs", sliceBudgetUs);
+	reshade::config_get_value(nullptr, "ADDON", "FC_SliceBlocks", sliceBlocks);
+	reshade::config_get_value(nullptr, "ADDON", "FC_WorkerPriority", workerPriority);
+	reshade::config_get_value(nullptr, "ADDON", "FC_WorkerIoPriority", workerIoPriority);
+	reshade::config_get_value(nullptr, "ADDON", "FC_WorkerAffinityMask", workerAffinityMask);
+	reshade::config_get_value(nullptr, "ADDON", "FC_WorkerPinLeastLoaded", workerPinLeastLoaded);
+	reshade::config_get_value(nullptr, "ADDON", "FC_Replay", enableReplay);
+	reshade::config_get_value(nullptr, "ADDON", "FC_ReplaySeconds", replaySeconds);
+	reshade::config_get_value(nullptr, "ADDON", "FC_ReplayInterval", replayInterval);
+	reshade::config_get_value(nullptr, "ADDON", "FC_ReplayMemoryMB", replayMemoryMB);
+	reshade::config_get_value(nullptr, "ADDON", "FC_DeferMode", deferMode);
+	reshade::config_get_value(nullptr, "ADDON", "FC_DeferIdleSeconds", deferIdleSeconds);
+	reshade::config_get_value(nullptr, "ADDON", "FC_DeferTargetFps", deferTargetFps);
+	reshade::config_get_value(nullptr, "ADDON", "FC_BudgetMB", budgetMB);
+	reshade::config_get_value(nullptr, "ADDON", "FC_BudgetPercent", budgetPercent);
+	reshade::config_get_value(nullptr, "ADDON", "FC_BudgetPolicy", budgetPolicy);
+	reshade::config_get_value(nullptr, "ADDON", "FC_EventTraceFrames", eventTraceFrames);
+	apply_budget();
+	apply_worker_qos();
 }
 
 static void on_init_effect_runtime(effect_runtime* runtime)
 {
 	runtime->create_private_data<stored_buffers_inst>();
+
+	init_capture(runtime);
 }
 
 static void on_destroy_effect_runtime(effect_runtime* runtime)
@@ -136,6 +151,8 @@ static void on_destroy_effect_runtime(effect_runtime* runtime)
 
 	stored_buffers_inst& sbi = runtime->get_private_data<stored_buffers_inst>();
 
+	destroy_capture(runtime, sbi);
+
 	if (sbi.export_texture_rv != 0)
 		device->destroy_resource_view(sbi.export_texture_rv);
 
@@ -164,292 +181,9 @@ static void on_begin_render_effects(effect_runtime* runtime, command_list* cmd_l
 	});
 }
 
-bool SaveEXR(const float* rgb, int width, int height, const char* outfilename, bool single_channel) {
-
-	EXRHeader header;
-	InitEXRHeader(&header);
-
-	EXRImage image;
-	InitEXRImage(&image);
-
-	image.num_channels = 3;
-
-	// Must be BGR(A) order, since most of EXR viewers expect this channel order.
-
-	std::vector<float> images[3];
-	images[0].resize(width * height);
-	images[1].resize(width * height);
-	images[2].resize(width * height);
-
-	for (int i = 0; i < width * height; i++) {
-		images[0][i] = rgb[3 * i + 0];
-		images[1][i] = rgb[3 * i + 1];
-		images[2][i] = rgb[3 * i + 2];
-	}
-
-	float* image_ptr[3];
-	image_ptr[0] = &(images[0].at(0)); // B
-	image_ptr[1] = &(images[1].at(0)); // G
-	image_ptr[2] = &(images[2].at(0)); // R
-
-	image.images = (unsigned char**)image_ptr;
-	image.width = width;
-	image.height = height;
-
-	header.compression_type = TINYEXR_COMPRESSIONTYPE_PIZ; //TINYEXR_COMPRESSIONTYPE_NONE
-
-	header.num_channels = 3;
-	header.channels = (EXRChannelInfo*)malloc(sizeof(EXRChannelInfo) * header.num_channels);
-	// Must be BGR(A) order, since most of EXR viewers expect this channel order.
-	strncpy(header.channels[0].name, "B", 255); header.channels[0].name[strlen("B")] = '\0';
-	strncpy(header.channels[1].name, "G", 255); header.channels[1].name[strlen("G")] = '\0';
-	strncpy(header.channels[2].name, "R", 255); header.channels[2].name[strlen("R")] = '\0';
-
-	header.pixel_types = (int*)malloc(sizeof(int) * header.num_channels);
-	header.requested_pixel_types = (int*)malloc(sizeof(int) * header.num_channels);
-	for (int i = 0; i < header.num_channels; i++) {
-		header.pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT; // pixel type of input image
-		header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT; // pixel type of output image to be stored in .EXR
-	}
-
-	const char* err;
-	int ret = SaveEXRImageToFile(&image, &header, outfilename, &err);
-	if (ret != TINYEXR_SUCCESS) {
-		return false;
-	}
-
-	//free(&rgb);
-
-	free(header.channels);
-	free(header.pixel_types);
-	free(header.requested_pixel_types);
-
-	//reshade::log_message(3, "EXR export done!");
-
-	return true;
-}
-
-bool capture_image(const resource_desc& desc, const subresource_data& data, std::filesystem::path save_path, uint32_t channels, type tex_type)
-{
-	float* data_p = static_cast<float*>(data.data);
-
-	std::vector<float> rgba_pixel_data(desc.texture.width * desc.texture.height * 3); //(desc.texture.width * desc.texture.height * 3)
-
-	uint32_t row_div = data.row_pitch / desc.texture.width;
-	uint32_t true_row = data.row_pitch / row_div;
-	uint32_t slice_div = data.slice_pitch / desc.texture.width;
-	uint32_t true_slice = data.slice_pitch / slice_div;
-
-	/*std::stringstream ss;
-	std::string str;
-	const char* message;
-	ss << data.row_pitch;
-	ss >> str;
-	ss.clear();
-	message = str.c_str();
-	reshade::log_message(3, message);*/
-
-	if (tex_type == depth)
-	{
-		for (uint32_t y = 0; y < desc.texture.height; ++y, data_p += data.row_pitch / channels) //data.row_pitch
-		{
-			for (uint32_t x = 0; x < desc.texture.width; ++x)
-			{
-				const float* const src = data_p + x * channels; // data_p + x * channels // data_p + true_slice
-				float* const dst = rgba_pixel_data.data() + (y * desc.texture.width + x) * 3;
-
-				dst[2] = src[3];
-				dst[1] = src[3];
-				dst[0] = src[3];
-			}
-		}
-	}
-	else if (tex_type == normal)
-	{
-		for (uint32_t y = 0; y < desc.texture.height; ++y, data_p += data.row_pitch / channels) //data.row_pitch
-		{
-			for (uint32_t x = 0; x < desc.texture.width; ++x)
-			{
-				const float* const src = data_p + x * channels; // data_p + x * channels // data_p + true_slice
-				float* const dst = rgba_pixel_data.data() + (y * desc.texture.width + x) * 3;
-
-				dst[2] = src[0];
-				dst[1] = src[1];
-				dst[0] = src[2];
-			}
-		}
-	}
-
-	return SaveEXR(rgba_pixel_data.data(), desc.texture.width, desc.texture.height, save_path.u8string().c_str(), false);
-}
-
-static bool saveImage(effect_runtime* runtime, std::filesystem::path save_path, resource sbr, resource_desc sbrd, format format, type tex_type)
-{
-	if (sbr != 0)
-	{
-		device* const device = runtime->get_device();
-		command_queue* const queue = runtime->get_command_queue();
-		resource_desc resource_desc = sbrd;
-
-		uint32_t row_pitch = format_row_pitch(resource_desc.texture.format, resource_desc.texture.width);
-		if (device->get_api() == device_api::d3d12) // Align row pitch to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT (256)
-			row_pitch = (row_pitch + 255) & ~255;
-		const uint32_t slice_pitch = format_slice_pitch(resource_desc.texture.format, row_pitch, resource_desc.texture.height);
-
-		resource intermediate;
-		if (resource_desc.heap != memory_heap::gpu_only)
-		{
-			// Avoid copying to temporary system memory resource if texture is accessible directly
-			intermediate = sbr;
-
-		}
-		else if (device->check_capability(device_caps::copy_buffer_to_texture))
-		{
-			if ((resource_desc.usage & resource_usage::copy_source) != resource_usage::copy_source)
-			{
-				return false;
-			}
-
-			if (!device->create_resource(reshade::api::resource_desc(slice_pitch, memory_heap::gpu_to_cpu, resource_usage::copy_dest), nullptr, resource_usage::copy_dest, &intermediate))
-			{
-				reshade::log_message(1, "Failed to create system memory buffer for texture dumping!");
-				return false;
-			}
-
-			command_list* const cmd_list = queue->get_immediate_command_list();
-			cmd_list->barrier(sbr, resource_usage::shader_resource, resource_usage::copy_source);
-			cmd_list->copy_texture_to_buffer(sbr, 0, nullptr, intermediate, 0, resource_desc.texture.width, resource_desc.texture.height);
-			cmd_list->barrier(sbr, resource_usage::copy_source, resource_usage::shader_resource);
-		}
-		else
-		{
-			if ((resource_desc.usage & resource_usage::copy_source) != resource_usage::copy_source)
-				return false;
-
-			if (!device->create_resource(reshade::api::resource_desc(resource_desc.texture.width, resource_desc.texture.height, 1, 1, format_to_default_typed(resource_desc.texture.format), 1, memory_heap::gpu_to_cpu, resource_usage::copy_dest), nullptr, resource_usage::copy_dest, &intermediate))
-			{
-				reshade::log_message(1, "Failed to create system memory texture for texture dumping!");
-				return false;
-			}
-
-			command_list* const cmd_list = queue->get_immediate_command_list();
-			cmd_list->barrier(sbr, resource_usage::shader_resource, resource_usage::copy_source);
-			cmd_list->copy_texture_region(sbr, 0, nullptr, intermediate, 0, nullptr);
-			cmd_list->barrier(sbr, resource_usage::copy_source, resource_usage::shader_resource);
-		}
-
-		queue->wait_idle();
-
-		subresource_data mapped_data = {};
-		if (resource_desc.heap == memory_heap::gpu_only &&
-			device->check_capability(device_caps::copy_buffer_to_texture))
-		{
-			device->map_buffer_region(intermediate, 0, std::numeric_limits<uint64_t>::max(), map_access::read_only, &mapped_data.data);
-
-			mapped_data.row_pitch = row_pitch;
-			mapped_data.slice_pitch = slice_pitch;
-		}
-		else
-		{
-			device->map_texture_region(intermediate, 0, nullptr, map_access::read_only, &mapped_data);
-		}
-
-		if (mapped_data.data != nullptr)
-		{
-			uint32_t channels = 0;
-			switch (format)
-			{
-				case format::r32_float:
-					channels = static_cast<uint32_t>(1);
-				break;
-				case format::r32g32b32a32_float:
-					channels = static_cast <uint32_t>(4);
-				break;
-			}
-
-			if (!capture_image(resource_desc, mapped_data, save_path, channels, tex_type))
-				return false;
-
-			if (resource_desc.heap == memory_heap::gpu_only &&
-				device->check_capability(device_caps::copy_buffer_to_texture))
-				device->unmap_buffer_region(intermediate);
-			else
-				device->unmap_texture_region(intermediate, 0);
-		}
-
-		if (intermediate != sbr) {
-			device->destroy_resource(intermediate);
-		}
-
-		return true;
-	}
-	else
-	{
-		return false;
-	}
-}
-
 static void on_reshade_present(effect_runtime* runtime)
 {
-	if (runtime->is_key_pressed(0x79) && enableCapturing)
-	{
-		uint32_t width, height;
-		device* const device = runtime->get_device();
-		resource backBuffer = runtime->get_current_back_buffer();
-		resource_desc resource_desc = device->get_resource_desc(backBuffer);
-
-		runtime->get_screenshot_width_and_height(&width, &height);
-		std::vector<uint8_t> pixels(width * height * 4);
-
-		runtime->capture_screenshot(pixels.data());
-
-		WCHAR file_prefix[MAX_PATH] = L"";
-		GetModuleFileNameW(nullptr, file_prefix, ARRAYSIZE(file_prefix));
-
-		std::filesystem::path save_path = file_prefix;
-		save_path += L' ';
-
-		const auto now = std::chrono::system_clock::now();
-		const auto now_seconds = std::chrono::time_point_cast<std::chrono::seconds>(now);
-
-		char timestamp[21];
-		const std::time_t t = std::chrono::system_clock::to_time_t(now_seconds);
-		tm tm; localtime_s(&tm, &t);
-		sprintf_s(timestamp, "%.4d-%.2d-%.2d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
-		save_path += timestamp;
-		save_path += L' ';
-		sprintf_s(timestamp, "%.2d-%.2d-%.2d", tm.tm_hour, tm.tm_min, tm.tm_sec);
-		save_path += timestamp;
-		save_path += L' ';
-		sprintf_s(timestamp, "%.3lld", std::chrono::duration_cast<std::chrono::milliseconds>(now - now_seconds).count());
-		save_path += timestamp;
-		save_path += L' ';
-
-		std::filesystem::path save_path_o = save_path;
-		std::filesystem::path save_path_c = save_path_o;
-
-		save_path += L"BackBuffer.bmp";
-
-		stbi_write_bmp(save_path.u8string().c_str(), width, height, 4, pixels.data());
-
-		type tex_type;
-
-		if (enableDepthExp) {
-			save_path_c = save_path_o;
-			save_path_c += L"DepthBuffer.exr";
-			stored_buffers_inst& sbi = runtime->get_private_data<stored_buffers_inst>();
-			tex_type = depth;
-			saveImage(runtime, save_path_c, sbi.export_texture_r, sbi.export_texture_rd, sbi.export_texture_rd.texture.format, tex_type);
-		}
-
-		if (enableNormalExp) {
-			save_path_c = save_path_o;
-			save_path_c += L"NormalMap.exr";
-			stored_buffers_inst& sbi = runtime->get_private_data<stored_buffers_inst>();
-			tex_type = normal;
-			saveImage(runtime, save_path_c, sbi.export_texture_r, sbi.export_texture_rd, sbi.export_texture_rd.texture.format, tex_type);
-		}
-	}
+	present_capture(runtime, runtime->get_private_data<stored_buffers_inst>());
 }
 
 static void drawItem(effect_runtime* runtime, resource_view srv, resource_desc srd, const char* source, bool firstElem, imgui_content img_cont)
@@ -554,12 +288,216 @@ static void draw_settings_overlay(effect_runtime* runtime)
 		doOnce = true;
 	}
 
+	if (sequence.recording)
+		ImGui::TextColored(ImVec4(1.0, 0.2, 0.2, 1.0), "Recording | %u frames%s", sequence.index, sequence.unchanged != 0 ? (" | " + std::to_string(sequence.unchanged) + " unchanged").c_str() : "");
+	const char* container_names[2] = { "Depth", "Normal" };
+	for (int i = 0; i < 2; ++i)
+		if (sequenceContainers[i] && sequenceContainers[i]->frames() != 0)
+			ImGui::Text("%s container | %llu frames | %.0f MB of %.0f MB raw", container_names[i], sequenceContainers[i]->frames(),
+				sequenceContainers[i]->file_bytes() / (1024.0f * 1024.0f), sequenceContainers[i]->raw_bytes() / (1024.0f * 1024.0f));
+	if (sequenceArchive)
+		ImGui::Text("Archive | %d files | %.0f MB", static_cast<int>(sequenceArchive->entries()), sequenceArchive->bytes() / (1024.0f * 1024.0f));
+	for (int i = 0; i < 2; ++i)
+		if (sequenceStacks[i] && sequenceStacks[i]->frames() != 0)
+			ImGui::Text("%s stack | %llu frames | %.0f MB", container_names[i], sequenceStacks[i]->frames(), sequenceStacks[i]->bytes() / (1024.0f * 1024.0f));
+	if (eventTrace.is_open())
+		ImGui::TextColored(ImVec4(1.0, 0.2, 0.2, 1.0), "Recording events | %llu events | %.1f MB", eventTrace.events(), eventTrace.bytes() / (1024.0f * 1024.0f));
+	if (frameStream.is_open())
+		ImGui::Text("Stream \"%s\" | %llu frames published | %u slots of %.0f MB", frameStreamName, frameStream.published(), frameStream.slot_count(), frameStream.slot_capacity() / (1024.0f * 1024.0f));
+	lastOverlayTime = seconds_now();
+
+	const capture_queue::stats backlog = captureQueue.get_stats();
+	const size_t spilled_frames = spillFile.is_open() ? spillFile.pending_count() : 0;
+	if (backlog.deferred_jobs != 0 || spilled_frames != 0)
+		ImGui::Text("Deferred | %d in memory (%.0f MB) | %d spilled (%.0f MB)%s", static_cast<int>(backlog.deferred_jobs), backlog.deferred_bytes / (1024.0f * 1024.0f),
+			static_cast<int>(spilled_frames), spillFile.pending_bytes() / (1024.0f * 1024.0f), encoderIdle ? " | encoding" : "");
+	if (presentEncoding && (backlog.slicing || backlog.queued_jobs != 0))
+		ImGui::Text("Encoding on present | %.0f%% of current file | %d queued", backlog.slice_progress * 100.0f, static_cast<int>(backlog.queued_jobs));
+	if (backlog.pinned_cores != 0)
+		ImGui::Text("Encoders pinned to cores %llX", backlog.pinned_cores);
+	if (backlog.refused_qos != 0)
+		ImGui::TextColored(ImVec4(1.0, 0.6, 0.2, 1.0), "Encoder priority or cores refused %llu times", backlog.refused_qos);
+	if (replayRing.count() != 0)
+		ImGui::Text("Replay | %.1f s in %d frames | %.0f of %.0f MB | %.2f ratio%s", replayRing.span(), static_cast<int>(replayRing.count()),
+			replayRing.used_bytes() / (1024.0f * 1024.0f), replayRing.capacity() / (1024.0f * 1024.0f), static_cast<double>(replayRing.used_bytes()) / replayRing.raw_bytes(), replayRing.frozen() ? " | saving" : "");
+
 	if (ImGui::CollapsingHeader("Settings")) //ImGuiTreeNodeFlags_DefaultOpen
 	{
 		ImGui::Spacing();
 		modified |= ImGui::Checkbox("Enable capturing with F10 key", &enableCapturing);
 		modified |= ImGui::Checkbox("Export Depth", &enableDepthExp);
 		modified |= ImGui::Checkbox("Export Normals", &enableNormalExp);
+		if (ImGui::Combo("Capture mode", &captureMode, capture_mode_names, IM_ARRAYSIZE(capture_mode_names))) {
+			if (sequence.recording)
+				stop_recording(runtime, runtime->get_private_data<stored_buffers_inst>());
+			modified = true;
+		}
+		if (captureMode == static_cast<int>(capture_mode::interval))
+			modified |= ImGui::DragInt("Capture every Nth frame", &sequenceInterval, 0.2f, 1, 600);
+		else if (captureMode == static_cast<int>(capture_mode::burst))
+			modified |= ImGui::DragInt("Frames per burst", &burstLength, 1.0f, 1, 3600);
+		if (captureMode != static_cast<int>(capture_mode::single))
+		{
+			modified |= ImGui::Combo("Sequence format", &sequenceFormat, sequence_format_names, IM_ARRAYSIZE(sequence_format_names));
+			if (sequenceFormat == static_cast<int>(sequence_format::container))
+				modified |= ImGui::DragInt("Keyframe every", &keyframeInterval, 0.5f, 1, 3600, "%d frames");
+			if (sequenceFormat == static_cast<int>(sequence_format::stream))
+				modified |= ImGui::DragInt("Stream slots", &streamSlots, 0.1f, 2, 64);
+			else if (sequenceFormat != static_cast<int>(sequence_format::npy_stack))
+				modified |= ImGui::Checkbox("Skip unchanged frames", &skipUnchanged);
+		}
+		modified |= ImGui::Checkbox("Instant replay, F9 saves it", &enableReplay);
+		if (enableReplay)
+		{
+			modified |= ImGui::DragFloat("Replay length (s)", &replaySeconds, 0.5f, 1.0f, 600.0f, "%.0f s");
+			modified |= ImGui::DragInt("Replay every Nth frame", &replayInterval, 0.2f, 1, 60);
+			modified |= ImGui::DragInt("Replay memory (MB)", &replayMemoryMB, 16.0f, 64, 65536, "%d MB");
+		}
+		if (ImGui::Combo("Defer encoding", &deferMode, defer_mode_names, IM_ARRAYSIZE(defer_mode_names))) {
+			if (static_cast<defer_mode>(deferMode) == defer_mode::spill_file)
+				open_spill_file();
+			modified = true;
+		}
+		if (deferMode != static_cast<int>(defer_mode::off))
+		{
+			modified |= ImGui::DragInt("Idle after no input for", &deferIdleSeconds, 0.2f, 0, 600, deferIdleSeconds > 0 ? "%d s" : "Never");
+			modified |= ImGui::DragInt("Or when running above", &deferTargetFps, 0.5f, 0, 500, deferTargetFps > 0 ? "%d fps" : "Never");
+		}
+		// Restarting finishes the queued frames with the old threads, or on the present thread, first
+		if (ImGui::Checkbox("Encode on the present thread", &presentEncoding)) {
+			start_encoders();
+			modified = true;
+		}
+		if (presentEncoding)
+		{
+			modified |= ImGui::DragInt("Encode time per frame", &sliceBudgetUs, 50.0f, 100, 50000, "%d us");
+			modified |= ImGui::DragInt("Blocks per frame", &sliceBlocks, 1.0f, 0, 4096, sliceBlocks > 0 ? "%d" : "No limit");
+		}
+		else
+		{
+			if (ImGui::SliderInt("Encoder threads", &encodeThreads, 1, static_cast<int>(capture_queue::max_workers))) {
+				start_encoders();
+				modified = true;
+			}
+			bool qos_modified = false;
+			qos_modified |= ImGui::Combo("Encoder priority", &workerPriority, thread_priority_names, IM_ARRAYSIZE(thread_priority_names));
+			qos_modified |= ImGui::Combo("Encoder I/O priority", &workerIoPriority, io_priority_names, IM_ARRAYSIZE(io_priority_names));
+			qos_modified |= ImGui::InputScalar("Encoder cores (hex mask, 0 for all)", ImGuiDataType_U64, &workerAffinityMask, nullptr, nullptr, "%llX", ImGuiInputTextFlags_CharsHexadecimal);
+			qos_modified |= ImGui::Checkbox("Pin encoders to least loaded cores", &workerPinLeastLoaded);
+			if (qos_modified)
+				apply_worker_qos();
+			modified |= qos_modified;
+		}
+		if (ImGui::Combo("Capture region", &regionMode, region_mode_names, IM_ARRAYSIZE(region_mode_names))) {
+			// Switching between fractions and pixels keeps the same region of the current frame
+			uint32_t width = 0, height = 0;
+			runtime->get_screenshot_width_and_height(&width, &height);
+			const float scale[4] = { static_cast<float>(width), static_cast<float>(height), static_cast<float>(width), static_cast<float>(height) };
+			for (int i = 0; i < 4 && width != 0 && height != 0; ++i) {
+				if (regionMode == static_cast<int>(region_mode::pixels) && regionRect[i] <= 1.0f)
+					regionRect[i] = std::round(regionRect[i] * scale[i]);
+				else if (regionMode == static_cast<int>(region_mode::normalized) && regionRect[i] > 1.0f)
+					regionRect[i] = regionRect[i] / scale[i];
+			}
+			modified = true;
+		}
+		if (regionMode == static_cast<int>(region_mode::normalized))
+			modified |= ImGui::DragFloat4("Left, top, right, bottom", regionRect, 0.001f, 0.0f, 1.0f, "%.3f");
+		else if (regionMode == static_cast<int>(region_mode::pixels))
+			modified |= ImGui::DragFloat4("Left, top, right, bottom", regionRect, 1.0f, 0.0f, 16384.0f, "%.0f px");
+		modified |= ImGui::Checkbox("Back buffer as half float EXR", &backBufferExr);
+		if (backBufferExr)
+			modified |= ImGui::Combo("Back buffer curve", &backBufferTransfer, transfer_function_names, IM_ARRAYSIZE(transfer_function_names));
+		else
+			modified |= ImGui::Combo("Back buffer format", &colorFormat, color_format_names, IM_ARRAYSIZE(color_format_names));
+		if (!backBufferExr && colorFormat == static_cast<int>(color_format::png))
+			modified |= ImGui::SliderInt("PNG threads", &pngThreads, 1, 16);
+		modified |= ImGui::Combo("Export file type", &exportFileType, export_file_type_names, IM_ARRAYSIZE(export_file_type_names));
+		if (exportFileType != static_cast<int>(export_file_type::dds))
+		{
+			modified |= ImGui::Combo("Export scale", &exportScale, export_scale_names, IM_ARRAYSIZE(export_scale_names));
+			if (exportScale != static_cast<int>(export_scale::full))
+				modified |= ImGui::Combo("Depth reduction", &depthReduction, depth_reduction_names, IM_ARRAYSIZE(depth_reduction_names));
+		}
+		if (exportFileType == static_cast<int>(export_file_type::exr))
+		{
+			modified |= ImGui::Checkbox("Crop constant borders", &cropBorders);
+			modified |= ImGui::Checkbox("Tiled EXR in bands (single captures)", &tiledExr);
+			if (tiledExr)
+				modified |= ImGui::SliderInt("Tile size", &tileSize, 16, 1024);
+		}
+		if (exportFileType == static_cast<int>(export_file_type::npy) || sequenceFormat == static_cast<int>(sequence_format::npy_stack))
+		{
+			modified |= ImGui::Checkbox("NumPy as float16", &npyHalf);
+			modified |= ImGui::Checkbox("Preallocate NumPy files", &npyPreallocate);
+		}
+		modified |= ImGui::Combo("EXR compression", &exportCompression, exr_compression_names, IM_ARRAYSIZE(exr_compression_names));
+		if (exportCompression == static_cast<int>(exr_compression::automatic))
+		{
+			modified |= ImGui::DragFloat("Max encode time (ms)", &autoMaxMs, 1.0f, 0.0f, 1000.0f, autoMaxMs > 0.0f ? "%.0f ms" : "No limit");
+			modified |= ImGui::DragInt("Max file size (MB)", &autoMaxMB, 1.0f, 0, 1024, autoMaxMB > 0 ? "%d MB" : "No limit");
+		}
+		bool budget_modified = false;
+		budget_modified |= ImGui::DragInt("Memory budget (MB)", &budgetMB, 16.0f, 0, 65536, budgetMB > 0 ? "%d MB" : "No limit");
+		budget_modified |= ImGui::DragFloat("Memory budget (% of free)", &budgetPercent, 1.0f, 0.0f, 100.0f, budgetPercent > 0.0f ? "%.0f%%" : "No limit");
+		budget_modified |= ImGui::Combo("Over budget", &budgetPolicy, budget_policy_names, IM_ARRAYSIZE(budget_policy_names));
+		if (budget_modified)
+			apply_budget();
+		modified |= budget_modified;
+		modified |= ImGui::Checkbox("Event recording hooks (after restart)", &eventHooks);
+		if (eventHooksRegistered)
+		{
+			modified |= ImGui::DragInt("Frames of events", &eventTraceFrames, 1.0f, 1, 36000);
+			if (eventTrace.is_open())
+			{
+				if (ImGui::Button("Stop recording events"))
+					stop_event_trace();
+			}
+			else if (ImGui::Button("Record events"))
+				start_event_trace();
+		}
+		ImGui::Spacing();
+		ImGui::Separator();
+	}
+
+	if (ImGui::CollapsingHeader("Last capture"))
+	{
+		ImGui::Spacing();
+		capture_trace traces[2];
+		{
+			const std::lock_guard<std::mutex> lock(lastCaptureMutex);
+			traces[0] = lastCapture[0];
+			traces[1] = lastCapture[1];
+		}
+
+		const char* pass_names[2] = { "Depth", "Normal" };
+		for (int i = 0; i < 2; ++i)
+		{
+			const capture_trace& trace = traces[i];
+			if (!trace.valid)
+				continue;
+			ImGui::Text("%s | %s%s%s | %.1f ms | %.1f MB -> %.1f MB", pass_names[i], exr_compression_names[static_cast<int>(trace.compression)], trace.automatic ? " (auto)" : "", trace.half ? " | half" : "",
+				trace.encode_ms, trace.raw_bytes / (1024.0f * 1024.0f), trace.file_bytes / (1024.0f * 1024.0f));
+			if (trace.automatic)
+				ImGui::TextWrapped("%s", trace.reason);
+		}
+		size_t arena_capacity = 0, arena_peak = 0;
+		bool arena_huge_pages = false;
+		for (const capture_arena& arena : captureArenas) {
+			arena_capacity += arena.capacity();
+			arena_peak = std::max(arena_peak, arena.high_water());
+			arena_huge_pages |= arena.huge_pages();
+		}
+		if (arena_capacity != 0)
+			ImGui::Text("Arenas | %.0f MB reserved | %.0f MB peak%s", arena_capacity / (1024.0f * 1024.0f), arena_peak / (1024.0f * 1024.0f), arena_huge_pages ? " | large pages" : "");
+
+		const capture_queue::stats queue_stats = captureQueue.get_stats();
+		ImGui::Text("In flight | %.0f MB of %s | %d queued | %.0f MB peak", queue_stats.in_flight_bytes / (1024.0f * 1024.0f),
+			queue_stats.limit_bytes != 0 ? std::to_string(queue_stats.limit_bytes / (1024 * 1024)).append(" MB").c_str() : "no limit", static_cast<int>(queue_stats.queued_jobs), queue_stats.peak_bytes / (1024.0f * 1024.0f));
+		if (queue_stats.pooled_buffers != 0)
+			ImGui::Text("Preallocated | %d of %d buffers free", static_cast<int>(queue_stats.free_buffers), static_cast<int>(queue_stats.pooled_buffers));
+		if (queue_stats.dropped_frames != 0 || queue_stats.degraded_frames != 0 || queue_stats.blocked_frames != 0)
+			ImGui::TextColored(ImVec4(1.0, 0.6, 0.2, 1.0), "Over budget | %llu dropped | %llu degraded | %llu waited", queue_stats.dropped_frames, queue_stats.degraded_frames, queue_stats.blocked_frames);
 		ImGui::Spacing();
 		ImGui::Separator();
 	}
@@ -573,11 +511,60 @@ static void draw_settings_overlay(effect_runtime* runtime)
 		reshade::config_set_value(nullptr, "ADDON", "FC_EnableCapture", enableCapturing);
 		reshade::config_set_value(nullptr, "ADDON", "FC_ExportDepth", enableDepthExp);
 		reshade::config_set_value(nullptr, "ADDON", "FC_ExportNormal", enableNormalExp);
+		reshade::config_set_value(nullptr, "ADDON", "FC_Compression", exportCompression);
+		reshade::config_set_value(nullptr, "ADDON", "FC_AutoMaxMs", autoMaxMs);
+		reshade::config_set_value(nullptr, "ADDON", "FC_AutoMaxMB", autoMaxMB);
+		reshade::config_set_value(nullptr, "ADDON", "FC_ExportFileType", exportFileType);
+		reshade::config_set_value(nullptr, "ADDON", "FC_ColorFormat", colorFormat);
+		reshade::config_set_value(nullptr, "ADDON", "FC_PngThreads", pngThreads);
+		reshade::config_set_value(nullptr, "ADDON", "FC_NpyHalf", npyHalf);
+		reshade::config_set_value(nullptr, "ADDON", "FC_NpyPreallocate", npyPreallocate);
+		reshade::config_set_value(nullptr, "ADDON", "FC_ExportScale", exportScale);
+		reshade::config_set_value(nullptr, "ADDON", "FC_DepthReduction", depthReduction);
+		reshade::config_set_value(nullptr, "ADDON", "FC_CropBorders", cropBorders);
+		reshade::config_set_value(nullptr, "ADDON", "FC_TiledExr", tiledExr);
+		reshade::config_set_value(nullptr, "ADDON", "FC_TileSize", tileSize);
+		reshade::config_set_value(nullptr, "ADDON", "FC_BackBufferExr", backBufferExr);
+		reshade::config_set_value(nullptr, "ADDON", "FC_BackBufferTransfer", backBufferTransfer);
+		reshade::config_set_value(nullptr, "ADDON", "FC_RegionMode", regionMode);
+		reshade::config_set_value(nullptr, "ADDON", "FC_RegionLeft", regionRect[0]);
+		reshade::config_set_value(nullptr, "ADDON", "FC_RegionTop", regionRect[1]);
+		reshade::config_set_value(nullptr, "ADDON", "FC_RegionRight", regionRect[2]);
+		reshade::config_set_value(nullptr, "ADDON", "FC_RegionBottom", regionRect[3]);
+		reshade::config_set_value(nullptr, "ADDON", "FC_CaptureMode", captureMode);
+		reshade::config_set_value(nullptr, "ADDON", "FC_SequenceInterval", sequenceInterval);
+		reshade::config_set_value(nullptr, "ADDON", "FC_BurstLength", burstLength);
+		reshade::config_set_value(nullptr, "ADDON", "FC_SequenceFormat", sequenceFormat);
+		reshade::config_set_value(nullptr, "ADDON", "FC_KeyframeInterval", keyframeInterval);
+		reshade::config_set_value(nullptr, "ADDON", "FC_SkipUnchanged", skipUnchanged);
+		reshade::config_set_value(nullptr, "ADDON", "FC_StreamSlots", streamSlots);
+		reshade::config_set_value(nullptr, "ADDON", "FC_EncodeThreads", encodeThreads);
+		reshade::config_set_value(nullptr, "ADDON", "FC_PresentEncoding", presentEncoding);
+		reshade::config_set_value(nullptr, "ADDON", "FC_SliceBudgetUs", sliceBudgetUs);
+		reshade::config_set_value(nullptr, "ADDON", "FC_SliceBlocks", sliceBlocks);
+		reshade::config_set_value(nullptr, "ADDON", "FC_WorkerPriority", workerPriority);
+		reshade::config_set_value(nullptr, "ADDON", "FC_WorkerIoPriority", workerIoPriority);
+		reshade::config_set_value(nullptr, "ADDON", "FC_WorkerAffinityMask", workerAffinityMask);
+		reshade::config_set_value(nullptr, "ADDON", "FC_WorkerPinLeastLoaded", workerPinLeastLoaded);
+		reshade::config_set_value(nullptr, "ADDON", "FC_Replay", enableReplay);
+		reshade::config_set_value(nullptr, "ADDON", "FC_ReplaySeconds", replaySeconds);
+		reshade::config_set_value(nullptr, "ADDON", "FC_ReplayInterval", replayInterval);
+		reshade::config_set_value(nullptr, "ADDON", "FC_ReplayMemoryMB", replayMemoryMB);
+		reshade::config_set_value(nullptr, "ADDON", "FC_DeferMode", deferMode);
+		reshade::config_set_value(nullptr, "ADDON", "FC_DeferIdleSeconds", deferIdleSeconds);
+		reshade::config_set_value(nullptr, "ADDON", "FC_DeferTargetFps", deferTargetFps);
+		reshade::config_set_value(nullptr, "ADDON", "FC_BudgetMB", budgetMB);
+		reshade::config_set_value(nullptr, "ADDON", "FC_BudgetPercent", budgetPercent);
+		reshade::config_set_value(nullptr, "ADDON", "FC_BudgetPolicy", budgetPolicy);
+		reshade::config_set_value(nullptr, "ADDON", "FC_EventHooks", eventHooks);
+		reshade::config_set_value(nullptr, "ADDON", "FC_EventTraceFrames", eventTraceFrames);
 	}
 }
 
 void register_addon_FC()
 {
+	captureLog = reshade::log_message;
+
 	reshade::register_overlay("Frame Capture", draw_settings_overlay);
 
 	reshade::register_event<reshade::addon_event::init_device>(on_init_device);
@@ -586,7 +573,26 @@ void register_addon_FC()
 
 	reshade::register_event<reshade::addon_event::reshade_present>(on_reshade_present);
 	reshade::register_event<reshade::addon_event::reshade_begin_effects>(on_begin_render_effects);
+
+	// Registered for good or not at all, as these run for every draw call of the game
+	reshade::config_get_value(nullptr, "ADDON", "FC_EventHooks", eventHooks);
+	eventHooksRegistered = eventHooks;
+	if (eventHooksRegistered)
+	{
+		reshade::register_event<reshade::addon_event::init_resource>(on_init_resource);
+		reshade::register_event<reshade::addon_event::destroy_resource>(on_destroy_resource);
+		reshade::register_event<reshade::addon_event::init_resource_view>(on_init_resource_view);
+		reshade::register_event<reshade::addon_event::destroy_resource_view>(on_destroy_resource_view);
+		reshade::register_event<reshade::addon_event::bind_render_targets_and_depth_stencil>(on_bind_render_targets_and_depth_stencil);
+		reshade::register_event<reshade::addon_event::bind_viewports>(on_bind_viewports);
+		reshade::register_event<reshade::addon_event::clear_depth_stencil_view>(on_clear_depth_stencil_view);
+		reshade::register_event<reshade::addon_event::draw>(on_draw);
+		reshade::register_event<reshade::addon_event::draw_indexed>(on_draw_indexed);
+		reshade::register_event<reshade::addon_event::draw_or_dispatch_indirect>(on_draw_or_dispatch_indirect);
+		reshade::register_event<reshade::addon_event::present>(on_present);
+	}
 }
+
 void unregister_addon_FC()
 {
 	reshade::unregister_overlay("Frame Capture", draw_settings_overlay);
@@ -597,6 +603,21 @@ void unregister_addon_FC()
 
 	reshade::unregister_event<reshade::addon_event::reshade_present>(on_reshade_present);
 	reshade::unregister_event<reshade::addon_event::reshade_begin_effects>(on_begin_render_effects);
+
+	if (eventHooksRegistered)
+	{
+		reshade::unregister_event<reshade::addon_event::init_resource>(on_init_resource);
+		reshade::unregister_event<reshade::addon_event::destroy_resource>(on_destroy_resource);
+		reshade::unregister_event<reshade::addon_event::init_resource_view>(on_init_resource_view);
+		reshade::unregister_event<reshade::addon_event::destroy_resource_view>(on_destroy_resource_view);
+		reshade::unregister_event<reshade::addon_event::bind_render_targets_and_depth_stencil>(on_bind_render_targets_and_depth_stencil);
+		reshade::unregister_event<reshade::addon_event::bind_viewports>(on_bind_viewports);
+		reshade::unregister_event<reshade::addon_event::clear_depth_stencil_view>(on_clear_depth_stencil_view);
+		reshade::unregister_event<reshade::addon_event::draw>(on_draw);
+		reshade::unregister_event<reshade::addon_event::draw_indexed>(on_draw_indexed);
+		reshade::unregister_event<reshade::addon_event::draw_or_dispatch_indirect>(on_draw_or_dispatch_indirect);
+		reshade::unregister_event<reshade::addon_event::present>(on_present);
+	}
 }
 
 extern "C" __declspec(dllexport) const char* NAME = "Frame Capture";
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Frames handed to another process through a named shared memory ring of fixed slots, no file and no copy on the consumer side.
+// Every slot has a sequence number like a seqlock: odd while the producer writes it, even once the frame is complete.
+// A consumer reads a frame in place and checks afterwards that the sequence did not move, otherwise the frame was overwritten meanwhile.
+
+enum class frame_stream_format : uint32_t
+{
+	float_planes, // One plane of 32-bit floats per channel, one after another
+	rgba8 // Interleaved 8-bit RGBA rows
+};
+
+// Which export a frame comes from, numbered like the passes of a capture archive
+enum class frame_stream_pass : uint32_t
+{
+	back_buffer,
+	depth,
+	normal
+};
+
+struct frame_stream_info
+{
+	uint64_t frame_index = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t channels = 0;
+	frame_stream_format format = frame_stream_format::float_planes;
+	frame_stream_pass pass = frame_stream_pass::depth;
+	uint32_t reserved = 0;
+	uint64_t timestamp = 0; // Microseconds of the steady clock when the frame was complete
+	uint64_t size = 0; // Bytes of the payload
+};
+
+struct frame_stream_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t reserved;
+	uint64_t slot_capacity; // Payload bytes a slot can hold
+	uint64_t slot_stride;
+	std::atomic<uint64_t> published; // Frames written so far, frame N is in slot N % slot_count
+	std::atomic<uint32_t> closed; // Set when the producer goes away, a consumer should open the stream again
+};
+
+struct frame_stream_slot
+{
+	std::atomic<uint64_t> sequence; // 2 * N + 1 while frame N is written, 2 * N + 2 once it is complete
+	frame_stream_info info;
+};
+
+// Clock of the frame timestamps, the steady clock is the same for all processes on a machine
+inline uint64_t frame_stream_now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory needs lock free atomics");
+
+class frame_stream
+{
+public:
+	static constexpr uint32_t magic = 0x54534346; // "FCST"
+	static constexpr uint32_t version = 1;
+	static constexpr uint64_t header_size = 4096;
+	static constexpr uint64_t slot_header_size = 256; // Keeps the payload aligned for SIMD loads
+
+	~frame_stream()
+	{
+		close();
+	}
+
+	// Producer side, creates the named ring
+	bool create(const char *name, uint32_t slot_count, uint64_t slot_capacity)
+	{
+		close();
+		const uint64_t stride = (slot_header_size + slot_capacity + 4095) & ~uint64_t(4095);
+		const uint64_t size = header_size + stride * slot_count;
+		if (!map(name, size, true))
+			return false;
+
+		frame_stream_header *const header = this->header();
+		header->magic = magic;
+		header->version = version;
+		header->slot_count = slot_count;
+		header->slot_capacity = slot_capacity;
+		header->slot_stride = stride;
+		header->published.store(0);
+		header->closed.store(0);
+		for (uint32_t i = 0; i < slot_count; ++i)
+			slot(i)->sequence.store(0);
+		return true;
+	}
+	// Consumer side, maps an existing ring
+	bool open(const char *name)
+	{
+		close();
+		if (!map(name, header_size, false))
+			return false;
+		const frame_stream_header *const header = this->header();
+		const bool valid = header->magic == magic && header->version == version && header->slot_count != 0;
+		const uint64_t size = header_size + header->slot_stride * header->slot_count;
+		unmap();
+		return valid && map(name, size, false);
+	}
+	void close()
+	{
+		if (_base != nullptr && _producer)
+			header()->closed.store(1, std::memory_order_release);
+		unmap();
+#ifndef _WIN32
+		if (_producer && !_name.empty())
+			shm_unlink(_name.c_str());
+#endif
+		_producer = false;
+		_name.clear();
+	}
+	bool is_open() const { return _base != nullptr; }
+
+	uint32_t slot_count() const { return header()->slot_count; }
+	uint64_t slot_capacity() const { return header()->slot_capacity; }
+	uint64_t published() const { return header()->published.load(std::memory_order_acquire); }
+	bool closed() const { return header()->closed.load(std::memory_order_acquire) != 0; }
+
+	// Returns where the payload of the next frame goes, or nullptr when it does not fit. end_write publishes it.
+	unsigned char *begin_write(const frame_stream_info &info)
+	{
+		if (info.size > header()->slot_capacity)
+			return nullptr;
+		const uint64_t number = header()->published.load(std::memory_order_relaxed);
+		frame_stream_slot *const s = slot(number % header()->slot_count);
+		s->sequence.store(2 * number + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		s->info = info;
+		return payload(s);
+	}
+	void end_write(uint64_t timestamp)
+	{
+		const uint64_t number = header()->published.load(std::memory_order_relaxed);
+		frame_stream_slot *const s = slot(number % header()->slot_count);
+		s->info.timestamp = timestamp;
+		s->sequence.store(2 * number + 2, std::memory_order_release);
+		header()->published.store(number + 1, std::memory_order_release);
+	}
+
+	// Points at frame `number` in place, false when it was not written yet or was already overwritten
+	bool read(uint64_t number, frame_stream_info &info, const unsigned char *&data) const
+	{
+		const frame_stream_slot *const s = slot(number % header()->slot_count);
+		if (s->sequence.load(std::memory_order_acquire) != 2 * number + 2)
+			return false;
+		info = s->info;
+		data = payload(s);
+		return still_valid(number);
+	}
+	// Call after using the data of a frame, false means the producer wrote over it meanwhile and the data must be thrown away
+	bool still_valid(uint64_t number) const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slot(number % header()->slot_count)->sequence.load(std::memory_order_relaxed) == 2 * number + 2;
+	}
+
+private:
+	frame_stream_header *header() const { return reinterpret_cast<frame_stream_header *>(_base); }
+	frame_stream_slot *slot(uint64_t index) const
+	{
+		return reinterpret_cast<frame_stream_slot *>(_base + header_size + header()->slot_stride * index);
+	}
+	static unsigned char *payload(const frame_stream_slot *s)
+	{
+		return reinterpret_cast<unsigned char *>(const_cast<frame_stream_slot *>(s)) + slot_header_size;
+	}
+
+	bool map(const char *name, uint64_t size, bool create)
+	{
+#ifdef _WIN32
+		const std::string mapping_name = std::string("Local\\") + name;
+		_mapping = create ?
+			CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), mapping_name.c_str()) :
+			OpenFileMappingA(FILE_MAP_READ, FALSE, mapping_name.c_str());
+		if (_mapping == nullptr)
+			return false;
+		// A consumer may still hold a ring of an earlier size under this name, which cannot be resized
+		if (create && GetLastError() == ERROR_ALREADY_EXISTS)
+		{
+			CloseHandle(_mapping);
+			_mapping = nullptr;
+			return false;
+		}
+		_base = static_cast<unsigned char *>(MapViewOfFile(_mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(size)));
+		if (_base == nullptr)
+		{
+			CloseHandle(_mapping);
+			_mapping = nullptr;
+			return false;
+		}
+#else
+		const std::string shm_name = std::string("/") + name;
+		const int fd = shm_open(shm_name.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0600);
+		if (fd < 0)
+			return false;
+		if (create && ftruncate(fd, static_cast<off_t>(size)) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void *const base = mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (base == MAP_FAILED)
+			return false;
+		_base = static_cast<unsigned char *>(base);
+		if (create)
+			_name = shm_name;
+#endif
+		_size = size;
+		_producer = create;
+		return true;
+	}
+	void unmap()
+	{
+		if (_base == nullptr)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile(_base);
+		CloseHandle(_mapping);
+		_mapping = nullptr;
+#else
+		munmap(_base, _size);
+#endif
+		_base = nullptr;
+		_size = 0;
+	}
+
+#ifdef _WIN32
+	HANDLE _mapping = nullptr;
+#endif
+	unsigned char *_base = nullptr;
+	uint64_t _size = 0;
+	bool _producer = false;
+	std::string _name;
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+// Exports as NumPy arrays, which np.load(path, mmap_mode='r') maps as they are, with nothing to parse or decompress.
+// The header is padded to a page, so the data starts page aligned and a stack can rewrite its frame count in place once it is done.
+
+enum class npy_dtype : uint32_t
+{
+	float32,
+	float16
+};
+
+static constexpr uint64_t npy_header_size = 4096;
+
+inline uint64_t npy_value_size(npy_dtype dtype)
+{
+	return dtype == npy_dtype::float16 ? 2 : 4;
+}
+
+// Version 1.0 header of a C-order array with `dims` dimensions, always npy_header_size bytes
+inline std::string npy_header(npy_dtype dtype, const uint64_t *shape, size_t dims)
+{
+	std::string dict = "{'descr': '";
+	dict += dtype == npy_dtype::float16 ? "<f2" : "<f4";
+	dict += "', 'fortran_order': False, 'shape': (";
+	for (size_t i = 0; i < dims; ++i)
+		dict += std::to_string(shape[i]) + (dims == 1 || i + 1 < dims ? "," : "");
+	dict += "), }";
+
+	const size_t dict_size = static_cast<size_t>(npy_header_size) - 10;
+	dict.resize(dict_size - 1, ' ');
+	dict += '\n';
+
+	std::string header("\x93NUMPY\x01\x00", 8);
+	header += static_cast<char>(dict_size & 0xFF);
+	header += static_cast<char>(dict_size >> 8);
+	return header + dict;
+}
+
+// Unbuffered, so the data goes to the file in large writes that start at page boundaries
+inline void npy_open(std::fstream &file, const std::filesystem::path &path, std::ios::openmode mode)
+{
+	file.rdbuf()->pubsetbuf(nullptr, 0);
+	file.open(path, mode | std::ios::binary);
+}
+
+inline bool npy_write_data(std::fstream &file, const void *data, uint64_t size)
+{
+	static constexpr uint64_t chunk_size = 8 * 1024 * 1024;
+	const char *p = static_cast<const char *>(data);
+	for (uint64_t offset = 0; offset < size && file; offset += chunk_size)
+		file.write(p + offset, static_cast<std::streamsize>(std::min(chunk_size, size - offset)));
+	return !!file;
+}
+
+// Writes one array, the file is sized up front with `preallocate` so the file system can place it in one piece
+inline bool write_npy(const std::filesystem::path &path, npy_dtype dtype, const uint64_t *shape, size_t dims, const void *data, uint64_t size, bool preallocate)
+{
+	std::fstream file;
+	if (preallocate)
+	{
+		{
+			std::ofstream create(path, std::ios::binary | std::ios::trunc);
+			if (!create.is_open())
+				return false;
+		}
+		std::error_code ec;
+		std::filesystem::resize_file(path, npy_header_size + size, ec);
+		npy_open(file, path, std::ios::in | std::ios::out);
+	}
+	else
+	{
+		npy_open(file, path, std::ios::out | std::ios::trunc);
+	}
+	if (!file.is_open())
+		return false;
+
+	const std::string header = npy_header(dtype, shape, dims);
+	file.write(header.data(), static_cast<std::streamsize>(header.size()));
+	return npy_write_data(file, data, size);
+}
+
+// All frames of a sequence in one array with the frame index as first dimension. Frames may arrive from any thread and in any order,
+// every one is written to its own place. Frames that were dropped stay zero.
+class npy_stack
+{
+public:
+	~npy_stack()
+	{
+		close();
+	}
+
+	// `expected_frames` is the length of a burst, zero when the recording has no set end
+	bool open(const std::filesystem::path &path, npy_dtype dtype, const uint64_t *frame_shape, size_t frame_dims, uint32_t expected_frames, bool preallocate)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_path = path;
+		_dtype = dtype;
+		_dims = frame_dims;
+		_frame_bytes = npy_value_size(dtype);
+		for (size_t i = 0; i < frame_dims; ++i)
+		{
+			_shape[i + 1] = frame_shape[i];
+			_frame_bytes *= frame_shape[i];
+		}
+		_frames = 0;
+		_allocated = 0;
+		_expected = expected_frames;
+		_preallocate = preallocate;
+
+		{
+			std::ofstream create(path, std::ios::binary | std::ios::trunc);
+			if (!create.is_open())
+				return false;
+		}
+		npy_open(_file, path, std::ios::in | std::ios::out);
+		if (!_file.is_open())
+			return false;
+		write_header_locked();
+		return !!_file;
+	}
+	// Sets the final frame count in the header and cuts off what was preallocated beyond the last frame
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_file.is_open())
+			return;
+		write_header_locked();
+		_file.close();
+		if (_allocated > _frames)
+		{
+			std::error_code ec;
+			std::filesystem::resize_file(_path, npy_header_size + _frames * _frame_bytes, ec);
+		}
+	}
+
+	bool write(uint32_t frame, const void *data, uint64_t size)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_file.is_open() || size != _frame_bytes)
+			return false;
+
+		if (_preallocate && frame >= _allocated)
+		{
+			// A burst is allocated at once, open ended recordings grow in steps
+			_allocated = std::max(frame + 1, _expected != 0 ? _expected : ((frame / growth_frames) + 1) * growth_frames);
+			std::error_code ec;
+			std::filesystem::resize_file(_path, npy_header_size + _allocated * _frame_bytes, ec);
+		}
+
+		_file.seekp(static_cast<std::streamoff>(npy_header_size + frame * _frame_bytes));
+		if (!npy_write_data(_file, data, size))
+		{
+			_file.clear();
+			return false;
+		}
+		_frames = std::max<uint64_t>(_frames, frame + 1ull);
+		_bytes += size;
+		return true;
+	}
+
+	uint64_t frame_bytes() const { return _frame_bytes; }
+	uint64_t frames() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _frames;
+	}
+	uint64_t bytes() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _bytes;
+	}
+
+private:
+	static constexpr uint32_t growth_frames = 64;
+
+	void write_header_locked()
+	{
+		_shape[0] = _frames;
+		const std::string header = npy_header(_dtype, _shape, _dims + 1);
+		_file.seekp(0);
+		_file.write(header.data(), static_cast<std::streamsize>(header.size()));
+	}
+
+	mutable std::mutex _mutex;
+	std::filesystem::path _path;
+	std::fstream _file;
+	npy_dtype _dtype = npy_dtype::float32;
+	uint64_t _shape[4] = {};
+	size_t _dims = 0;
+	uint64_t _frame_bytes = 0;
+	uint64_t _frames = 0;
+	uint64_t _allocated = 0;
+	uint64_t _bytes = 0;
+	uint32_t _expected = 0;
+	bool _preallocate = false;
+};
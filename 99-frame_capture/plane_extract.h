@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "content_bounds.h"
+#include "content_hash.h"
+
+// Splits rows of an export texture into the B, G and R planes of the depth or normal export: alpha into all three for depth, RGB for normals.
+// `row_pitch` is in bytes, textures of a single channel put it into every plane. `store` takes the index of the texel in the planes and its
+// B, G and R values. The hash and the bounds of the content take every texel as it is loaded, both only look at the channels that are exported.
+// The hash sums the texels of a row with two integer adds and mixes only the sums, which is what keeps it within a few percent of the conversion.
+// tools/hash_bench times this very loop.
+template <typename Store>
+void extract_planes(const void *data, uint32_t row_pitch, uint32_t channels, uint32_t width, uint32_t height, bool depth_texture, Store store, content_hash *hash = nullptr,
+	content_bounds *bounds = nullptr)
+{
+	const uint32_t exported = depth_texture ? 0x8 : 0x7;
+	if (channels != 4)
+		bounds = nullptr;
+	else if (bounds != nullptr)
+		bounds->begin(static_cast<const float *>(data), channels, exported);
+	const bool hash_texels = hash != nullptr;
+	// Through the pointer every store to the planes would reload the hash state, local copies stay in registers
+	content_hash local_hash = hash != nullptr ? *hash : content_hash();
+	content_row_sum row_sum(exported);
+
+	const float *data_p = static_cast<const float *>(data);
+	const size_t row_stride = row_pitch / sizeof(float);
+
+	if (channels == 1)
+	{
+		for (uint32_t y = 0; y < height; ++y, data_p += row_stride)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				const float value = data_p[x];
+				store(static_cast<size_t>(y) * width + x, value, value, value);
+				if (hash_texels)
+				{
+					const float texel[4] = { value, value, value, value };
+					row_sum.add(texel);
+				}
+			}
+			if (hash_texels)
+				row_sum.fold(local_hash);
+		}
+	}
+	else if (channels != 4)
+	{
+		return;
+	}
+	else if (depth_texture)
+	{
+		for (uint32_t y = 0; y < height; ++y, data_p += row_stride)
+		{
+			uint32_t first = UINT32_MAX, last = 0;
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				const float *const src = data_p + x * channels;
+
+				store(static_cast<size_t>(y) * width + x, src[3], src[3], src[3]);
+				if (hash_texels)
+					row_sum.add(src);
+				if (bounds != nullptr && bounds->differs(src))
+				{
+					first = std::min(first, x);
+					last = x;
+				}
+			}
+			if (hash_texels)
+				row_sum.fold(local_hash);
+			if (bounds != nullptr)
+				bounds->add_row(y, first, last);
+		}
+	}
+	else
+	{
+		for (uint32_t y = 0; y < height; ++y, data_p += row_stride)
+		{
+			uint32_t first = UINT32_MAX, last = 0;
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				const float *const src = data_p + x * channels;
+
+				store(static_cast<size_t>(y) * width + x, src[2], src[1], src[0]);
+				if (hash_texels)
+					row_sum.add(src);
+				if (bounds != nullptr && bounds->differs(src))
+				{
+					first = std::min(first, x);
+					last = x;
+				}
+			}
+			if (hash_texels)
+				row_sum.fold(local_hash);
+			if (bounds != nullptr)
+				bounds->add_row(y, first, last);
+		}
+	}
+
+	if (hash != nullptr)
+		*hash = local_hash;
+}
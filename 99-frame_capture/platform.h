@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// The few things the capture core needs from the operating system, so it builds on Windows for the add-on and on Linux for tools and benchmarks
+
+// Path of the executable of the process, captures and the spill file go next to it
+inline std::filesystem::path executable_path()
+{
+#ifdef _WIN32
+	WCHAR path[MAX_PATH] = L"";
+	GetModuleFileNameW(nullptr, path, ARRAYSIZE(path));
+	return path;
+#else
+	char path[4096] = "";
+	const ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	return std::filesystem::path(std::string(path, length > 0 ? static_cast<size_t>(length) : 0));
+#endif
+}
+
+inline tm local_time(std::time_t t)
+{
+	tm result = {};
+#ifdef _WIN32
+	localtime_s(&result, &t);
+#else
+	localtime_r(&t, &result);
+#endif
+	return result;
+}
+
+// Seconds since the last keyboard or mouse input to the process, negative where that is not known
+inline double seconds_since_input()
+{
+#ifdef _WIN32
+	LASTINPUTINFO input = { sizeof(input) };
+	if (GetLastInputInfo(&input))
+		return (GetTickCount() - input.dwTime) / 1000.0;
+#endif
+	return -1.0;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "capture_arena.h"
+#include "float_codec.h"
+
+// Keeps the last frames of the export texture compressed in one preallocated slab. Frames are written one after
+// another and wrap around at the end, the oldest ones are evicted when their space is needed or they fall out of the time window.
+class replay_ring
+{
+public:
+	struct frame_record
+	{
+		size_t offset;
+		size_t size;
+		double time; // Seconds, from the clock passed to add_frame
+		int width, height, channels;
+	};
+
+	// Sizes the slab and the record table once, nothing is allocated per frame afterwards
+	bool allocate(size_t capacity, size_t max_frames)
+	{
+		release();
+		if (!_slab.reserve(capacity))
+			return false;
+		_base = static_cast<unsigned char *>(_slab.allocate(capacity));
+		_capacity = capacity;
+		_records.resize(max_frames < 2 ? 2 : max_frames);
+		return true;
+	}
+	void release()
+	{
+		_slab.release();
+		_base = nullptr;
+		_capacity = 0;
+		_records.clear();
+		_records.shrink_to_fit();
+		clear();
+	}
+	void clear()
+	{
+		_first = 0;
+		_count = 0;
+		_head = 0;
+		_used = 0;
+		_raw_bytes = 0;
+	}
+
+	// Compresses a frame into the ring, returns false when it is frozen or the frame can never fit
+	bool add_frame(const void *data, size_t row_pitch, int width, int height, int channels, double time, double window)
+	{
+		if (_frozen.load() || _base == nullptr)
+			return false;
+
+		const size_t bound = float_codec_bound(static_cast<size_t>(width) * height * channels);
+		if (bound > _capacity)
+			return false;
+
+		size_t offset = _head;
+		if (offset + bound > _capacity)
+		{
+			// Everything behind the head was written before the last wrap, so it is older than what sits at the start
+			while (_count != 0 && oldest().offset >= _head)
+				pop_oldest();
+			offset = 0;
+		}
+
+		// The writer only ever moves forward, so evicting from the oldest frame frees the region in order
+		while (_count != 0 && (_count == _records.size() || overlaps(oldest(), offset, bound)))
+			pop_oldest();
+
+		const size_t size = float_codec_encode(data, row_pitch, width, height, channels, _base + offset);
+
+		frame_record &record = _records[(_first + _count) % _records.size()];
+		record.offset = offset;
+		record.size = size;
+		record.time = time;
+		record.width = width;
+		record.height = height;
+		record.channels = channels;
+		_count++;
+		_used += size;
+		_raw_bytes += static_cast<uint64_t>(width) * height * channels * sizeof(float);
+		_head = offset + size;
+
+		while (_count > 1 && time - oldest().time > window)
+			pop_oldest();
+
+		return true;
+	}
+
+	// While frozen no frame is added or evicted, so the frames can be read from other threads
+	void freeze() { _frozen.store(true); }
+	void unfreeze() { _frozen.store(false); }
+	bool frozen() const { return _frozen.load(); }
+
+	size_t count() const { return _count; }
+	// Index zero is the oldest frame
+	const frame_record &frame(size_t index) const { return _records[(_first + index) % _records.size()]; }
+	void decode(size_t index, float *dst) const
+	{
+		const frame_record &record = frame(index);
+		float_codec_decode(_base + record.offset, record.width, record.height, record.channels, dst);
+	}
+
+	size_t capacity() const { return _capacity; }
+	size_t max_frames() const { return _records.size(); }
+	size_t used_bytes() const { return _used; }
+	uint64_t raw_bytes() const { return _raw_bytes; }
+	double span() const { return _count > 1 ? frame(_count - 1).time - frame(0).time : 0.0; }
+
+private:
+	const frame_record &oldest() const { return _records[_first]; }
+	static bool overlaps(const frame_record &record, size_t offset, size_t size)
+	{
+		return record.offset < offset + size && offset < record.offset + record.size;
+	}
+	void pop_oldest()
+	{
+		const frame_record &record = oldest();
+		_used -= record.size;
+		_raw_bytes -= static_cast<uint64_t>(record.width) * record.height * record.channels * sizeof(float);
+		_first = (_first + 1) % _records.size();
+		_count--;
+	}
+
+	capture_arena _slab;
+	unsigned char *_base = nullptr;
+	size_t _capacity = 0;
+	std::vector<frame_record> _records;
+	size_t _first = 0;
+	size_t _count = 0;
+	size_t _head = 0;
+	size_t _used = 0;
+	uint64_t _raw_bytes = 0;
+	std::atomic<bool> _frozen { false };
+};
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "miniz.h"
+#include "float_codec.h"
+#include "half_float.h"
+
+// One file per recorded export that holds all frames of a sequence as planar B, G, R floats.
+// Keyframes predict every value from its left neighbour like the replay codec, the frames in between from the same value of the
+// previous frame, so a static or slowly panning camera leaves mostly zero residuals. The zigzag coded residuals are split into
+// byte lanes, which puts the always zero high bytes next to each other, and deflated at the fastest level.
+// Planes that equal the first one (the depth export repeats depth three times) are stored once.
+
+struct sequence_header
+{
+	uint32_t magic = 0x51534346; // "FCSQ"
+	uint32_t version = 1;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t keyframe_interval = 0;
+};
+
+struct sequence_frame_header
+{
+	uint32_t magic = 0x46534346; // "FCSF"
+	uint32_t frame_index = 0; // Index in the recording, frames that were dropped leave a gap
+	uint32_t keyframe = 0;
+	uint32_t duplicate_mask = 0; // Bit N set when plane N equals the first plane
+	uint64_t compressed_size = 0; // Zero for a frame that repeats the previous one
+};
+
+static constexpr int sequence_planes = 3;
+
+inline uint32_t sequence_residual(uint32_t bits, uint32_t pred_bits)
+{
+	const uint32_t delta = float_codec_to_ordered(bits) - float_codec_to_ordered(pred_bits);
+	return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+}
+inline uint32_t sequence_apply_residual(uint32_t zigzag, uint32_t pred_bits)
+{
+	const uint32_t delta = (zigzag >> 1) ^ (0u - (zigzag & 1));
+	return float_codec_from_ordered(float_codec_to_ordered(pred_bits) + delta);
+}
+
+// Frames arrive from several capture threads, so every frame takes a ticket in submission order on the present thread
+// and the writer stores them in ticket order. Tickets of frames that are not going to be written have to be skipped.
+// Frames that did not change are stored as a reference to the previous one.
+class sequence_writer
+{
+public:
+	~sequence_writer()
+	{
+		close();
+	}
+
+	// Allocates all buffers for frames of the given size up front
+	bool open(const std::filesystem::path &path, uint32_t width, uint32_t height, uint32_t keyframe_interval)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_file.open(path, std::ios::binary | std::ios::trunc);
+		if (!_file.is_open())
+			return false;
+
+		_header.width = width;
+		_header.height = height;
+		_header.keyframe_interval = keyframe_interval < 1 ? 1 : keyframe_interval;
+		_file.write(reinterpret_cast<const char *>(&_header), sizeof(_header));
+
+		const size_t num_values = static_cast<size_t>(width) * height * sequence_planes;
+		_previous.resize(num_values);
+		_current.resize(num_values);
+		_lanes.resize(num_values * 4);
+		_compressed.resize(mz_compressBound(static_cast<mz_ulong>(num_values * 4)));
+		_frames_since_keyframe = 0;
+		_file_bytes = sizeof(_header);
+		return !!_file;
+	}
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_file.is_open())
+			_file.close();
+	}
+
+	uint64_t reserve()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _next_ticket++;
+	}
+	// Does not wait for the turn of the ticket, so it can be called while the frame is dropped from the capture queue
+	void skip(uint64_t ticket)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_settled.emplace(ticket, -1);
+		advance_locked();
+	}
+	// Records that the frame equals the previous one, also without waiting for its turn
+	void repeat(uint64_t ticket, uint32_t frame_index)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_settled.emplace(ticket, frame_index);
+		advance_locked();
+	}
+
+	// Blocks until all frames with an earlier ticket were written, `planes` holds the three planes with float or half values.
+	// The frame is encoded without holding the lock, only the holder of the current ticket touches the buffers and the file.
+	bool write(uint64_t ticket, uint32_t frame_index, const void *planes, bool half, uint32_t width, uint32_t height)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_turn.wait(lock, [this, ticket]() { return _current_ticket == ticket; });
+		}
+
+		bool result = false;
+		if (_file.is_open() && width == _header.width && height == _header.height)
+			result = encode_frame(frame_index, planes, half);
+		_previous_lost = !result;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_current_ticket++;
+		advance_locked();
+		return result;
+	}
+
+	uint64_t frames() const { return _frames.load(); }
+	uint64_t repeated_frames() const { return _repeated_frames.load(); }
+	uint64_t raw_bytes() const { return _frames.load() * _previous.size() * sizeof(float); }
+	uint64_t file_bytes() const { return _file_bytes.load(); }
+
+private:
+	// Settles the skipped and repeated frames that are next in line, the holder of the previous ticket is done with the file
+	void advance_locked()
+	{
+		for (auto it = _settled.find(_current_ticket); it != _settled.end(); it = _settled.find(_current_ticket))
+		{
+			if (it->second >= 0)
+				repeat_frame(static_cast<uint32_t>(it->second));
+			else
+				_previous_lost = true;
+			_settled.erase(it);
+			_current_ticket++;
+		}
+		_turn.notify_all();
+	}
+
+	void repeat_frame(uint32_t frame_index)
+	{
+		// The frame it repeats never made it into the file, so this one is lost as well
+		if (!_file.is_open() || _frames == 0 || _previous_lost)
+			return;
+
+		sequence_frame_header frame;
+		frame.frame_index = frame_index;
+		_file.write(reinterpret_cast<const char *>(&frame), sizeof(frame));
+		_file.flush();
+		if (!_file)
+		{
+			_file.clear();
+			return;
+		}
+		_frames++;
+		_repeated_frames++;
+		_frames_since_keyframe++;
+		_file_bytes += sizeof(frame);
+	}
+
+	bool encode_frame(uint32_t frame_index, const void *planes, bool half)
+	{
+		const size_t num_pixels = static_cast<size_t>(_header.width) * _header.height;
+		const size_t num_values = num_pixels * sequence_planes;
+
+		if (half)
+			for (size_t i = 0; i < num_values; ++i)
+			{
+				const float value = half_to_float(static_cast<const uint16_t *>(planes)[i]);
+				std::memcpy(&_current[i], &value, 4);
+			}
+		else
+			std::memcpy(_current.data(), planes, num_values * 4);
+
+		sequence_frame_header frame;
+		frame.frame_index = frame_index;
+		frame.keyframe = _frames == 0 || _frames_since_keyframe >= _header.keyframe_interval;
+
+		for (int c = 1; c < sequence_planes; ++c)
+			if (std::memcmp(_current.data() + num_pixels * c, _current.data(), num_pixels * 4) == 0)
+				frame.duplicate_mask |= 1u << c;
+
+		// Residuals of the stored planes, split into byte lanes
+		size_t count = 0;
+		for (int c = 0; c < sequence_planes; ++c)
+			if ((frame.duplicate_mask & (1u << c)) == 0)
+				count += num_pixels;
+
+		size_t index = 0;
+		for (int c = 0; c < sequence_planes; ++c)
+		{
+			if (frame.duplicate_mask & (1u << c))
+				continue;
+			const uint32_t *const cur = _current.data() + num_pixels * c;
+			const uint32_t *const prev = _previous.data() + num_pixels * c;
+			for (size_t i = 0; i < num_pixels; ++i, ++index)
+			{
+				uint32_t pred_bits = 0;
+				if (!frame.keyframe)
+					pred_bits = prev[i];
+				else if (i % _header.width != 0)
+					pred_bits = cur[i - 1];
+				else if (i != 0)
+					pred_bits = cur[i - _header.width];
+
+				const uint32_t zigzag = sequence_residual(cur[i], pred_bits);
+				_lanes[index] = static_cast<unsigned char>(zigzag);
+				_lanes[count + index] = static_cast<unsigned char>(zigzag >> 8);
+				_lanes[count * 2 + index] = static_cast<unsigned char>(zigzag >> 16);
+				_lanes[count * 3 + index] = static_cast<unsigned char>(zigzag >> 24);
+			}
+		}
+
+		mz_ulong compressed_size = static_cast<mz_ulong>(_compressed.size());
+		if (mz_compress2(_compressed.data(), &compressed_size, _lanes.data(), static_cast<mz_ulong>(count * 4), MZ_BEST_SPEED) != MZ_OK)
+			return false;
+		frame.compressed_size = compressed_size;
+
+		_file.write(reinterpret_cast<const char *>(&frame), sizeof(frame));
+		_file.write(reinterpret_cast<const char *>(_compressed.data()), static_cast<std::streamsize>(compressed_size));
+		_file.flush();
+		if (!_file)
+		{
+			_file.clear();
+			return false;
+		}
+
+		_current.swap(_previous);
+		_frames++;
+		_frames_since_keyframe = frame.keyframe ? 1 : _frames_since_keyframe + 1;
+		_file_bytes += sizeof(frame) + compressed_size;
+		return true;
+	}
+
+	std::mutex _mutex;
+	std::condition_variable _turn;
+	std::ofstream _file;
+	sequence_header _header;
+	std::vector<uint32_t> _previous, _current;
+	std::vector<unsigned char> _lanes, _compressed;
+	uint64_t _next_ticket = 0;
+	uint64_t _current_ticket = 0;
+	std::map<uint64_t, int64_t> _settled; // Frame index of a repeat, -1 for a skipped frame
+	bool _previous_lost = false;
+	std::atomic<uint64_t> _frames { 0 };
+	std::atomic<uint64_t> _repeated_frames { 0 };
+	uint32_t _frames_since_keyframe = 0;
+	std::atomic<uint64_t> _file_bytes { 0 };
+};
+
+// Reads the frames of a container back in order
+class sequence_reader
+{
+public:
+	bool open(const std::filesystem::path &path)
+	{
+		_file.open(path, std::ios::binary);
+		if (!_file.is_open())
+			return false;
+		_file.read(reinterpret_cast<char *>(&_header), sizeof(_header));
+		if (!_file || _header.magic != sequence_header().magic || _header.version != 1 || _header.width == 0 || _header.height == 0)
+			return false;
+
+		const size_t num_values = static_cast<size_t>(_header.width) * _header.height * sequence_planes;
+		_previous.assign(num_values, 0);
+		_lanes.resize(num_values * 4);
+		return true;
+	}
+
+	uint32_t width() const { return _header.width; }
+	uint32_t height() const { return _header.height; }
+	uint32_t keyframe_interval() const { return _header.keyframe_interval; }
+
+	// Decodes the next frame into `planes`, which holds width * height * 3 floats. Returns false at the end or on a damaged frame.
+	bool next(sequence_frame_header &frame, float *planes)
+	{
+		_file.read(reinterpret_cast<char *>(&frame), sizeof(frame));
+		if (!_file || frame.magic != sequence_frame_header().magic || frame.compressed_size > mz_compressBound(static_cast<mz_ulong>(_lanes.size())))
+			return false;
+		if (!frame.keyframe && !_has_previous)
+			return false;
+
+		const size_t num_values = static_cast<size_t>(_header.width) * _header.height * sequence_planes;
+		if (frame.compressed_size == 0)
+		{
+			std::memcpy(planes, _previous.data(), num_values * 4);
+			return true;
+		}
+
+		_compressed.resize(static_cast<size_t>(frame.compressed_size));
+		_file.read(reinterpret_cast<char *>(_compressed.data()), static_cast<std::streamsize>(frame.compressed_size));
+		if (!_file)
+			return false;
+
+		const size_t num_pixels = static_cast<size_t>(_header.width) * _header.height;
+		size_t count = 0;
+		for (int c = 0; c < sequence_planes; ++c)
+			if ((frame.duplicate_mask & (1u << c)) == 0)
+				count += num_pixels;
+		if (count == 0)
+			return false;
+
+		mz_ulong size = static_cast<mz_ulong>(count * 4);
+		if (mz_uncompress(_lanes.data(), &size, _compressed.data(), static_cast<mz_ulong>(frame.compressed_size)) != MZ_OK || size != count * 4)
+			return false;
+
+		uint32_t *const out = reinterpret_cast<uint32_t *>(planes);
+		size_t index = 0;
+		for (int c = 0; c < sequence_planes; ++c)
+		{
+			uint32_t *const cur = out + num_pixels * c;
+			if (frame.duplicate_mask & (1u << c))
+			{
+				std::memcpy(cur, out, num_pixels * 4);
+				continue;
+			}
+			const uint32_t *const prev = _previous.data() + num_pixels * c;
+			for (size_t i = 0; i < num_pixels; ++i, ++index)
+			{
+				const uint32_t zigzag = static_cast<uint32_t>(_lanes[index]) | static_cast<uint32_t>(_lanes[count + index]) << 8 |
+					static_cast<uint32_t>(_lanes[count * 2 + index]) << 16 | static_cast<uint32_t>(_lanes[count * 3 + index]) << 24;
+
+				uint32_t pred_bits = 0;
+				if (!frame.keyframe)
+					pred_bits = prev[i];
+				else if (i % _header.width != 0)
+					pred_bits = cur[i - 1];
+				else if (i != 0)
+					pred_bits = cur[i - _header.width];
+
+				cur[i] = sequence_apply_residual(zigzag, pred_bits);
+			}
+		}
+
+		std::memcpy(_previous.data(), out, num_values * 4);
+		_has_previous = true;
+		return true;
+	}
+
+private:
+	std::ifstream _file;
+	sequence_header _header;
+	std::vector<uint32_t> _previous;
+	std::vector<unsigned char> _lanes, _compressed;
+	bool _has_previous = false;
+};
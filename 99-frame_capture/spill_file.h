@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "exr_codec.h"
+
+// Raw export planes written to disk as they are, so the expensive encode can happen later, even after a reload of the add-on.
+// Every record carries everything needed to encode it and a state that is flipped in place once its EXR was written.
+struct spill_record
+{
+	uint64_t offset = 0; // Of the record header
+	uint64_t payload_size = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	bool half = false;
+	exr_compression compression = exr_compression::piz;
+	float max_ms = 0.0f;
+	uint64_t max_bytes = 0;
+	int32_t window_x = 0; // Data window of the EXR, like exr_window
+	int32_t window_y = 0;
+	int32_t display_width = 0; // Zero for planes that are the full frame
+	int32_t display_height = 0;
+	uint32_t crop_left = 0; // Part of the planes that is encoded, their borders are only cut off then
+	uint32_t crop_top = 0;
+	uint32_t crop_width = 0; // Zero for all of them
+	uint32_t crop_height = 0;
+	std::string path; // UTF-8 path of the EXR to write
+};
+
+class spill_file
+{
+public:
+	// Opens or creates the file and collects the records that were not encoded yet
+	bool open(const std::filesystem::path &path)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		close_locked();
+
+		_path = path;
+		_file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+		if (!_file.is_open())
+			_file.open(path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+		if (!_file.is_open())
+			return false;
+
+		_file.seekg(0, std::ios::end);
+		const uint64_t file_size = static_cast<uint64_t>(_file.tellg());
+		_file.seekg(0);
+
+		uint64_t offset = 0;
+		while (offset < file_size)
+		{
+			spill_record record;
+			uint32_t state;
+			if (!read_header_locked(offset, record, state) || offset + record_size(record) > file_size)
+				break; // A record that was cut off by a crash, it and everything after it is dropped
+			if (state == state_pending)
+			{
+				_pending.push_back(record);
+				_pending_bytes += record.payload_size;
+			}
+			offset += record_size(record);
+		}
+		_end = offset;
+		_file.clear();
+
+		if (_pending.empty())
+			truncate_locked();
+		return true;
+	}
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		close_locked();
+	}
+
+	// Appends a record with its planes, the record is then pending until mark_done
+	bool append(spill_record record, const void *payload)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_file.is_open())
+			return false;
+
+		record.offset = _end;
+		std::string header;
+		put(header, magic);
+		put(header, state_pending);
+		put(header, record.width);
+		put(header, record.height);
+		put(header, static_cast<uint32_t>(record.half));
+		put(header, static_cast<uint32_t>(record.compression));
+		put(header, record.max_ms);
+		put(header, record.max_bytes);
+		put(header, record.payload_size);
+		put(header, record.window_x);
+		put(header, record.window_y);
+		put(header, record.display_width);
+		put(header, record.display_height);
+		put(header, record.crop_left);
+		put(header, record.crop_top);
+		put(header, record.crop_width);
+		put(header, record.crop_height);
+		put(header, static_cast<uint32_t>(record.path.size()));
+		header += record.path;
+
+		_file.seekp(static_cast<std::streamoff>(_end));
+		_file.write(header.data(), header.size());
+		_file.write(static_cast<const char *>(payload), static_cast<std::streamsize>(record.payload_size));
+		_file.flush();
+		if (!_file)
+		{
+			_file.clear();
+			return false;
+		}
+
+		_end += header.size() + record.payload_size;
+		_pending.push_back(std::move(record));
+		_pending_bytes += _pending.back().payload_size;
+		return true;
+	}
+
+	// Takes the oldest pending record out of the backlog, it stays pending in the file until mark_done
+	bool take(spill_record &record)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_pending.empty())
+			return false;
+		record = std::move(_pending.front());
+		_pending.pop_front();
+		_pending_bytes -= record.payload_size;
+		_in_progress++;
+		return true;
+	}
+	bool read(const spill_record &record, void *payload)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_file.seekg(static_cast<std::streamoff>(record.offset + header_size(record)));
+		_file.read(static_cast<char *>(payload), static_cast<std::streamsize>(record.payload_size));
+		const bool result = !!_file;
+		_file.clear();
+		return result;
+	}
+	// Called after take, with success false the record goes back to the backlog
+	void finish(const spill_record &record, bool success)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_in_progress--;
+		if (!success)
+		{
+			_pending.push_front(record);
+			_pending_bytes += record.payload_size;
+			return;
+		}
+
+		_file.seekp(static_cast<std::streamoff>(record.offset + sizeof(magic)));
+		const uint32_t state = state_done;
+		_file.write(reinterpret_cast<const char *>(&state), sizeof(state));
+		_file.flush();
+		_file.clear();
+
+		// Nothing left to do, so the file does not keep growing
+		if (_pending.empty() && _in_progress == 0)
+			truncate_locked();
+	}
+
+	size_t pending_count()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _pending.size() + _in_progress;
+	}
+	uint64_t pending_bytes()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _pending_bytes;
+	}
+	bool is_open()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _file.is_open();
+	}
+
+private:
+	// Records of the first version had no window and crop, they are dropped like cut off ones
+	static constexpr uint32_t magic = 0x32534346; // "FCS2"
+	static constexpr uint32_t state_pending = 0;
+	static constexpr uint32_t state_done = 1;
+
+	template <typename T>
+	static void put(std::string &out, const T &value)
+	{
+		out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+	static uint64_t header_size(const spill_record &record)
+	{
+		return sizeof(uint32_t) * 6 + sizeof(float) + sizeof(uint64_t) * 2 + sizeof(int32_t) * 4 + sizeof(uint32_t) * 4 + sizeof(uint32_t) + record.path.size();
+	}
+	static uint64_t record_size(const spill_record &record)
+	{
+		return header_size(record) + record.payload_size;
+	}
+
+	bool read_header_locked(uint64_t offset, spill_record &record, uint32_t &state)
+	{
+		uint32_t record_magic = 0, half = 0, compression = 0, path_size = 0;
+		_file.seekg(static_cast<std::streamoff>(offset));
+		_file.read(reinterpret_cast<char *>(&record_magic), sizeof(record_magic));
+		_file.read(reinterpret_cast<char *>(&state), sizeof(state));
+		_file.read(reinterpret_cast<char *>(&record.width), sizeof(record.width));
+		_file.read(reinterpret_cast<char *>(&record.height), sizeof(record.height));
+		_file.read(reinterpret_cast<char *>(&half), sizeof(half));
+		_file.read(reinterpret_cast<char *>(&compression), sizeof(compression));
+		_file.read(reinterpret_cast<char *>(&record.max_ms), sizeof(record.max_ms));
+		_file.read(reinterpret_cast<char *>(&record.max_bytes), sizeof(record.max_bytes));
+		_file.read(reinterpret_cast<char *>(&record.payload_size), sizeof(record.payload_size));
+		for (int32_t *value : { &record.window_x, &record.window_y, &record.display_width, &record.display_height })
+			_file.read(reinterpret_cast<char *>(value), sizeof(*value));
+		for (uint32_t *value : { &record.crop_left, &record.crop_top, &record.crop_width, &record.crop_height })
+			_file.read(reinterpret_cast<char *>(value), sizeof(*value));
+		_file.read(reinterpret_cast<char *>(&path_size), sizeof(path_size));
+		if (!_file || record_magic != magic || path_size > 4096 || compression > static_cast<uint32_t>(exr_compression::automatic) ||
+			static_cast<uint64_t>(record.crop_left) + record.crop_width > record.width || static_cast<uint64_t>(record.crop_top) + record.crop_height > record.height)
+			return false;
+		record.path.resize(path_size);
+		_file.read(&record.path[0], path_size);
+		record.offset = offset;
+		record.half = half != 0;
+		record.compression = static_cast<exr_compression>(compression);
+		return !!_file;
+	}
+
+	void truncate_locked()
+	{
+		_file.close();
+		std::error_code ec;
+		std::filesystem::resize_file(_path, 0, ec);
+		_file.open(_path, std::ios::binary | std::ios::in | std::ios::out);
+		_end = 0;
+	}
+	void close_locked()
+	{
+		if (_file.is_open())
+			_file.close();
+		_pending.clear();
+		_pending_bytes = 0;
+		_in_progress = 0;
+		_end = 0;
+	}
+
+	std::mutex _mutex;
+	std::fstream _file;
+	std::filesystem::path _path;
+	std::deque<spill_record> _pending;
+	uint64_t _pending_bytes = 0;
+	size_t _in_progress = 0;
+	uint64_t _end = 0;
+};
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#include <winternl.h>
+#else
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Scheduling of the capture threads, so encoding and writing stay off the cores and the disk the game needs. Every function applies to the
+// calling thread. Cores are logical processors and masks cover the first 64 of them, which on Windows is the processor group of the thread.
+
+enum class thread_priority : int
+{
+	normal,
+	below_normal,
+	lowest,
+	idle
+};
+
+inline constexpr const char *thread_priority_names[] = { "Normal", "Below normal", "Lowest", "Idle" };
+
+// On Windows a thread only has a background mode for its I/O, which both lower levels use and which lowers its CPU priority as well
+enum class io_priority : int
+{
+	normal,
+	low,
+	idle
+};
+
+inline constexpr const char *io_priority_names[] = { "Normal", "Low", "Idle (only when the disk is free)" };
+
+struct thread_qos
+{
+	thread_priority priority = thread_priority::normal;
+	io_priority io = io_priority::normal;
+	uint64_t affinity_mask = 0; // Cores the threads may run on, zero for all of them
+	bool pin_least_loaded = false; // Pins every thread to one of the least loaded cores of the mask
+};
+
+inline uint32_t core_count()
+{
+	const uint32_t count = std::thread::hardware_concurrency();
+	return count == 0 ? 1 : count < 64 ? count : 64;
+}
+
+// The mask limited to existing cores, all of them when nothing of it is left
+inline uint64_t usable_cores(uint64_t mask)
+{
+	const uint32_t count = core_count();
+	const uint64_t all = count >= 64 ? ~0ull : (1ull << count) - 1;
+	return (mask & all) != 0 ? mask & all : all;
+}
+
+// Lowering the priority always works, raising it again may need rights the process does not have on Linux
+inline bool set_thread_priority(thread_priority priority)
+{
+#ifdef _WIN32
+	static const int levels[] = { THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_IDLE };
+	return SetThreadPriority(GetCurrentThread(), levels[static_cast<int>(priority)]) != FALSE;
+#else
+	// The nice value is per thread on Linux
+	static const int levels[] = { 0, 5, 10, 19 };
+	return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), levels[static_cast<int>(priority)]) == 0;
+#endif
+}
+
+inline bool set_thread_affinity(uint64_t mask)
+{
+	mask = usable_cores(mask);
+#ifdef _WIN32
+	return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(mask)) != 0;
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (uint32_t core = 0; core < 64; ++core)
+		if ((mask & (1ull << core)) != 0)
+			CPU_SET(core, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+}
+
+inline bool set_thread_io_priority(io_priority priority)
+{
+#ifdef _WIN32
+	// Entering the mode twice or leaving it without having entered fails, so the state of the thread is kept
+	static thread_local bool background = false;
+	const bool want_background = priority != io_priority::normal;
+	if (want_background == background)
+		return true;
+	if (!SetThreadPriority(GetCurrentThread(), want_background ? THREAD_MODE_BACKGROUND_BEGIN : THREAD_MODE_BACKGROUND_END))
+		return false;
+	background = want_background;
+	return true;
+#else
+	// Best effort at its lowest level or the idle class, no class takes the priority from the nice value again
+	constexpr int ioprio_who_process = 1, ioprio_class_shift = 13, ioprio_class_be = 2, ioprio_class_idle = 3;
+	const int value = priority == io_priority::idle ? ioprio_class_idle << ioprio_class_shift : priority == io_priority::low ? (ioprio_class_be << ioprio_class_shift) | 7 : 0;
+	return syscall(SYS_ioprio_set, ioprio_who_process, 0, value) == 0;
+#endif
+}
+
+// Busy fraction of every core between two calls of sample(), from the counters the system keeps anyway, so sampling costs no waiting
+class core_load_sampler
+{
+public:
+	// False on the first call and whenever the counters cannot be read, loads are only filled in after a previous sample
+	bool sample(std::vector<float> &loads)
+	{
+		std::vector<uint64_t> busy, total;
+		if (!read_counters(busy, total))
+			return false;
+		const bool valid = _busy.size() == busy.size();
+		if (valid)
+		{
+			loads.resize(busy.size());
+			for (size_t i = 0; i < busy.size(); ++i)
+			{
+				const uint64_t elapsed = total[i] - _total[i];
+				loads[i] = elapsed != 0 ? static_cast<float>(busy[i] - _busy[i]) / static_cast<float>(elapsed) : 0.0f;
+			}
+		}
+		_busy.swap(busy);
+		_total.swap(total);
+		return valid;
+	}
+
+private:
+	static bool read_counters(std::vector<uint64_t> &busy, std::vector<uint64_t> &total)
+	{
+		const uint32_t count = core_count();
+		busy.assign(count, 0);
+		total.assign(count, 0);
+#ifdef _WIN32
+		using query_function = LONG(WINAPI *)(SYSTEM_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+		static const auto query = reinterpret_cast<query_function>(GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtQuerySystemInformation"));
+		if (query == nullptr)
+			return false;
+		std::vector<SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION> info(count);
+		ULONG size = 0;
+		if (query(SystemProcessorPerformanceInformation, info.data(), static_cast<ULONG>(info.size() * sizeof(info[0])), &size) < 0)
+			return false;
+		// Kernel time includes the idle time
+		for (size_t i = 0; i < count && i < size / sizeof(info[0]); ++i)
+		{
+			total[i] = static_cast<uint64_t>(info[i].KernelTime.QuadPart + info[i].UserTime.QuadPart);
+			busy[i] = total[i] - static_cast<uint64_t>(info[i].IdleTime.QuadPart);
+		}
+		return true;
+#else
+		FILE *const stat = std::fopen("/proc/stat", "r");
+		if (stat == nullptr)
+			return false;
+		char line[256];
+		while (std::fgets(line, sizeof(line), stat))
+		{
+			unsigned int core = 0;
+			unsigned long long user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+			if (std::sscanf(line, "cpu%u %llu %llu %llu %llu %llu %llu %llu %llu", &core, &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) < 5 || core >= count)
+				continue;
+			busy[core] = user + nice + system + irq + softirq + steal;
+			total[core] = busy[core] + idle + iowait;
+		}
+		std::fclose(stat);
+		return true;
+#endif
+	}
+
+	std::vector<uint64_t> _busy, _total;
+};
+
+// Core of the mask with the `rank`th lowest load, so threads of one pool that sample at the same time spread over different cores
+inline uint32_t least_loaded_core(const std::vector<float> &loads, uint64_t mask, size_t rank)
+{
+	mask = usable_cores(mask);
+	std::vector<uint32_t> cores;
+	for (uint32_t core = 0; core < loads.size() && core < 64; ++core)
+		if ((mask & (1ull << core)) != 0)
+			cores.push_back(core);
+	if (cores.empty())
+		return 0;
+	std::stable_sort(cores.begin(), cores.end(), [&loads](uint32_t a, uint32_t b) { return loads[a] < loads[b]; });
+	return cores[rank % cores.size()];
+}
+
+// Settings as applied to one thread. They are only set again when they changed, and a pinned thread looks for the least loaded core
+// again every few seconds, as the threads of the game move between cores as well.
+class thread_qos_state
+{
+public:
+	static constexpr double repin_seconds = 2.0;
+
+	// Returns false when the system refused one of the settings
+	bool apply(const thread_qos &qos, uint64_t generation, size_t rank)
+	{
+		const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		const bool changed = generation != _generation;
+		if (!changed && !(qos.pin_least_loaded && now - _pinned_time >= repin_seconds))
+			return true;
+
+		bool applied = true;
+		if (changed)
+		{
+			applied &= set_thread_io_priority(qos.io);
+			applied &= set_thread_priority(qos.priority);
+			_generation = generation;
+			_core = -1;
+		}
+
+		std::vector<float> loads;
+		if (qos.pin_least_loaded)
+		{
+			// Without a previous sample the load of the last few milliseconds has to do
+			if (!_sampler.sample(loads))
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+				_sampler.sample(loads);
+			}
+			_pinned_time = now;
+		}
+		if (!loads.empty())
+		{
+			const int core = static_cast<int>(least_loaded_core(loads, qos.affinity_mask, rank));
+			if (core != _core)
+			{
+				applied &= set_thread_affinity(1ull << core);
+				_core = core;
+			}
+		}
+		else if (changed)
+		{
+			applied &= set_thread_affinity(qos.affinity_mask);
+		}
+		return applied;
+	}
+
+	// Core the thread is pinned to, negative when it is not
+	int core() const { return _core; }
+
+private:
+	uint64_t _generation = 0;
+	double _pinned_time = 0.0;
+	int _core = -1;
+	core_load_sampler _sampler;
+};
@@ -0,0 +1,166 @@
+/*
+ * Benchmark of the fixed EXR codecs against the automatic codec selection on mixed synthetic content.
+ *
+ * Build: g++ -O2 -std=c++17 -I.. -I../../deps/tinyexr codec_bench.cpp -o codec_bench
+ * Usage: codec_bench [width height [max_ms [max_mb]]]
+ */
+
+#define TINYEXR_IMPLEMENTATION
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "tinyexr.h"
+#include "miniz.c"
+#include "exr_codec.h"
+
+struct frame
+{
+	const char *name;
+	int width, height;
+	std::vector<float> planes[3];
+};
+
+// Depth with the upper part of the screen at the far plane
+static void make_sky_depth(frame &f, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<float> noise(-0.0005f, 0.0005f);
+	for (int y = 0; y < f.height; ++y)
+		for (int x = 0; x < f.width; ++x)
+		{
+			const float v = y < f.height * 6 / 10 ? 1.0f : 0.2f + 0.5f * (f.height - y) / f.height + noise(rng);
+			for (auto &plane : f.planes)
+				plane[y * f.width + x] = v;
+		}
+}
+
+// Depth of dense vegetation, close to white noise
+static void make_foliage_depth(frame &f, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<float> leaf(0.05f, 0.3f);
+	for (int y = 0; y < f.height; ++y)
+		for (int x = 0; x < f.width; ++x)
+		{
+			const float v = leaf(rng);
+			for (auto &plane : f.planes)
+				plane[y * f.width + x] = v;
+		}
+}
+
+// Smoothly varying normals with some surface detail
+static void make_normals(frame &f, std::mt19937 &rng)
+{
+	std::normal_distribution<float> detail(0.0f, 0.02f);
+	for (int y = 0; y < f.height; ++y)
+		for (int x = 0; x < f.width; ++x)
+		{
+			float n[3] = { std::sin(x * 0.01f) + detail(rng), std::cos(y * 0.013f) + detail(rng), 1.0f };
+			const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int c = 0; c < 3; ++c)
+				f.planes[c][y * f.width + x] = n[c] / len * 0.5f + 0.5f;
+		}
+}
+
+static size_t encode(const frame &f, exr_compression compression, double &ms)
+{
+	EXRHeader header;
+	InitEXRHeader(&header);
+	EXRImage image;
+	InitEXRImage(&image);
+
+	const float *image_ptr[3] = { f.planes[0].data(), f.planes[1].data(), f.planes[2].data() };
+	image.num_channels = 3;
+	image.images = (unsigned char **)image_ptr;
+	image.width = f.width;
+	image.height = f.height;
+
+	EXRChannelInfo channels[3] = {};
+	int pixel_types[3] = { TINYEXR_PIXELTYPE_FLOAT, TINYEXR_PIXELTYPE_FLOAT, TINYEXR_PIXELTYPE_FLOAT };
+	channels[0].name[0] = 'B'; channels[1].name[0] = 'G'; channels[2].name[0] = 'R';
+	header.num_channels = 3;
+	header.channels = channels;
+	header.pixel_types = pixel_types;
+	header.requested_pixel_types = pixel_types;
+	header.compression_type = exr_compression_to_tinyexr(compression);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	unsigned char *memory = nullptr;
+	const char *err = nullptr;
+	const size_t size = SaveEXRImageToMemory(&image, &header, &memory, &err);
+	ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	free(memory);
+	return size;
+}
+
+int main(int argc, char *argv[])
+{
+	const int width = argc > 2 ? std::atoi(argv[1]) : 1920;
+	const int height = argc > 2 ? std::atoi(argv[2]) : 1080;
+	const float max_ms = argc > 3 ? static_cast<float>(std::atof(argv[3])) : 0.0f;
+	const int max_mb = argc > 4 ? std::atoi(argv[4]) : 0;
+
+	std::mt19937 rng(42);
+	frame frames[3] = { { "sky depth", width, height }, { "foliage depth", width, height }, { "normals", width, height } };
+	for (frame &f : frames)
+		for (auto &plane : f.planes)
+			plane.resize(static_cast<size_t>(width) * height);
+	make_sky_depth(frames[0], rng);
+	make_foliage_depth(frames[1], rng);
+	make_normals(frames[2], rng);
+
+	exr_codec_model model;
+	exr_auto_target target;
+	target.max_ms = max_ms;
+	target.max_bytes = static_cast<uint64_t>(max_mb) * 1024 * 1024;
+
+	// Warm the model up the same way the add-on does after its first captures
+	for (const frame &f : frames)
+		for (exr_compression c : { exr_compression::rle, exr_compression::zip, exr_compression::piz })
+		{
+			const float *planes[3] = { f.planes[0].data(), f.planes[1].data(), f.planes[2].data() };
+			double ms;
+			const size_t size = encode(f, c, ms);
+			model.update(c, exr_sample_content(planes, 3, width, height, 2), static_cast<uint64_t>(width) * height * 12, size, static_cast<float>(ms));
+		}
+
+	std::printf("%dx%d, auto limits: %.0f ms, %d MB (0 = none)\n\n", width, height, max_ms, max_mb);
+	std::printf("%-14s %-9s %10s %10s %8s   %s\n", "content", "codec", "ms", "MB", "ratio", "auto estimate");
+
+	double total_ms[5] = {}, total_mb[5] = {};
+	for (const frame &f : frames)
+	{
+		const double raw_mb = static_cast<double>(width) * height * 12 / (1024.0 * 1024.0);
+		for (int c = 0; c < 5; ++c)
+		{
+			exr_compression compression = static_cast<exr_compression>(c);
+			double sample_ms = 0.0;
+			exr_codec_decision decision;
+			if (compression == exr_compression::automatic)
+			{
+				const auto start = std::chrono::high_resolution_clock::now();
+				const float *planes[3] = { f.planes[0].data(), f.planes[1].data(), f.planes[2].data() };
+				decision = exr_choose_codec(exr_sample_content(planes, 3, width, height), static_cast<uint64_t>(width) * height * 12, target, model);
+				compression = decision.compression;
+				sample_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+
+			double ms;
+			const double mb = encode(f, compression, ms) / (1024.0 * 1024.0);
+			ms += sample_ms;
+			total_ms[c] += ms;
+			total_mb[c] += mb;
+
+			char name[32];
+			std::snprintf(name, sizeof(name), c == 4 ? "auto:%s" : "%s", exr_compression_names[static_cast<int>(compression)]);
+			std::printf("%-14s %-9s %10.1f %10.2f %8.3f   %s\n", f.name, name, ms, mb, mb / raw_mb, c == 4 ? decision.reason : "");
+		}
+	}
+
+	std::printf("\n%-14s %-9s %10s %10s\n", "total", "codec", "ms", "MB");
+	for (int c = 0; c < 5; ++c)
+		std::printf("%-14s %-9s %10.1f %10.2f\n", "", exr_compression_names[c], total_ms[c], total_mb[c]);
+
+	return 0;
+}
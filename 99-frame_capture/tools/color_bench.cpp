@@ -0,0 +1,205 @@
+/*
+ * Compares the back buffer formats on wall time and bytes: BMP as stb_image_write writes it, QOI and the striped PNG with a growing
+ * number of threads. Every frame is encoded and written to a file, like a capture thread does it, and QOI and PNG are decoded
+ * again to check they are lossless. The frames are synthetic, a sky gradient, noisy terrain and flat overlay boxes.
+ *
+ * Build: g++ -O2 -std=c++17 -pthread -I.. -I../../deps/stb -I../../deps/tinyexr color_bench.cpp -o color_bench
+ * Usage: color_bench [width height [frames [output_directory]]]
+ */
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "stb_image_write.h"
+#include "miniz.c"
+#include "color_encoder.h"
+
+static std::vector<unsigned char> make_frame(uint32_t width, uint32_t height, uint32_t frame)
+{
+	std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4);
+	uint32_t seed = 12345 + frame;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			unsigned char *const p = &rgba[(static_cast<size_t>(y) * width + x) * 4];
+			seed = seed * 1664525 + 1013904223;
+			const int noise = static_cast<int>(seed >> 28) - 8;
+			const uint32_t horizon = height / 2 + static_cast<uint32_t>(height / 12 * ((x + frame * 3) % 512) / 512);
+			if (y < horizon)
+			{
+				p[0] = static_cast<unsigned char>(90 + 80 * y / height);
+				p[1] = static_cast<unsigned char>(140 + 60 * y / height);
+				p[2] = 230;
+			}
+			else
+			{
+				const int shade = 60 + static_cast<int>(((x + frame * 3) / 7 ^ y / 5) % 40);
+				p[0] = static_cast<unsigned char>(std::clamp(shade + noise, 0, 255));
+				p[1] = static_cast<unsigned char>(std::clamp(shade + 30 + noise, 0, 255));
+				p[2] = static_cast<unsigned char>(std::clamp(shade / 2 + noise, 0, 255));
+			}
+			// Overlay boxes in the corners
+			if ((x < width / 5 || x > width * 4 / 5) && y > height * 5 / 6)
+				p[0] = p[1] = p[2] = 24;
+			p[3] = 255;
+		}
+	}
+	return rgba;
+}
+
+static bool decode_qoi(const std::vector<unsigned char> &file, std::vector<unsigned char> &rgba)
+{
+	if (file.size() < 22 || std::memcmp(file.data(), "qoif", 4) != 0)
+		return false;
+	const uint32_t width = static_cast<uint32_t>(file[4]) << 24 | file[5] << 16 | file[6] << 8 | file[7];
+	const uint32_t height = static_cast<uint32_t>(file[8]) << 24 | file[9] << 16 | file[10] << 8 | file[11];
+	rgba.resize(static_cast<size_t>(width) * height * 4);
+
+	unsigned char index[64][4] = {};
+	unsigned char px[4] = { 0, 0, 0, 255 };
+	size_t p = 14, run = 0;
+	for (size_t i = 0; i < rgba.size(); i += 4)
+	{
+		if (run != 0)
+		{
+			run--;
+		}
+		else if (p < file.size() - 8)
+		{
+			const unsigned char b1 = file[p++];
+			if (b1 == 0xFE)
+			{
+				px[0] = file[p++]; px[1] = file[p++]; px[2] = file[p++];
+			}
+			else if (b1 == 0xFF)
+			{
+				px[0] = file[p++]; px[1] = file[p++]; px[2] = file[p++]; px[3] = file[p++];
+			}
+			else if ((b1 & 0xC0) == 0x00)
+			{
+				std::memcpy(px, index[b1], 4);
+			}
+			else if ((b1 & 0xC0) == 0x40)
+			{
+				px[0] += ((b1 >> 4) & 3) - 2; px[1] += ((b1 >> 2) & 3) - 2; px[2] += (b1 & 3) - 2;
+			}
+			else if ((b1 & 0xC0) == 0x80)
+			{
+				const unsigned char b2 = file[p++];
+				const int dg = (b1 & 0x3F) - 32;
+				px[0] += dg - 8 + ((b2 >> 4) & 0xF); px[1] += dg; px[2] += dg - 8 + (b2 & 0xF);
+			}
+			else
+			{
+				run = b1 & 0x3F;
+			}
+			std::memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+		}
+		std::memcpy(&rgba[i], px, 4);
+	}
+	return true;
+}
+
+static bool decode_png(const std::vector<unsigned char> &file, uint32_t width, uint32_t height, std::vector<unsigned char> &rgba)
+{
+	// Joins the IDAT chunks and undoes the Up filter, which is all the encoder uses
+	std::vector<unsigned char> stream;
+	for (size_t p = 8; p + 12 <= file.size();)
+	{
+		const uint32_t size = static_cast<uint32_t>(file[p]) << 24 | file[p + 1] << 16 | file[p + 2] << 8 | file[p + 3];
+		if (std::memcmp(&file[p + 4], "IDAT", 4) == 0)
+			stream.insert(stream.end(), file.begin() + p + 8, file.begin() + p + 8 + size);
+		const uint32_t crc = static_cast<uint32_t>(file[p + 8 + size]) << 24 | file[p + 9 + size] << 16 | file[p + 10 + size] << 8 | file[p + 11 + size];
+		if (static_cast<uint32_t>(mz_crc32(MZ_CRC32_INIT, &file[p + 4], size + 4)) != crc)
+			return false;
+		p += 12 + size;
+	}
+
+	const size_t row_size = static_cast<size_t>(width) * 4;
+	std::vector<unsigned char> filtered((row_size + 1) * height);
+	mz_ulong filtered_size = static_cast<mz_ulong>(filtered.size());
+	if (mz_uncompress(filtered.data(), &filtered_size, stream.data(), static_cast<mz_ulong>(stream.size())) != MZ_OK || filtered_size != filtered.size())
+		return false;
+
+	rgba.resize(row_size * height);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const unsigned char *const src = &filtered[y * (row_size + 1)];
+		for (size_t x = 0; x < row_size; ++x)
+			rgba[y * row_size + x] = static_cast<unsigned char>(src[1 + x] + (src[0] == 2 ? rgba[(y - 1) * row_size + x] : 0));
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	const uint32_t width = argc > 2 ? std::atoi(argv[1]) : 3840;
+	const uint32_t height = argc > 2 ? std::atoi(argv[2]) : 2160;
+	const uint32_t frames = argc > 3 ? std::atoi(argv[3]) : 4;
+	const std::filesystem::path directory = argc > 4 ? argv[4] : std::filesystem::temp_directory_path();
+
+	std::vector<std::vector<unsigned char>> sources;
+	for (uint32_t f = 0; f < frames; ++f)
+		sources.push_back(make_frame(width, height, f));
+
+	const uint32_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::printf("%u frames of %ux%u, %u hardware threads\n", frames, width, height, hardware_threads);
+	std::printf("%-22s %10s %10s %8s\n", "format", "ms/frame", "MB/frame", "ratio");
+
+	std::vector<unsigned char> buffer, file_data, decoded;
+	std::vector<png_stripe> stripes;
+	const double raw_mb = static_cast<double>(width) * height * 4 / (1024.0 * 1024.0);
+
+	const auto run = [&](const char *name, color_format format, uint32_t threads) {
+		const std::filesystem::path path = directory / (std::string("color_bench") + color_format_extensions[static_cast<int>(format)]);
+		uint64_t bytes = 0;
+		bool lossless = true;
+		const auto start = std::chrono::steady_clock::now();
+		for (const std::vector<unsigned char> &rgba : sources)
+		{
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			const auto output = [&](const unsigned char *data, size_t size) {
+				file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+				bytes += size;
+				return !!file;
+			};
+			if (format == color_format::bmp)
+				stbi_write_bmp_to_func([](void *context, void *data, int size) {
+					(*static_cast<decltype(output) *>(context))(static_cast<const unsigned char *>(data), static_cast<size_t>(size));
+				}, const_cast<void *>(static_cast<const void *>(&output)), width, height, 4, rgba.data());
+			else if (format == color_format::qoi)
+				encode_qoi(rgba.data(), width, height, buffer, output);
+			else
+				encode_png(rgba.data(), width, height, threads, stripes, output);
+		}
+		const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// The last frame is read back and compared, outside of the timing
+		if (format != color_format::bmp)
+		{
+			std::ifstream file(path, std::ios::binary);
+			file_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			lossless = (format == color_format::qoi ? decode_qoi(file_data, decoded) : decode_png(file_data, width, height, decoded)) && decoded == sources.back();
+		}
+		std::printf("%-22s %10.1f %10.2f %8.2f%s\n", name, elapsed * 1000.0 / frames, bytes / (1024.0 * 1024.0) / frames, raw_mb * frames / (bytes / (1024.0 * 1024.0)),
+			lossless ? "" : "  DECODED FRAME DIFFERS");
+		std::error_code ec;
+		std::filesystem::remove(path, ec);
+	};
+
+	run("BMP", color_format::bmp, 1);
+	run("QOI", color_format::qoi, 1);
+	for (uint32_t threads = 1; threads <= std::max(8u, hardware_threads); threads *= 2)
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "PNG %u stripes", threads);
+		run(name, color_format::png, threads);
+	}
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Converts the raw export textures (.dds) the add-on writes when the export file type is "Raw texture" into the depth and normal EXRs
+ * it would have written itself, "<prefix> ExportTexture.dds" becomes "<prefix> DepthBuffer.exr" and "<prefix> NormalMap.exr".
+ *
+ * Build: g++ -O2 -std=c++17 -I.. -I../../deps/tinyexr dds_to_exr.cpp -o dds_to_exr
+ * Usage: dds_to_exr [-c compression] file.dds...
+ *        compression is 0 None, 1 RLE, 2 ZIP, 3 PIZ (default) or 4 Auto
+ */
+
+#define TINYEXR_IMPLEMENTATION
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "tinyexr.h"
+#include "miniz.c"
+#include "dds_writer.h"
+#include "exr_writer.h"
+
+int main(int argc, char *argv[])
+{
+	exr_write_settings settings;
+	settings.compression = exr_compression::piz;
+	int first = 1;
+	if (argc > 2 && std::strcmp(argv[1], "-c") == 0)
+	{
+		settings.compression = static_cast<exr_compression>(std::atoi(argv[2]));
+		first = 3;
+	}
+	if (first >= argc || settings.compression > exr_compression::automatic)
+	{
+		std::fprintf(stderr, "Usage: %s [-c compression] file.dds...\n", argv[0]);
+		return 2;
+	}
+
+	capture_arena arena;
+	exr_codec_model model;
+	std::vector<float> texels, planes;
+	int failed = 0;
+
+	for (int i = first; i < argc; ++i)
+	{
+		const std::filesystem::path input = argv[i];
+		std::ifstream file(input, std::ios::binary);
+		uint32_t format = 0, width = 0, height = 0, row_size = 0;
+		if (!read_dds_header(file, format, width, height, row_size))
+		{
+			std::fprintf(stderr, "%s is not a DDS file with a DX10 header\n", input.u8string().c_str());
+			failed++;
+			continue;
+		}
+
+		const uint32_t channels = format == dds_format_r32g32b32a32_float ? 4 : format == dds_format_r32_float ? 1 : 0;
+		if (channels == 0 || row_size != width * channels * sizeof(float))
+		{
+			std::fprintf(stderr, "%s has DXGI format %u, only RGBA32F and R32F export textures are supported\n", input.u8string().c_str(), format);
+			failed++;
+			continue;
+		}
+
+		const size_t num_pixels = static_cast<size_t>(width) * height;
+		texels.resize(num_pixels * channels);
+		file.read(reinterpret_cast<char *>(texels.data()), static_cast<std::streamsize>(texels.size() * sizeof(float)));
+		if (!file)
+		{
+			std::fprintf(stderr, "%s is cut off\n", input.u8string().c_str());
+			failed++;
+			continue;
+		}
+
+		std::string prefix = input.filename().u8string();
+		const size_t suffix = prefix.rfind("ExportTexture.dds");
+		prefix = suffix != std::string::npos ? prefix.substr(0, suffix) : input.stem().u8string() + " ";
+
+		// The export shader puts the normals into RGB and depth into alpha, the EXRs have B, G and R planes like the add-on writes them
+		planes.resize(num_pixels * 3);
+		for (int pass = 0; pass < (channels == 4 ? 2 : 1); ++pass)
+		{
+			const bool depth = pass == 0;
+			for (size_t p = 0; p < num_pixels; ++p)
+			{
+				const float *const src = &texels[p * channels];
+				planes[p] = depth ? src[channels - 1] : src[2];
+				planes[num_pixels + p] = depth ? src[channels - 1] : src[1];
+				planes[num_pixels * 2 + p] = depth ? src[channels - 1] : src[0];
+			}
+
+			const std::filesystem::path path = input.parent_path() / std::filesystem::u8path(prefix + (depth ? "DepthBuffer.exr" : "NormalMap.exr"));
+			capture_trace trace;
+			if (!write_exr_planes(reinterpret_cast<const unsigned char *>(planes.data()), false, width, height, path, settings, arena, model, trace))
+			{
+				std::fprintf(stderr, "Failed to write %s\n", path.u8string().c_str());
+				failed++;
+			}
+		}
+	}
+
+	std::printf("%d of %d textures converted\n", argc - first - failed, argc - first);
+	return failed != 0 ? 1 : 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * Replays a trace of add-on events recorded in a game (Events.fctrace) into the event hooks of the add-on at full speed, against the mock device
+ * of mock_runtime.h, and prints what every event type costs in the hooks. With an output path the hooks record the trace again while replaying it,
+ * which measures the cost of recording. Its trace comes out a little smaller, as handles of the mock are shorter. --synthetic writes a trace with passes of draws to try it without a game.
+ *
+ * Build: cmake -S .. -B build && cmake --build build --target event_replay
+ * Usage: event_replay trace.fctrace [repeats [rerecorded.fctrace]]
+ *        event_replay --synthetic trace.fctrace [frames [draws_per_frame]]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "mock_runtime.h"
+
+using namespace reshade::api;
+using clock_type = std::chrono::steady_clock;
+
+// A frame of a deferred renderer: a depth prepass, a G-buffer pass and a lighting pass, spread over four command lists
+static bool write_synthetic(const char *path, uint32_t frames, uint32_t draws_per_frame)
+{
+	event_trace_writer writer;
+	if (!writer.open(path))
+		return false;
+
+	uint64_t next_handle = 0x10000;
+	const uint32_t num_targets = 6;
+	uint64_t resources[num_targets], views[num_targets];
+	for (uint32_t i = 0; i < num_targets; ++i)
+	{
+		trace_record record;
+		record.type = trace_event::init_resource;
+		record.handle = resources[i] = next_handle += 0x40;
+		record.desc = resource_desc(1920, 1080, 1, 1, i == 0 ? format::d32_float : format::r16g16b16a16_float, 1, memory_heap::gpu_only, i == 0 ? resource_usage::depth_stencil : resource_usage::render_target);
+		record.usage = record.desc.usage;
+		writer.write(record);
+		record.type = trace_event::init_resource_view;
+		record.parent = resources[i];
+		record.handle = views[i] = next_handle += 0x40;
+		record.view_desc = resource_view_desc(record.desc.texture.format);
+		writer.write(record);
+	}
+
+	const uint64_t command_lists[4] = { 0x7000100, 0x7000200, 0x7000300, 0x7000400 };
+	uint32_t seed = 1;
+	for (uint32_t frame = 0; frame < frames; ++frame)
+	{
+		for (uint32_t pass = 0; pass < 3; ++pass)
+		{
+			const uint64_t cmd = command_lists[(frame + pass) % 4];
+			trace_record record;
+			record.object = cmd;
+			record.type = trace_event::bind_render_targets_and_depth_stencil;
+			record.count = pass == 0 ? 0 : pass == 1 ? 4 : 1;
+			for (uint32_t i = 0; i < record.count; ++i)
+				record.views[i] = views[1 + i];
+			record.handle = pass == 2 ? 0 : views[0];
+			writer.write(record);
+			record.type = trace_event::bind_viewports;
+			record.count = 1;
+			record.viewports[0] = { 0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f };
+			writer.write(record);
+			if (pass == 0)
+			{
+				record.type = trace_event::clear_depth_stencil_view;
+				record.handle = views[0];
+				record.has_depth = true;
+				record.depth = 1.0f;
+				record.has_stencil = true;
+				record.rect_count = frame % 4 == 3 ? 2 : 0; // Now and then only parts of it
+				writer.write(record);
+			}
+
+			const uint32_t draws = pass == 2 ? 8 : draws_per_frame / 2;
+			for (uint32_t draw = 0; draw < draws; ++draw)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				record.type = (seed >> 28) == 0 ? trace_event::draw_or_dispatch_indirect : (seed >> 26) % 8 == 0 ? trace_event::draw : trace_event::draw_indexed;
+				record.args[0] = record.type == trace_event::draw_or_dispatch_indirect ? static_cast<uint32_t>(indirect_command::draw_indexed) : 3 * (1 + (seed >> 12) % 20000);
+				record.args[1] = record.type == trace_event::draw_or_dispatch_indirect ? 1 + (seed >> 20) % 64 : 1 + ((seed >> 8) & 3);
+				record.args[2] = record.type == trace_event::draw_or_dispatch_indirect ? 20 : (seed >> 4) % 500000;
+				record.args[3] = static_cast<uint32_t>(-static_cast<int32_t>((seed >> 16) % 1000));
+				record.args[4] = 0;
+				record.handle = next_handle;
+				record.offset = (seed >> 10) % 4096 * 20;
+				writer.write(record);
+			}
+		}
+		trace_record present;
+		present.type = trace_event::present;
+		present.object = 0x9000000;
+		present.parent = 0x9000100;
+		writer.write(present);
+	}
+	writer.close();
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 2 && std::strcmp(argv[1], "--synthetic") == 0)
+	{
+		const uint32_t frames = argc > 3 ? std::atoi(argv[3]) : 600;
+		const uint32_t draws = argc > 4 ? std::atoi(argv[4]) : 2000;
+		if (!write_synthetic(argv[2], frames, draws))
+		{
+			std::fprintf(stderr, "Could not write %s\n", argv[2]);
+			return 1;
+		}
+		std::printf("Wrote %u frames of %u draws to %s\n", frames, draws, argv[2]);
+		return 0;
+	}
+	if (argc < 2)
+	{
+		std::fprintf(stderr, "Usage: event_replay trace.fctrace [repeats [rerecorded.fctrace]]\n       event_replay --synthetic trace.fctrace [frames [draws_per_frame]]\n");
+		return 1;
+	}
+	const int repeats = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 5;
+
+	event_trace_reader reader;
+	if (!reader.open(argv[1]))
+	{
+		std::fprintf(stderr, "Could not read %s\n", argv[1]);
+		return 1;
+	}
+
+	mock::mock_runtime runtime(device_api::d3d12, 1, 1);
+	runtime.device_.host_memory = false;
+	device *const dev = &runtime.device_;
+
+	// Cost of reading the clock twice, taken off every event
+	double timer_ns = 0.0;
+	{
+		const int samples = 1000000;
+		const clock_type::time_point start = clock_type::now();
+		for (int i = 0; i < samples; ++i)
+			clock_type::now();
+		timer_ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / samples;
+	}
+
+	if (argc > 3)
+	{
+		eventTraceFrames = 1 << 30;
+		start_event_trace(argv[3]);
+	}
+
+	uint64_t counts[trace_event_count] = {};
+	double ns[trace_event_count] = {};
+	double wall_seconds = 0.0;
+	bool truncated = false;
+	for (int repeat = 0; repeat < repeats; ++repeat)
+	{
+		reader.rewind();
+		std::unordered_map<uint64_t, resource> resources;
+		std::unordered_map<uint64_t, resource_view> views;
+		std::unordered_map<uint64_t, std::unique_ptr<mock::mock_command_list>> command_lists;
+		const auto find_resource = [&resources](uint64_t handle) { const auto it = resources.find(handle); return it != resources.end() ? it->second : resource { 0 }; };
+		const auto find_view = [&views](uint64_t handle) { const auto it = views.find(handle); return it != views.end() ? it->second : resource_view { 0 }; };
+
+		// Traces keep how many rects a clear had but not where they were, the hooks only look at the count
+		std::vector<rect> clear_rects;
+
+		const clock_type::time_point pass_start = clock_type::now();
+		trace_record record;
+		while (reader.next(record))
+		{
+			command_list *cmd = nullptr;
+			if (record.object != 0 && record.type != trace_event::present)
+			{
+				std::unique_ptr<mock::mock_command_list> &list = command_lists[record.object];
+				if (list == nullptr)
+					list.reset(new mock::mock_command_list(&runtime.device_));
+				cmd = list.get();
+			}
+
+			// Handles of the game become handles of the mock, resources are created before their init event like in the game
+			resource_view rtvs[trace_record::max_views];
+			clock_type::time_point start;
+			switch (record.type)
+			{
+			case trace_event::init_resource:
+			{
+				resource res;
+				dev->create_resource(record.desc, nullptr, record.usage, &res);
+				resources[record.handle] = res;
+				start = clock_type::now();
+				on_init_resource(dev, record.desc, nullptr, record.usage, res);
+				break;
+			}
+			case trace_event::destroy_resource:
+			{
+				const resource res = find_resource(record.handle);
+				start = clock_type::now();
+				on_destroy_resource(dev, res);
+				break;
+			}
+			case trace_event::init_resource_view:
+			{
+				resource_view view;
+				const resource res = find_resource(record.parent);
+				dev->create_resource_view(res, record.usage, record.view_desc, &view);
+				views[record.handle] = view;
+				start = clock_type::now();
+				on_init_resource_view(dev, res, record.usage, record.view_desc, view);
+				break;
+			}
+			case trace_event::destroy_resource_view:
+			{
+				const resource_view view = find_view(record.handle);
+				start = clock_type::now();
+				on_destroy_resource_view(dev, view);
+				break;
+			}
+			case trace_event::bind_render_targets_and_depth_stencil:
+			{
+				for (uint32_t i = 0; i < record.count; ++i)
+					rtvs[i] = find_view(record.views[i]);
+				const resource_view dsv = find_view(record.handle);
+				start = clock_type::now();
+				on_bind_render_targets_and_depth_stencil(cmd, record.count, rtvs, dsv);
+				break;
+			}
+			case trace_event::bind_viewports:
+				start = clock_type::now();
+				on_bind_viewports(cmd, record.first, record.count, record.viewports);
+				break;
+			case trace_event::clear_depth_stencil_view:
+			{
+				const resource_view dsv = find_view(record.handle);
+				if (clear_rects.size() < record.rect_count)
+					clear_rects.resize(record.rect_count);
+				start = clock_type::now();
+				on_clear_depth_stencil_view(cmd, dsv, record.has_depth ? &record.depth : nullptr, record.has_stencil ? &record.stencil : nullptr, record.rect_count,
+					record.rect_count != 0 ? clear_rects.data() : nullptr);
+				break;
+			}
+			case trace_event::draw:
+				start = clock_type::now();
+				on_draw(cmd, record.args[0], record.args[1], record.args[2], record.args[3]);
+				break;
+			case trace_event::draw_indexed:
+				start = clock_type::now();
+				on_draw_indexed(cmd, record.args[0], record.args[1], record.args[2], static_cast<int32_t>(record.args[3]), record.args[4]);
+				break;
+			case trace_event::draw_or_dispatch_indirect:
+			{
+				const resource buffer = find_resource(record.handle);
+				start = clock_type::now();
+				on_draw_or_dispatch_indirect(cmd, static_cast<indirect_command>(record.args[0]), buffer, record.offset, record.args[1], record.args[2]);
+				break;
+			}
+			case trace_event::present:
+				start = clock_type::now();
+				on_present(runtime.get_command_queue(), &runtime, nullptr, nullptr, 0, nullptr);
+				break;
+			}
+			const clock_type::time_point end = clock_type::now();
+
+			const uint32_t type = static_cast<uint32_t>(record.type);
+			counts[type]++;
+			ns[type] += std::chrono::duration<double, std::nano>(end - start).count();
+		}
+		wall_seconds += std::chrono::duration<double>(clock_type::now() - pass_start).count();
+		truncated |= !reader.at_end();
+	}
+
+	if (argc > 3)
+	{
+		const uint64_t recorded = eventTrace.events();
+		stop_event_trace();
+		std::printf("Recorded %llu events again to %s\n", static_cast<unsigned long long>(recorded), argv[3]);
+	}
+
+	uint64_t total_count = 0;
+	double total_ns = 0.0;
+	std::printf("%-40s %12s %10s\n", "event", "count", "ns/event");
+	for (uint32_t type = 1; type < trace_event_count; ++type)
+	{
+		if (counts[type] == 0)
+			continue;
+		const double hook_ns = std::max(ns[type] / counts[type] - timer_ns, 0.0);
+		std::printf("%-40s %12llu %10.1f\n", trace_event_names[type], static_cast<unsigned long long>(counts[type] / repeats), hook_ns);
+		total_count += counts[type];
+		total_ns += hook_ns * counts[type];
+	}
+	std::printf("%-40s %12llu %10.1f\n", "all", static_cast<unsigned long long>(total_count / repeats), total_count != 0 ? total_ns / total_count : 0.0);
+	std::printf("%.1f MB trace, %d passes, %.1f ms per pass with translation, %.1f ns clock overhead taken off%s\n", reader.size() / (1024.0 * 1024.0), repeats,
+		wall_seconds * 1000.0 / repeats, timer_ns, truncated ? ", trace ends in a cut off record" : "");
+	return 0;
+}
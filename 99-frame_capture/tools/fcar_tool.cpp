@@ -0,0 +1,99 @@
+/*
+ * Lists or extracts the files of a capture archive (.fcar). Archives of a recording that never finished, for example after a crash,
+ * have no index, it is rebuilt from the entry headers then.
+ *
+ * Build: g++ -O2 -std=c++17 -I.. fcar_tool.cpp -o fcar_tool
+ * Usage: fcar_tool list archive.fcar
+ *        fcar_tool extract archive.fcar [output_directory]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include "capture_archive.h"
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3 || (std::strcmp(argv[1], "list") != 0 && std::strcmp(argv[1], "extract") != 0))
+	{
+		std::fprintf(stderr, "Usage: %s list archive.fcar\n       %s extract archive.fcar [output_directory]\n", argv[0], argv[0]);
+		return 2;
+	}
+
+	const bool extract = std::strcmp(argv[1], "extract") == 0;
+	const std::filesystem::path input = argv[2];
+	const std::filesystem::path directory = argc > 3 ? std::filesystem::path(argv[3]) : input.parent_path();
+
+	archive_reader reader;
+	if (!reader.open(input))
+	{
+		std::fprintf(stderr, "%s is not a capture archive\n", input.u8string().c_str());
+		return 1;
+	}
+	if (reader.recovered())
+		std::fprintf(stderr, "The archive has no valid index, %zu entries were recovered from their headers\n", reader.entries().size());
+
+	// "<prefix> Sequence.fcar" becomes "<prefix> 000000 DepthBuffer.exr" and so on
+	const std::string stem = input.stem().u8string();
+	const size_t split = stem.rfind(' ');
+	const std::string prefix = split != std::string::npos ? stem.substr(0, split + 1) : std::string();
+
+	// Entries are stored in the order the capture threads finished them, files are written in frame order
+	std::vector<archive_entry> entries = reader.entries();
+	std::stable_sort(entries.begin(), entries.end(), [](const archive_entry &a, const archive_entry &b) {
+		return a.frame != b.frame ? a.frame < b.frame : a.pass < b.pass;
+	});
+
+	if (extract)
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+	}
+
+	// Last data of every pass, which the entries of unchanged frames stand for
+	std::map<archive_pass, std::vector<unsigned char>> previous;
+	uint64_t total_bytes = 0;
+	size_t unchanged = 0;
+
+	for (const archive_entry &entry : entries)
+	{
+		char name[64];
+		std::snprintf(name, sizeof(name), "%.6u %s", entry.frame, archive_pass_names[static_cast<uint32_t>(entry.pass)]);
+		total_bytes += entry.size;
+		unchanged += entry.size == 0;
+
+		if (!extract)
+		{
+			std::printf("%10.3f s  %12llu bytes  %s%s\n", entry.timestamp / 1000000.0, static_cast<unsigned long long>(entry.size), name, entry.size == 0 ? "  (unchanged)" : "");
+			continue;
+		}
+
+		if (entry.size != 0)
+		{
+			if (!reader.read(entry, previous[entry.pass]))
+			{
+				std::fprintf(stderr, "Failed to read %s\n", name);
+				return 1;
+			}
+		}
+		else if (previous[entry.pass].empty())
+		{
+			std::fprintf(stderr, "Skipping %s, the frame it repeats is not in the archive\n", name);
+			continue;
+		}
+
+		const std::vector<unsigned char> &file_data = previous[entry.pass];
+		const std::filesystem::path path = directory / std::filesystem::u8path(prefix + name);
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char *>(file_data.data()), static_cast<std::streamsize>(file_data.size()));
+		if (!file)
+		{
+			std::fprintf(stderr, "Failed to write %s\n", path.u8string().c_str());
+			return 1;
+		}
+	}
+
+	std::printf("%zu files (%zu unchanged), %.1f MB\n", entries.size(), unchanged, total_bytes / (1024.0 * 1024.0));
+	return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Rebuilds the EXR files of a sequence recorded into a delta container (.fcseq), named like the add-on names the EXRs of a sequence.
+ *
+ * Build: g++ -O2 -std=c++17 -I.. -I../../deps/tinyexr fcseq_to_exr.cpp -o fcseq_to_exr
+ * Usage: fcseq_to_exr container.fcseq [output_directory [compression]]
+ *        compression is 0 None, 1 RLE, 2 ZIP, 3 PIZ (default) or 4 Auto
+ */
+
+#define TINYEXR_IMPLEMENTATION
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "tinyexr.h"
+#include "miniz.c"
+#include "exr_writer.h"
+#include "sequence_container.h"
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::fprintf(stderr, "Usage: %s container.fcseq [output_directory [compression]]\n", argv[0]);
+		return 2;
+	}
+
+	const std::filesystem::path input = argv[1];
+	const std::filesystem::path directory = argc > 2 ? std::filesystem::path(argv[2]) : input.parent_path();
+	exr_write_settings settings;
+	settings.compression = static_cast<exr_compression>(argc > 3 ? std::atoi(argv[3]) : static_cast<int>(exr_compression::piz));
+	if (settings.compression > exr_compression::automatic)
+	{
+		std::fprintf(stderr, "Unknown compression %d\n", static_cast<int>(settings.compression));
+		return 2;
+	}
+
+	sequence_reader reader;
+	if (!reader.open(input))
+	{
+		std::fprintf(stderr, "%s is not a sequence container\n", input.u8string().c_str());
+		return 1;
+	}
+
+	// "<prefix> DepthBuffer.fcseq" becomes "<prefix> 000000 DepthBuffer.exr" and so on
+	const std::string stem = input.stem().u8string();
+	const size_t split = stem.rfind(' ');
+	const std::string prefix = split != std::string::npos ? stem.substr(0, split + 1) : std::string();
+	const std::string kind = split != std::string::npos ? stem.substr(split + 1) : stem;
+
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+
+	const int width = static_cast<int>(reader.width()), height = static_cast<int>(reader.height());
+	std::vector<float> planes(static_cast<size_t>(width) * height * sequence_planes);
+	capture_arena arena;
+	exr_codec_model model;
+
+	uint64_t frames = 0, keyframes = 0, repeats = 0, exr_bytes = 0;
+	sequence_frame_header frame;
+	while (reader.next(frame, planes.data()))
+	{
+		char index[16];
+		std::snprintf(index, sizeof(index), "%.6u ", frame.frame_index);
+		const std::filesystem::path path = directory / std::filesystem::u8path(prefix + index + kind + ".exr");
+
+		capture_trace trace;
+		if (!write_exr_planes(reinterpret_cast<const unsigned char *>(planes.data()), false, width, height, path, settings, arena, model, trace))
+		{
+			std::fprintf(stderr, "Failed to write %s\n", path.u8string().c_str());
+			return 1;
+		}
+		frames++;
+		keyframes += frame.keyframe;
+		repeats += frame.compressed_size == 0;
+		exr_bytes += trace.file_bytes;
+	}
+
+	const uint64_t container_bytes = std::filesystem::file_size(input, ec);
+	std::printf("%llu frames (%llu keyframes, %llu unchanged) of %dx%d, container %.1f MB, EXRs %.1f MB with %s\n", static_cast<unsigned long long>(frames),
+		static_cast<unsigned long long>(keyframes), static_cast<unsigned long long>(repeats), width, height, container_bytes / (1024.0 * 1024.0), exr_bytes / (1024.0 * 1024.0),
+		exr_compression_names[static_cast<int>(settings.compression)]);
+	return frames != 0 ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/*
+ * Cost of the content hash that detects unchanged sequence frames, measured in extract_planes of the add-on, the planar conversion it runs in.
+ * The conversion sums the texels of every row as it loads them, the full hash only mixes the sums of every row.
+ *
+ * Build: g++ -O2 -std=c++17 -I.. hash_bench.cpp -o hash_bench
+ * Usage: hash_bench [width height [half]]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "half_float.h"
+#include "plane_extract.h"
+
+template <typename F>
+static double time_ms(F &&f, int repeat = 9)
+{
+	double best = 1e30;
+	for (int i = 0; i < repeat; ++i)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	const int width = argc > 1 ? std::atoi(argv[1]) : 1920;
+	const int height = argc > 2 ? std::atoi(argv[2]) : 1080;
+	const bool half = argc > 3 && std::strcmp(argv[3], "half") == 0;
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+
+	std::vector<float> texture(num_pixels * 4), plane_data(num_pixels * 3);
+	std::vector<uint16_t> half_plane_data(num_pixels * 3);
+	for (size_t i = 0; i < num_pixels; ++i)
+	{
+		texture[i * 4 + 0] = std::sin(i * 0.001f);
+		texture[i * 4 + 1] = std::cos(i * 0.002f);
+		texture[i * 4 + 2] = 0.5f;
+		texture[i * 4 + 3] = 0.05f + (i % width) * 1e-4f;
+	}
+
+	// The store of capture_image, which picks float or half planes for every texel
+	float *const planes = plane_data.data();
+	uint16_t *const half_planes = half_plane_data.data();
+	const auto store = [planes, half_planes, num_pixels, half](size_t i, float b, float g, float r) {
+		if (half)
+		{
+			half_planes[i] = float_to_half(b);
+			half_planes[num_pixels + i] = float_to_half(g);
+			half_planes[num_pixels * 2 + i] = float_to_half(r);
+		}
+		else
+		{
+			planes[i] = b;
+			planes[num_pixels + i] = g;
+			planes[num_pixels * 2 + i] = r;
+		}
+	};
+	const auto convert = [&](bool depth, content_hash *hash) {
+		extract_planes(texture.data(), width * 4 * sizeof(float), 4, width, height, depth, store, hash);
+	};
+
+	const double mb = num_pixels * 16 / (1024.0 * 1024.0);
+	std::printf("%dx%d RGBA32F into %s planes, %.1f MB per frame\n\n", width, height, half ? "half" : "float", mb);
+
+	const auto hash_texture = [&](bool depth) {
+		content_hash hash;
+		content_row_sum row_sum(depth ? 0x8 : 0x7);
+		for (size_t y = 0; y < static_cast<size_t>(height); ++y)
+		{
+			for (size_t x = 0; x < static_cast<size_t>(width); ++x)
+				row_sum.add(texture.data() + (y * width + x) * 4);
+			row_sum.fold(hash);
+		}
+		return hash.digest();
+	};
+
+	uint64_t digest = 0;
+	const double hash_only = time_ms([&]() { digest = hash_texture(false); });
+	std::printf("hash alone            %7.2f ms  %6.0f MB/s\n", hash_only, mb / hash_only * 1000.0);
+
+	bool within_budget = true;
+	for (const bool depth : { true, false })
+	{
+		// Alternated, so every pair sees the same state of the machine. The budget takes the median of the pairs, one slow moment does not decide it
+		double plain = 1e30, hashed = 1e30;
+		std::vector<double> overheads;
+		for (int i = 0; i < 31; ++i)
+		{
+			const double plain_ms = time_ms([&]() { convert(depth, nullptr); }, 3);
+			const double hashed_ms = time_ms([&]() { content_hash hash; convert(depth, &hash); digest ^= hash.digest(); }, 3);
+			plain = std::min(plain, plain_ms);
+			hashed = std::min(hashed, hashed_ms);
+			overheads.push_back((hashed_ms - plain_ms) / plain_ms * 100.0);
+		}
+		std::nth_element(overheads.begin(), overheads.begin() + overheads.size() / 2, overheads.end());
+		const double overhead = overheads[overheads.size() / 2];
+		within_budget &= overhead < 5.0;
+		std::printf("%-6s convert       %7.2f ms, with hash %7.2f ms, %+5.1f%%\n", depth ? "depth" : "normal", plain, hashed, overhead);
+	}
+
+	// The conversion gives the same hash as summing the texture on its own
+	content_hash fused;
+	convert(true, &fused);
+	const uint64_t depth_hash = hash_texture(true), normal_hash = hash_texture(false);
+	if (fused.digest() != depth_hash)
+	{
+		std::printf("hashing in the conversion and on its own differ\n");
+		return 1;
+	}
+
+	// Depth only exports alpha, a changed normal keeps the depth hash but not the normal one
+	const size_t texel = num_pixels / 2 + width / 3;
+	texture[texel * 4] = std::nextafter(texture[texel * 4], 2.0f);
+	if (hash_texture(true) != depth_hash || hash_texture(false) == normal_hash)
+	{
+		std::printf("a changed normal did not change only the normal hash\n");
+		return 1;
+	}
+
+	// One changed depth value and two swapped texels of a row both have to change the hash
+	texture[texel * 4 + 3] = std::nextafter(texture[texel * 4 + 3], 1.0f);
+	const uint64_t changed_hash = hash_texture(true);
+	std::swap(texture[texel * 4 + 3], texture[(texel + 1) * 4 + 3]);
+	if (changed_hash == depth_hash || hash_texture(true) == changed_hash)
+	{
+		std::printf("a changed or moved value kept the same hash\n");
+		return 1;
+	}
+
+	std::printf("\n%s (digest %016llx)\n", within_budget ? "hash costs less than 5% of the conversion" : "hash costs MORE than 5% of the conversion",
+		static_cast<unsigned long long>(digest));
+	return within_budget ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+/*
+ * Runs the capture core against the in-memory runtime of mock_runtime.h, without a GPU or ReShade: one single capture and one burst
+ * of a synthetic export texture and back buffer, written like the add-on would. Prints what the device was asked for and the files written.
+ *
+ * Build: cmake -S .. -B build && cmake --build build --target mock_capture (or link capture_core.cpp like CMakeLists.txt does)
+ * Usage: mock_capture [width height [frames [output_directory [d3d11|d3d12]]]]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "mock_runtime.h"
+
+using namespace reshade::api;
+
+// Depth in red, normals in green to alpha, moving with the frame so sequences do not come out unchanged
+static void fill_frame(mock::mock_runtime &runtime, uint32_t frame)
+{
+	mock::mock_resource &exp = runtime.export_texture();
+	const uint32_t width = exp.desc.texture.width, height = exp.desc.texture.height;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		float *const row = reinterpret_cast<float *>(exp.data.data() + static_cast<size_t>(y) * exp.row_pitch);
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			row[x * 4] = static_cast<float>((x + frame) % width) / width;
+			row[x * 4 + 1] = static_cast<float>(y) / height;
+			row[x * 4 + 2] = 0.5f;
+			row[x * 4 + 3] = 1.0f;
+		}
+	}
+
+	mock::mock_resource &bb = runtime.back_buffer();
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		uint8_t *const row = bb.data.data() + static_cast<size_t>(y) * bb.row_pitch;
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			row[x * 4] = static_cast<uint8_t>(x + frame);
+			row[x * 4 + 1] = static_cast<uint8_t>(y);
+			row[x * 4 + 2] = static_cast<uint8_t>(frame * 8);
+			row[x * 4 + 3] = 255;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const uint32_t width = argc > 2 ? std::atoi(argv[1]) : 640;
+	const uint32_t height = argc > 2 ? std::atoi(argv[2]) : 360;
+	const uint32_t frames = argc > 3 ? std::atoi(argv[3]) : 8;
+	saveDirectory = argc > 4 ? argv[4] : "mock_capture_out";
+	const device_api api = argc > 5 && std::strcmp(argv[5], "d3d11") == 0 ? device_api::d3d11 : device_api::d3d12;
+
+	std::error_code ec;
+	std::filesystem::create_directories(saveDirectory, ec);
+
+	enableCapturing = true;
+	enableDepthExp = true;
+	enableNormalExp = true;
+
+	mock::mock_runtime runtime(api, width, height);
+	stored_buffers_inst &sbi = runtime.create_private_data<stored_buffers_inst>();
+	init_capture(&runtime);
+	sbi.update(runtime.export_resource(), runtime.device_.get_resource_desc(runtime.export_resource()), runtime.export_view());
+
+	const auto start = std::chrono::steady_clock::now();
+	const uint32_t presents = frames + static_cast<uint32_t>(readback_latency) + 4;
+	for (uint32_t frame = 0; frame < presents; ++frame)
+	{
+		fill_frame(runtime, frame);
+		// A single capture on the first frame, the burst starts two frames later
+		if (frame == 0 || frame == 2)
+			runtime.press_key(0x79);
+		if (frame == 1)
+		{
+			captureMode = static_cast<int>(capture_mode::burst);
+			burstLength = frames;
+		}
+		present_capture(&runtime, sbi);
+		runtime.end_frame();
+	}
+	destroy_capture(&runtime, sbi);
+	runtime.destroy_private_data<stored_buffers_inst>();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const mock::mock_stats &stats = runtime.device_.stats;
+	std::printf("%ux%u %s, %u presents in %.1f ms\n", width, height, api == device_api::d3d12 ? "D3D12" : "D3D11", presents, seconds * 1000.0);
+	std::printf("resources %llu, copies %llu (%.1f MB), barriers %llu, maps %llu, flushes %llu\n",
+		static_cast<unsigned long long>(stats.resources_created), static_cast<unsigned long long>(stats.copies), stats.copied_bytes / 1048576.0,
+		static_cast<unsigned long long>(stats.barriers), static_cast<unsigned long long>(stats.maps), static_cast<unsigned long long>(stats.flushes));
+
+	size_t files = 0;
+	uintmax_t bytes = 0;
+	for (const auto &entry : std::filesystem::directory_iterator(saveDirectory, ec))
+	{
+		if (!entry.is_regular_file())
+			continue;
+		files++;
+		bytes += entry.file_size();
+	}
+	std::printf("%zu files, %.1f MB in %s\n", files, bytes / 1048576.0, saveDirectory.string().c_str());
+
+	// A single capture encoded on the present thread, which must not start a capture thread and has to be done after a few presents
+	const std::filesystem::path present_directory = saveDirectory / "present";
+	std::filesystem::create_directories(present_directory, ec);
+	saveDirectory = present_directory;
+	captureMode = static_cast<int>(capture_mode::single);
+	presentEncoding = true;
+	mock::mock_runtime present_runtime(api, width, height);
+	stored_buffers_inst &present_sbi = present_runtime.create_private_data<stored_buffers_inst>();
+	init_capture(&present_runtime);
+	present_sbi.update(present_runtime.export_resource(), present_runtime.device_.get_resource_desc(present_runtime.export_resource()), present_runtime.export_view());
+	size_t max_workers = 0;
+	bool pending = true;
+	uint32_t present_frames = 0;
+	for (; present_frames < 10000 && (present_frames < 2 || pending); ++present_frames)
+	{
+		fill_frame(present_runtime, present_frames);
+		if (present_frames == 0)
+			present_runtime.press_key(0x79);
+		present_capture(&present_runtime, present_sbi);
+		present_runtime.end_frame();
+		const capture_queue::stats stats = captureQueue.get_stats();
+		max_workers = std::max(max_workers, stats.workers);
+		pending = stats.slicing || stats.queued_jobs != 0;
+	}
+	destroy_capture(&present_runtime, present_sbi);
+	present_runtime.destroy_private_data<stored_buffers_inst>();
+	presentEncoding = false;
+
+	size_t present_files = 0;
+	for (const auto &entry : std::filesystem::directory_iterator(present_directory, ec))
+		present_files += entry.is_regular_file() ? 1 : 0;
+	std::printf("encoded on present: %zu files in %u presents, %zu capture threads\n", present_files, present_frames, max_workers);
+	if (max_workers != 0 || present_files == 0)
+	{
+		std::fprintf(stderr, "encoding on the present thread started a capture thread or wrote nothing\n");
+		return 1;
+	}
+	return files != 0 ? 0 : 1;
+}
@@ -0,0 +1,478 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "capture_core.h"
+
+// In-memory stand-ins for the ReShade device, command queue and effect runtime, enough to drive the capture core without a GPU or ReShade.
+// Resources live in host memory and copies happen as they are recorded, with the latency of a GPU simulated on request. The runtime has one RGBA8 back buffer and exposes the export texture
+// as DepthToAddon_ExportTex, like the DepthToAddon effect does. Everything the core does not use does nothing.
+
+namespace mock
+{
+	using namespace reshade::api;
+
+	struct mock_resource
+	{
+		resource_desc desc;
+		std::vector<uint8_t> data;
+		uint32_t row_pitch = 0; // Of textures, rows are tightly packed
+		std::chrono::steady_clock::time_point ready; // When the last copy into it would have finished
+	};
+
+	// Counts what the core asked the device for, so tools can report it
+	struct mock_stats
+	{
+		uint64_t resources_created = 0;
+		uint64_t copies = 0;
+		uint64_t copied_bytes = 0;
+		uint64_t barriers = 0;
+		uint64_t flushes = 0;
+		uint64_t waits = 0;
+		uint64_t maps = 0;
+	};
+
+	// Private data of every object, by the address __uuidof gives its type
+	template <typename Base>
+	class with_private_data : public Base
+	{
+	public:
+		uint64_t get_native() const override { return 0; }
+		void get_private_data(const uint8_t guid[16], uint64_t *data) const override
+		{
+			const auto it = _private_data.find(guid);
+			*data = it != _private_data.end() ? it->second : 0;
+		}
+		void set_private_data(const uint8_t guid[16], const uint64_t data) override
+		{
+			_private_data[guid] = data;
+		}
+
+	private:
+		std::map<const uint8_t *, uint64_t> _private_data;
+	};
+
+	class mock_device final : public with_private_data<device>
+	{
+	public:
+		explicit mock_device(device_api api) : _api(api) {}
+
+		mock_resource *get(resource handle) const
+		{
+			const auto it = _resources.find(handle.handle);
+			return it != _resources.end() ? it->second.get() : nullptr;
+		}
+		// Row pitch of a texture copied into a buffer, D3D12 aligns rows to 256 bytes like the readback expects
+		uint32_t buffer_row_pitch(const resource_desc &desc) const
+		{
+			const uint32_t row_size = format_row_pitch(desc.texture.format, desc.texture.width);
+			return _api == device_api::d3d12 ? (row_size + 255) & ~255u : row_size;
+		}
+		mock_stats stats;
+		// Without it resources only keep their description, for replaying traces with thousands of game resources
+		bool host_memory = true;
+		// Simulated GPU: copies finish after their size at this rate, one after the other, and maps wait for them and then take the overhead on top
+		double copy_bytes_per_second = 0.0;
+		std::chrono::microseconds map_overhead { 0 };
+		std::chrono::steady_clock::time_point gpu_done;
+
+		void finish_copy(mock_resource &dest, uint64_t size)
+		{
+			stats.copies++;
+			stats.copied_bytes += size;
+			if (copy_bytes_per_second <= 0.0)
+				return;
+			const auto now = std::chrono::steady_clock::now();
+			gpu_done = std::max(gpu_done, now) + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(size / copy_bytes_per_second));
+			dest.ready = gpu_done;
+		}
+		void wait_for(const mock_resource &res) const
+		{
+			if (res.ready > std::chrono::steady_clock::now())
+				std::this_thread::sleep_until(res.ready);
+			if (map_overhead.count() != 0)
+				std::this_thread::sleep_for(map_overhead);
+		}
+
+		device_api get_api() const override { return _api; }
+		bool check_capability(device_caps capability) const override
+		{
+			// D3D10 and D3D11 copy into staging textures, the others into buffers
+			if (capability == device_caps::copy_buffer_to_texture)
+				return _api != device_api::d3d9 && _api != device_api::d3d10 && _api != device_api::d3d11;
+			return true;
+		}
+		bool check_format_support(format, resource_usage) const override { return true; }
+
+		bool create_resource(const resource_desc &desc, const subresource_data *initial_data, resource_usage, resource *out_handle, void ** = nullptr) override
+		{
+			std::unique_ptr<mock_resource> res(new mock_resource());
+			res->desc = desc;
+			if (desc.type == resource_type::buffer)
+			{
+				if (host_memory)
+					res->data.resize(static_cast<size_t>(desc.buffer.size));
+			}
+			else
+			{
+				res->row_pitch = format_row_pitch(desc.texture.format, desc.texture.width);
+				if (host_memory)
+					res->data.resize(static_cast<size_t>(res->row_pitch) * desc.texture.height);
+				if (initial_data != nullptr && host_memory)
+					for (uint32_t y = 0; y < desc.texture.height; ++y)
+						std::memcpy(res->data.data() + static_cast<size_t>(y) * res->row_pitch, static_cast<const uint8_t *>(initial_data->data) + static_cast<size_t>(y) * initial_data->row_pitch, res->row_pitch);
+			}
+			out_handle->handle = _next_handle++;
+			_resources[out_handle->handle] = std::move(res);
+			stats.resources_created++;
+			return true;
+		}
+		void destroy_resource(resource handle) override { _resources.erase(handle.handle); }
+		resource_desc get_resource_desc(resource handle) const override
+		{
+			const mock_resource *const res = get(handle);
+			return res != nullptr ? res->desc : resource_desc();
+		}
+
+		bool create_resource_view(resource resource, resource_usage, const resource_view_desc &, resource_view *out_handle) override
+		{
+			out_handle->handle = _next_handle++;
+			_views[out_handle->handle] = resource;
+			return true;
+		}
+		void destroy_resource_view(resource_view handle) override { _views.erase(handle.handle); }
+		resource get_resource_from_view(resource_view view) const override
+		{
+			const auto it = _views.find(view.handle);
+			return it != _views.end() ? it->second : resource { 0 };
+		}
+		resource_view_desc get_resource_view_desc(resource_view) const override { return resource_view_desc(); }
+
+		bool map_buffer_region(resource handle, uint64_t offset, uint64_t, map_access, void **out_data) override
+		{
+			mock_resource *const res = get(handle);
+			*out_data = res != nullptr ? res->data.data() + offset : nullptr;
+			if (res != nullptr)
+				wait_for(*res);
+			stats.maps++;
+			return res != nullptr;
+		}
+		void unmap_buffer_region(resource) override {}
+		bool map_texture_region(resource handle, uint32_t, const subresource_box *, map_access, subresource_data *out_data) override
+		{
+			mock_resource *const res = get(handle);
+			if (res == nullptr)
+				return false;
+			wait_for(*res);
+			out_data->data = res->data.data();
+			out_data->row_pitch = res->row_pitch;
+			out_data->slice_pitch = static_cast<uint32_t>(res->data.size());
+			stats.maps++;
+			return true;
+		}
+		void unmap_texture_region(resource, uint32_t) override {}
+		void update_buffer_region(const void *data, resource handle, uint64_t offset, uint64_t size) override
+		{
+			if (mock_resource *const res = get(handle))
+				std::memcpy(res->data.data() + offset, data, static_cast<size_t>(size));
+		}
+		void update_texture_region(const subresource_data &data, resource handle, uint32_t, const subresource_box * = nullptr) override
+		{
+			if (mock_resource *const res = get(handle))
+				for (uint32_t y = 0; y < res->desc.texture.height; ++y)
+					std::memcpy(res->data.data() + static_cast<size_t>(y) * res->row_pitch, static_cast<const uint8_t *>(data.data) + static_cast<size_t>(y) * data.row_pitch, res->row_pitch);
+		}
+
+		bool create_sampler(const sampler_desc &, sampler *) override { return false; }
+		void destroy_sampler(sampler) override {}
+		bool create_pipeline(pipeline_layout, uint32_t, const pipeline_subobject *, pipeline *) override { return false; }
+		void destroy_pipeline(pipeline) override {}
+		bool create_pipeline_layout(uint32_t, const pipeline_layout_param *, pipeline_layout *) override { return false; }
+		void destroy_pipeline_layout(pipeline_layout) override {}
+		bool allocate_descriptor_sets(uint32_t, pipeline_layout, uint32_t, descriptor_set *) override { return false; }
+		void free_descriptor_sets(uint32_t, const descriptor_set *) override {}
+		void get_descriptor_pool_offset(descriptor_set, uint32_t, uint32_t, descriptor_pool *, uint32_t *) const override {}
+		void copy_descriptor_sets(uint32_t, const descriptor_set_copy *) override {}
+		void update_descriptor_sets(uint32_t, const descriptor_set_update *) override {}
+		bool create_query_pool(query_type, uint32_t, query_pool *) override { return false; }
+		void destroy_query_pool(query_pool) override {}
+		bool get_query_pool_results(query_pool, uint32_t, uint32_t, void *, uint32_t) override { return false; }
+		void set_resource_name(resource, const char *) override {}
+		void set_resource_view_name(resource_view, const char *) override {}
+
+	private:
+		device_api _api;
+		uint64_t _next_handle = 1;
+		std::map<uint64_t, std::unique_ptr<mock_resource>> _resources;
+		std::map<uint64_t, resource> _views;
+	};
+
+	class mock_command_list final : public with_private_data<command_list>
+	{
+	public:
+		explicit mock_command_list(mock_device *device) : _device(device) {}
+
+		device *get_device() override { return _device; }
+
+		void barrier(uint32_t count, const resource *, const resource_usage *, const resource_usage *) override { _device->stats.barriers += count; }
+
+		// Copies the rows of a box of the source to the start of the destination, rows `dst_pitch` apart
+		void copy_box(const mock_resource &src, const subresource_box &box, mock_resource &dst, size_t dest_offset, size_t dst_pitch)
+		{
+			const size_t pixel_size = src.row_pitch / std::max(src.desc.texture.width, 1u);
+			const size_t row_size = static_cast<size_t>(box.right - box.left) * pixel_size;
+			for (int32_t y = box.top; y < box.bottom; ++y)
+			{
+				const size_t offset = dest_offset + static_cast<size_t>(y - box.top) * dst_pitch;
+				if (offset + row_size > dst.data.size())
+					break;
+				std::memcpy(dst.data.data() + offset, src.data.data() + static_cast<size_t>(y) * src.row_pitch + box.left * pixel_size, row_size);
+			}
+			_device->finish_copy(dst, row_size * (box.bottom - box.top));
+		}
+		void copy_resource(resource source, resource dest) override
+		{
+			const mock_resource *const src = _device->get(source);
+			mock_resource *const dst = _device->get(dest);
+			if (src == nullptr || dst == nullptr)
+				return;
+			std::memcpy(dst->data.data(), src->data.data(), std::min(src->data.size(), dst->data.size()));
+			_device->finish_copy(*dst, src->data.size());
+		}
+		void copy_texture_region(resource source, uint32_t, const subresource_box *source_box, resource dest, uint32_t, const subresource_box *, filter_mode = filter_mode::min_mag_mip_point) override
+		{
+			if (source_box == nullptr)
+				return copy_resource(source, dest);
+			const mock_resource *const src = _device->get(source);
+			mock_resource *const dst = _device->get(dest);
+			if (src == nullptr || dst == nullptr)
+				return;
+			copy_box(*src, *source_box, *dst, 0, dst->row_pitch);
+		}
+		void copy_texture_to_buffer(resource source, uint32_t, const subresource_box *source_box, resource dest, uint64_t dest_offset, uint32_t = 0, uint32_t = 0) override
+		{
+			const mock_resource *const src = _device->get(source);
+			mock_resource *const dst = _device->get(dest);
+			if (src == nullptr || dst == nullptr)
+				return;
+			const subresource_box full = { 0, 0, 0, static_cast<int32_t>(src->desc.texture.width), static_cast<int32_t>(src->desc.texture.height), 1 };
+			const subresource_box &box = source_box != nullptr ? *source_box : full;
+			resource_desc region = src->desc;
+			region.texture.width = box.right - box.left;
+			copy_box(*src, box, *dst, static_cast<size_t>(dest_offset), _device->buffer_row_pitch(region));
+		}
+		void copy_buffer_region(resource source, uint64_t source_offset, resource dest, uint64_t dest_offset, uint64_t size) override
+		{
+			const mock_resource *const src = _device->get(source);
+			mock_resource *const dst = _device->get(dest);
+			if (src == nullptr || dst == nullptr)
+				return;
+			std::memcpy(dst->data.data() + dest_offset, src->data.data() + source_offset, static_cast<size_t>(size));
+			_device->finish_copy(*dst, size);
+		}
+
+		void begin_render_pass(uint32_t, const render_pass_render_target_desc *, const render_pass_depth_stencil_desc * = nullptr) override {}
+		void end_render_pass() override {}
+		void bind_render_targets_and_depth_stencil(uint32_t, const resource_view *, resource_view = { 0 }) override {}
+		void bind_pipeline(pipeline_stage, pipeline) override {}
+		void bind_pipeline_states(uint32_t, const dynamic_state *, const uint32_t *) override {}
+		void bind_viewports(uint32_t, uint32_t, const viewport *) override {}
+		void bind_scissor_rects(uint32_t, uint32_t, const rect *) override {}
+		void push_constants(shader_stage, pipeline_layout, uint32_t, uint32_t, uint32_t, const void *) override {}
+		void push_descriptors(shader_stage, pipeline_layout, uint32_t, const descriptor_set_update &) override {}
+		void bind_descriptor_sets(shader_stage, pipeline_layout, uint32_t, uint32_t, const descriptor_set *) override {}
+		void bind_index_buffer(resource, uint64_t, uint32_t) override {}
+		void bind_vertex_buffers(uint32_t, uint32_t, const resource *, const uint64_t *, const uint32_t *) override {}
+		void bind_stream_output_buffers(uint32_t, uint32_t, const resource *, const uint64_t *, const uint64_t *) override {}
+		void draw(uint32_t, uint32_t, uint32_t, uint32_t) override {}
+		void draw_indexed(uint32_t, uint32_t, uint32_t, int32_t, uint32_t) override {}
+		void dispatch(uint32_t, uint32_t, uint32_t) override {}
+		void draw_or_dispatch_indirect(indirect_command, resource, uint64_t, uint32_t, uint32_t) override {}
+		void copy_buffer_to_texture(resource, uint64_t, uint32_t, uint32_t, resource, uint32_t, const subresource_box * = nullptr) override {}
+		void resolve_texture_region(resource, uint32_t, const subresource_box *, resource, uint32_t, int32_t, int32_t, int32_t, format) override {}
+		void clear_depth_stencil_view(resource_view, const float *, const uint8_t *, uint32_t = 0, const rect * = nullptr) override {}
+		void clear_render_target_view(resource_view, const float[4], uint32_t = 0, const rect * = nullptr) override {}
+		void clear_unordered_access_view_uint(resource_view, const uint32_t[4], uint32_t = 0, const rect * = nullptr) override {}
+		void clear_unordered_access_view_float(resource_view, const float[4], uint32_t = 0, const rect * = nullptr) override {}
+		void generate_mipmaps(resource_view) override {}
+		void begin_query(query_pool, query_type, uint32_t) override {}
+		void end_query(query_pool, query_type, uint32_t) override {}
+		void copy_query_pool_results(query_pool, query_type, uint32_t, uint32_t, resource, uint64_t, uint32_t) override {}
+		void begin_debug_event(const char *, const float[4] = nullptr) override {}
+		void end_debug_event() override {}
+		void insert_debug_marker(const char *, const float[4] = nullptr) override {}
+
+	private:
+		mock_device *_device;
+	};
+
+	class mock_command_queue final : public with_private_data<command_queue>
+	{
+	public:
+		explicit mock_command_queue(mock_device *device) : _device(device), _immediate(device) {}
+
+		device *get_device() override { return _device; }
+		command_queue_type get_type() const override { return command_queue_type::graphics | command_queue_type::copy; }
+		void wait_idle() const override
+		{
+			_device->stats.waits++;
+			if (_device->gpu_done > std::chrono::steady_clock::now())
+				std::this_thread::sleep_until(_device->gpu_done);
+		}
+		void flush_immediate_command_list() const override { _device->stats.flushes++; }
+		command_list *get_immediate_command_list() override { return &_immediate; }
+		void begin_debug_event(const char *, const float[4] = nullptr) override {}
+		void end_debug_event() override {}
+		void insert_debug_marker(const char *, const float[4] = nullptr) override {}
+
+	private:
+		mock_device *_device;
+		mock_command_list _immediate;
+	};
+
+	class mock_runtime final : public with_private_data<effect_runtime>
+	{
+	public:
+		// A back buffer of `width` x `height` in `back_buffer_format` and an RGBA32F export texture of the same size
+		mock_runtime(device_api api, uint32_t width, uint32_t height, format back_buffer_format = format::r8g8b8a8_unorm) :
+			device_(api), _queue(&device_)
+		{
+			device_.create_resource(resource_desc(width, height, 1, 1, back_buffer_format, 1, memory_heap::gpu_only, resource_usage::render_target | resource_usage::copy_source), nullptr, resource_usage::present, &_back_buffer);
+			device_.create_resource(resource_desc(width, height, 1, 1, format::r32g32b32a32_float, 1, memory_heap::gpu_only, resource_usage::shader_resource | resource_usage::copy_source), nullptr, resource_usage::shader_resource, &_export_texture);
+			device_.create_resource_view(_export_texture, resource_usage::shader_resource, resource_view_desc(format::r32g32b32a32_float), &_export_view);
+		}
+
+		mock_device device_;
+
+		mock_resource &back_buffer() { return *device_.get(_back_buffer); }
+		mock_resource &export_texture() { return *device_.get(_export_texture); }
+		resource export_resource() const { return _export_texture; }
+		resource_view export_view() const { return _export_view; }
+
+		// Keys count as pressed for the next frame only
+		void press_key(uint32_t keycode) { _pressed.push_back(keycode); }
+		void end_frame() { _pressed.clear(); }
+
+		device *get_device() override { return &device_; }
+		command_queue *get_command_queue() override { return &_queue; }
+
+		void *get_hwnd() const override { return nullptr; }
+		resource get_back_buffer(uint32_t) override { return _back_buffer; }
+		uint32_t get_back_buffer_count() const override { return 1; }
+		uint32_t get_current_back_buffer_index() const override { return 0; }
+
+		bool capture_screenshot(uint8_t *pixels) override
+		{
+			// RGBA8 like ReShade hands it out, BGRA back buffers are swizzled. ReShade copies and waits for the copy on its own, which the simulated GPU does too.
+			mock_resource &res = back_buffer();
+			const bool bgra = res.desc.texture.format == format::b8g8r8a8_unorm || res.desc.texture.format == format::b8g8r8a8_unorm_srgb;
+			if (format_row_pitch(res.desc.texture.format, 1) != 4)
+				return false;
+			device_.finish_copy(res, res.data.size());
+			device_.wait_for(res);
+			std::memcpy(pixels, res.data.data(), res.data.size());
+			if (bgra)
+				for (size_t i = 0; i < res.data.size(); i += 4)
+					std::swap(pixels[i], pixels[i + 2]);
+			return true;
+		}
+		void get_screenshot_width_and_height(uint32_t *out_width, uint32_t *out_height) const override
+		{
+			const resource_desc desc = device_.get_resource_desc(_back_buffer);
+			*out_width = desc.texture.width;
+			*out_height = desc.texture.height;
+		}
+
+		bool is_key_down(uint32_t keycode) const override { return is_key_pressed(keycode); }
+		bool is_key_pressed(uint32_t keycode) const override { return std::find(_pressed.begin(), _pressed.end(), keycode) != _pressed.end(); }
+		bool is_key_released(uint32_t) const override { return false; }
+		bool is_mouse_button_down(uint32_t) const override { return false; }
+		bool is_mouse_button_pressed(uint32_t) const override { return false; }
+		bool is_mouse_button_released(uint32_t) const override { return false; }
+		void get_mouse_cursor_position(uint32_t *out_x, uint32_t *out_y, int16_t *out_wheel_delta = nullptr) const override
+		{
+			*out_x = *out_y = 0;
+			if (out_wheel_delta != nullptr)
+				*out_wheel_delta = 0;
+		}
+
+		// The export texture is the only texture variable
+		void enumerate_texture_variables(const char *, void(*callback)(effect_runtime *runtime, effect_texture_variable variable, void *user_data), void *user_data) override
+		{
+			callback(this, effect_texture_variable { 1 }, user_data);
+		}
+		effect_texture_variable find_texture_variable(const char *, const char *variable_name) const override
+		{
+			return effect_texture_variable { std::strcmp(variable_name, export_variable_name) == 0 ? 1u : 0u };
+		}
+		void get_texture_variable_name(effect_texture_variable variable, char *name, size_t *length) const override
+		{
+			const char *const value = variable.handle == 1 ? export_variable_name : "";
+			if (name != nullptr && *length != 0)
+			{
+				std::strncpy(name, value, *length - 1);
+				name[*length - 1] = '\0';
+			}
+			*length = std::strlen(value);
+		}
+		void get_texture_binding(effect_texture_variable variable, resource_view *out_srv, resource_view *out_srv_srgb = nullptr) const override
+		{
+			*out_srv = variable.handle == 1 ? _export_view : resource_view { 0 };
+			if (out_srv_srgb != nullptr)
+				*out_srv_srgb = *out_srv;
+		}
+
+		void render_effects(command_list *, resource_view, resource_view = { 0 }) override {}
+		void enumerate_uniform_variables(const char *, void(*)(effect_runtime *, effect_uniform_variable, void *), void *) override {}
+		effect_uniform_variable find_uniform_variable(const char *, const char *) const override { return { 0 }; }
+		void get_uniform_variable_type(effect_uniform_variable, format *, uint32_t * = nullptr, uint32_t * = nullptr, uint32_t * = nullptr) const override {}
+		void get_uniform_variable_name(effect_uniform_variable, char *, size_t *length) const override { *length = 0; }
+		bool get_annotation_bool_from_uniform_variable(effect_uniform_variable, const char *, bool *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_float_from_uniform_variable(effect_uniform_variable, const char *, float *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_int_from_uniform_variable(effect_uniform_variable, const char *, int32_t *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_uint_from_uniform_variable(effect_uniform_variable, const char *, uint32_t *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_string_from_uniform_variable(effect_uniform_variable, const char *, char *, size_t *) const override { return false; }
+		void get_uniform_value_bool(effect_uniform_variable, bool *, size_t, size_t = 0) const override {}
+		void get_uniform_value_float(effect_uniform_variable, float *, size_t, size_t = 0) const override {}
+		void get_uniform_value_int(effect_uniform_variable, int32_t *, size_t, size_t = 0) const override {}
+		void get_uniform_value_uint(effect_uniform_variable, uint32_t *, size_t, size_t = 0) const override {}
+		void set_uniform_value_bool(effect_uniform_variable, const bool *, size_t, size_t = 0) override {}
+		void set_uniform_value_float(effect_uniform_variable, const float *, size_t, size_t = 0) override {}
+		void set_uniform_value_int(effect_uniform_variable, const int32_t *, size_t, size_t = 0) override {}
+		void set_uniform_value_uint(effect_uniform_variable, const uint32_t *, size_t, size_t = 0) override {}
+		bool get_annotation_bool_from_texture_variable(effect_texture_variable, const char *, bool *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_float_from_texture_variable(effect_texture_variable, const char *, float *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_int_from_texture_variable(effect_texture_variable, const char *, int32_t *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_uint_from_texture_variable(effect_texture_variable, const char *, uint32_t *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_string_from_texture_variable(effect_texture_variable, const char *, char *, size_t *) const override { return false; }
+		void update_texture(effect_texture_variable, const uint32_t, const uint32_t, const uint8_t *) override {}
+		void update_texture_bindings(const char *, resource_view, resource_view = { 0 }) override {}
+		void enumerate_techniques(const char *, void(*)(effect_runtime *, effect_technique, void *), void *) override {}
+		effect_technique find_technique(const char *, const char *) override { return { 0 }; }
+		void get_technique_name(effect_technique, char *, size_t *length) const override { *length = 0; }
+		bool get_annotation_bool_from_technique(effect_technique, const char *, bool *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_float_from_technique(effect_technique, const char *, float *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_int_from_technique(effect_technique, const char *, int32_t *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_uint_from_technique(effect_technique, const char *, uint32_t *, size_t, size_t = 0) const override { return false; }
+		bool get_annotation_string_from_technique(effect_technique, const char *, char *, size_t *) const override { return false; }
+		bool get_technique_state(effect_technique) const override { return false; }
+		void set_technique_state(effect_technique, bool) override {}
+		bool get_preprocessor_definition(const char *, char *, size_t *) const override { return false; }
+		void set_preprocessor_definition(const char *, const char *) override {}
+
+		static constexpr const char *export_variable_name = "DepthToAddon_ExportTex";
+
+	private:
+		mock_command_queue _queue;
+		resource _back_buffer = { 0 };
+		resource _export_texture = { 0 };
+		resource_view _export_view = { 0 };
+		std::vector<uint32_t> _pressed;
+	};
+}
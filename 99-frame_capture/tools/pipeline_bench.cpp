@@ -0,0 +1,211 @@
+/*
+ * End to end benchmark of the capture path: present, readback, conversion, EXR and BMP encoding and writing, driven through the capture core
+ * by the mock runtime of mock_runtime.h with synthetic depth, normal and color frames. Copies and maps take the time a GPU would take for them.
+ * Runs single captures on every frame and a burst sequence at 1080p, 1440p and 4K, writes to a tmpfs directory that is emptied after every run,
+ * and reports captured frames per second, the stall of the present thread and the peak resident memory, as JSON for comparing builds.
+ *
+ * Build: cmake -S .. -B build && cmake --build build --target pipeline_bench
+ * Usage: pipeline_bench [frames [output_directory [results.json [label]]]]
+ * The capture threads take the settings of the add-on from the environment, FC_EncodeThreads, FC_WorkerPriority, FC_WorkerIoPriority,
+ * FC_WorkerAffinityMask (hexadecimal) and FC_WorkerPinLeastLoaded, so their effect can be measured next to a load on the other cores.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "mock_runtime.h"
+
+using namespace reshade::api;
+using clock_type = std::chrono::steady_clock;
+
+// PCIe 3.0 x16 in practice, and what a map of a readback resource costs in the driver
+static constexpr double copy_bytes_per_second = 12e9;
+static constexpr int map_overhead_us = 30;
+
+struct bench_result
+{
+	std::string mode;
+	uint32_t width = 0, height = 0;
+	uint32_t frames = 0;
+	double seconds = 0.0;
+	double stall_p50_ms = 0.0, stall_p99_ms = 0.0, stall_max_ms = 0.0;
+	double peak_rss_mb = 0.0;
+	double written_mb = 0.0;
+	size_t files = 0;
+};
+
+// Peak resident memory since the last reset, only known on Linux
+static void reset_peak_rss()
+{
+	std::ofstream("/proc/self/clear_refs") << "5";
+}
+static double peak_rss_mb()
+{
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line))
+		if (line.compare(0, 6, "VmHWM:") == 0)
+			return std::atof(line.c_str() + 6) / 1024.0;
+	return 0.0;
+}
+
+static void fill_frame(mock::mock_runtime &runtime)
+{
+	mock::mock_resource &exp = runtime.export_texture();
+	const uint32_t width = exp.desc.texture.width, height = exp.desc.texture.height;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		float *const row = reinterpret_cast<float *>(exp.data.data() + static_cast<size_t>(y) * exp.row_pitch);
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			// Smooth normals and a depth falling off towards the horizon, roughly like a game frame compresses
+			row[x * 4] = static_cast<float>(x) / width * 2.0f - 1.0f;
+			row[x * 4 + 1] = static_cast<float>(y) / height * 2.0f - 1.0f;
+			row[x * 4 + 2] = 0.5f;
+			row[x * 4 + 3] = 1.0f / (1.0f + y * 0.01f + ((x * 7 + y * 13) & 15) * 0.0001f);
+		}
+	}
+
+	mock::mock_resource &bb = runtime.back_buffer();
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		uint8_t *const row = bb.data.data() + static_cast<size_t>(y) * bb.row_pitch;
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			row[x * 4] = static_cast<uint8_t>(x);
+			row[x * 4 + 1] = static_cast<uint8_t>(y);
+			row[x * 4 + 2] = static_cast<uint8_t>(x ^ y);
+			row[x * 4 + 3] = 255;
+		}
+	}
+}
+
+static bench_result run(const std::string &mode, uint32_t width, uint32_t height, uint32_t frames)
+{
+	bench_result result;
+	result.mode = mode;
+	result.width = width;
+	result.height = height;
+	result.frames = frames;
+
+	mock::mock_runtime runtime(device_api::d3d12, width, height);
+	runtime.device_.copy_bytes_per_second = copy_bytes_per_second;
+	runtime.device_.map_overhead = std::chrono::microseconds(map_overhead_us);
+	fill_frame(runtime);
+
+	const bool single = mode == "single";
+	captureMode = static_cast<int>(single ? capture_mode::single : capture_mode::burst);
+	burstLength = frames;
+
+	reset_peak_rss();
+	stored_buffers_inst &sbi = runtime.create_private_data<stored_buffers_inst>();
+	init_capture(&runtime);
+	sbi.update(runtime.export_resource(), runtime.device_.get_resource_desc(runtime.export_resource()), runtime.export_view());
+
+	std::vector<double> stalls;
+	const clock_type::time_point start = clock_type::now();
+	// Single captures on every frame, or one press that records the burst, then a few more frames for the last readbacks
+	const uint32_t presents = (single ? frames : frames + 1) + static_cast<uint32_t>(readback_latency) + 1;
+	for (uint32_t frame = 0; frame < presents; ++frame)
+	{
+		if (single ? frame < frames : frame == 0)
+			runtime.press_key(0x79);
+		const clock_type::time_point present_start = clock_type::now();
+		present_capture(&runtime, sbi);
+		stalls.push_back(std::chrono::duration<double, std::milli>(clock_type::now() - present_start).count());
+		runtime.end_frame();
+	}
+	// Everything is written once the capture threads are stopped
+	destroy_capture(&runtime, sbi);
+	runtime.destroy_private_data<stored_buffers_inst>();
+	result.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+	result.peak_rss_mb = peak_rss_mb();
+
+	std::sort(stalls.begin(), stalls.end());
+	result.stall_p50_ms = stalls[stalls.size() / 2];
+	result.stall_p99_ms = stalls[std::min(stalls.size() - 1, stalls.size() * 99 / 100)];
+	result.stall_max_ms = stalls.back();
+
+	std::error_code ec;
+	uintmax_t bytes = 0;
+	for (const auto &entry : std::filesystem::directory_iterator(saveDirectory, ec))
+	{
+		if (!entry.is_regular_file())
+			continue;
+		result.files++;
+		bytes += entry.file_size();
+		std::filesystem::remove(entry.path(), ec);
+	}
+	result.written_mb = bytes / (1024.0 * 1024.0);
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	const uint32_t frames = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 20;
+	std::error_code ec;
+	saveDirectory = argc > 2 ? std::filesystem::path(argv[2]) : std::filesystem::exists("/dev/shm", ec) ? std::filesystem::path("/dev/shm/pipeline_bench") : std::filesystem::temp_directory_path(ec) / "pipeline_bench";
+	const char *const json_path = argc > 3 ? argv[3] : nullptr;
+	const std::string label = argc > 4 ? argv[4] : "";
+	std::filesystem::create_directories(saveDirectory, ec);
+
+	if (const char *const value = std::getenv("FC_EncodeThreads"))
+		encodeThreads = std::max(std::atoi(value), 1);
+	if (const char *const value = std::getenv("FC_WorkerPriority"))
+		workerPriority = std::clamp(std::atoi(value), 0, static_cast<int>(thread_priority::idle));
+	if (const char *const value = std::getenv("FC_WorkerIoPriority"))
+		workerIoPriority = std::clamp(std::atoi(value), 0, static_cast<int>(io_priority::idle));
+	if (const char *const value = std::getenv("FC_WorkerAffinityMask"))
+		workerAffinityMask = std::strtoull(value, nullptr, 16);
+	if (const char *const value = std::getenv("FC_WorkerPinLeastLoaded"))
+		workerPinLeastLoaded = std::atoi(value) != 0;
+	apply_worker_qos();
+
+	enableCapturing = true;
+	enableDepthExp = true;
+	enableNormalExp = true;
+	captureLog = [](int level, const char *message) {
+		if (level <= 2)
+			std::fprintf(stderr, "%s\n", message);
+	};
+
+	const uint32_t resolutions[3][2] = { { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+	std::vector<bench_result> results;
+	std::printf("%-9s %11s %7s %9s %10s %10s %10s %10s %10s\n", "mode", "resolution", "frames", "fps", "p50 ms", "p99 ms", "max ms", "peak MB", "written MB");
+	for (const char *mode : { "single", "sequence" })
+	{
+		for (const auto &resolution : resolutions)
+		{
+			const bench_result r = run(mode, resolution[0], resolution[1], frames);
+			std::printf("%-9s %5ux%-5u %7u %9.2f %10.2f %10.2f %10.2f %10.0f %10.1f\n", r.mode.c_str(), r.width, r.height, r.frames, r.frames / r.seconds,
+				r.stall_p50_ms, r.stall_p99_ms, r.stall_max_ms, r.peak_rss_mb, r.written_mb);
+			std::fflush(stdout);
+			results.push_back(r);
+		}
+	}
+
+	if (json_path != nullptr)
+	{
+		std::ofstream json(json_path, std::ios::trunc);
+		json << "{\n  \"label\": \"" << label << "\",\n  \"encode_threads\": " << encodeThreads << ",\n  \"worker_priority\": " << workerPriority
+			<< ",\n  \"worker_io_priority\": " << workerIoPriority << ",\n  \"worker_affinity_mask\": " << workerAffinityMask << ",\n  \"worker_pin_least_loaded\": " << workerPinLeastLoaded
+			<< ",\n  \"copy_bytes_per_second\": " << copy_bytes_per_second
+			<< ",\n  \"map_overhead_us\": " << map_overhead_us << ",\n  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const bench_result &r = results[i];
+			char line[512];
+			std::snprintf(line, sizeof(line), "    { \"mode\": \"%s\", \"width\": %u, \"height\": %u, \"frames\": %u, \"seconds\": %.4f, \"fps\": %.3f, "
+				"\"stall_p50_ms\": %.3f, \"stall_p99_ms\": %.3f, \"stall_max_ms\": %.3f, \"peak_rss_mb\": %.1f, \"written_mb\": %.2f, \"files\": %zu }%s\n",
+				r.mode.c_str(), r.width, r.height, r.frames, r.seconds, r.frames / r.seconds, r.stall_p50_ms, r.stall_p99_ms, r.stall_max_ms, r.peak_rss_mb, r.written_mb, r.files,
+				i + 1 < results.size() ? "," : "");
+			json << line;
+		}
+		json << "  ]\n}\n";
+	}
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Speed and ratio of the in-memory float codec used by the instant replay ring, compared with memcpy and the tinyexr codecs.
+ *
+ * Build: g++ -O2 -std=c++17 -I.. -I../../deps/tinyexr replay_codec_bench.cpp -o replay_codec_bench
+ * Usage: replay_codec_bench [width height]
+ */
+
+#define TINYEXR_IMPLEMENTATION
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "tinyexr.h"
+#include "miniz.c"
+#include "float_codec.h"
+
+struct frame
+{
+	const char *name;
+	std::vector<float> texels; // RGBA32F like the DepthToAddon export texture: normal in RGB, depth in A
+};
+
+static void make_frame(frame &f, int width, int height, float noise_amount, bool sky, std::mt19937 &rng)
+{
+	std::normal_distribution<float> noise(0.0f, noise_amount);
+	f.texels.resize(static_cast<size_t>(width) * height * 4);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+		{
+			float *const texel = f.texels.data() + (static_cast<size_t>(y) * width + x) * 4;
+			const float u = static_cast<float>(x) / width, v = static_cast<float>(y) / height;
+			float n[3] = { std::sin(u * 12.0f) * 0.3f + noise(rng), std::cos(v * 9.0f) * 0.3f + noise(rng), 1.0f };
+			const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			texel[0] = n[0] / len;
+			texel[1] = n[1] / len;
+			texel[2] = n[2] / len;
+			texel[3] = sky && v < 0.4f ? 1.0f : 0.05f + 0.4f * (1.0f - v) + noise(rng) * 0.1f;
+		}
+}
+
+template <typename F>
+static double time_ms(F &&f, int repeat = 5)
+{
+	double best = 1e30;
+	for (int i = 0; i < repeat; ++i)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+	}
+	return best;
+}
+
+static size_t encode_exr(const frame &f, int width, int height, int compression)
+{
+	// Four channel planes, the same data the ring holds
+	std::vector<float> planes[4];
+	const float *ptrs[4];
+	for (int c = 0; c < 4; ++c)
+	{
+		planes[c].resize(static_cast<size_t>(width) * height);
+		for (size_t i = 0; i < planes[c].size(); ++i)
+			planes[c][i] = f.texels[i * 4 + (3 - c)];
+		ptrs[c] = planes[c].data();
+	}
+
+	EXRHeader header;
+	InitEXRHeader(&header);
+	EXRImage image;
+	InitEXRImage(&image);
+	image.num_channels = 4;
+	image.images = (unsigned char **)ptrs;
+	image.width = width;
+	image.height = height;
+
+	EXRChannelInfo channels[4] = {};
+	const char *names[4] = { "A", "B", "G", "R" };
+	int types[4];
+	for (int c = 0; c < 4; ++c)
+	{
+		std::strcpy(channels[c].name, names[c]);
+		types[c] = TINYEXR_PIXELTYPE_FLOAT;
+	}
+	header.num_channels = 4;
+	header.channels = channels;
+	header.pixel_types = types;
+	header.requested_pixel_types = types;
+	header.compression_type = compression;
+
+	unsigned char *memory = nullptr;
+	const char *err = nullptr;
+	const size_t size = SaveEXRImageToMemory(&image, &header, &memory, &err);
+	free(memory);
+	return size;
+}
+
+int main(int argc, char *argv[])
+{
+	const int width = argc > 1 ? std::atoi(argv[1]) : 1920;
+	const int height = argc > 2 ? std::atoi(argv[2]) : 1080;
+
+	std::mt19937 rng(7);
+	frame frames[3] = { { "smooth + sky" }, { "light noise" }, { "heavy noise" } };
+	make_frame(frames[0], width, height, 0.0f, true, rng);
+	make_frame(frames[1], width, height, 0.002f, true, rng);
+	make_frame(frames[2], width, height, 0.05f, false, rng);
+
+	const size_t num_values = static_cast<size_t>(width) * height * 4;
+	const double raw_mb = num_values * 4 / (1024.0 * 1024.0);
+	std::vector<unsigned char> encoded(float_codec_bound(num_values));
+	std::vector<float> decoded(num_values);
+
+	std::printf("%dx%d RGBA32F, %.1f MB per frame\n\n", width, height, raw_mb);
+	std::printf("%-14s %-10s %9s %9s %9s %10s %10s\n", "content", "codec", "ratio", "enc ms", "dec ms", "enc MB/s", "dec MB/s");
+
+	for (const frame &f : frames)
+	{
+		const double copy_ms = time_ms([&]() { std::memcpy(decoded.data(), f.texels.data(), num_values * 4); });
+		std::printf("%-14s %-10s %9.3f %9.1f %9s %10.0f %10s\n", f.name, "memcpy", 1.0, copy_ms, "", raw_mb / copy_ms * 1000.0, "");
+
+		size_t size = 0;
+		const double enc_ms = time_ms([&]() { size = float_codec_encode(f.texels.data(), static_cast<size_t>(width) * 16, width, height, 4, encoded.data()); });
+		const double dec_ms = time_ms([&]() { float_codec_decode(encoded.data(), width, height, 4, decoded.data()); });
+		if (std::memcmp(decoded.data(), f.texels.data(), num_values * 4) != 0)
+		{
+			std::printf("round trip mismatch for %s\n", f.name);
+			return 1;
+		}
+		std::printf("%-14s %-10s %9.3f %9.1f %9.1f %10.0f %10.0f\n", f.name, "ring", static_cast<double>(size) / (num_values * 4), enc_ms, dec_ms,
+			raw_mb / enc_ms * 1000.0, raw_mb / dec_ms * 1000.0);
+
+		for (const auto &codec : { std::make_pair("RLE", TINYEXR_COMPRESSIONTYPE_RLE), std::make_pair("ZIP", TINYEXR_COMPRESSIONTYPE_ZIP) })
+		{
+			size_t exr_size = 0;
+			const double exr_ms = time_ms([&]() { exr_size = encode_exr(f, width, height, codec.second); }, 1);
+			std::printf("%-14s %-10s %9.3f %9.1f %9s %10.0f %10s\n", f.name, codec.first, static_cast<double>(exr_size) / (num_values * 4), exr_ms, "",
+				raw_mb / exr_ms * 1000.0, "");
+		}
+	}
+
+	return 0;
+}
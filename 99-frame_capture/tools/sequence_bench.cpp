@@ -0,0 +1,161 @@
+/*
+ * Headless check of the sequence recording pipeline: a synthetic frame source presents depth and normal frames at a fixed rate,
+ * they go through the same budget, buffer pool, planar conversion and EXR writer the add-on uses, and the bench reports
+ * whether the capture threads kept up without dropping frames.
+ *
+ * Build: g++ -O2 -std=c++17 -pthread -I.. -I../../deps/tinyexr sequence_bench.cpp -o sequence_bench
+ * Usage: sequence_bench [width height [fps [seconds [interval [threads [compression [budget_mb]]]]]]]
+ *        compression is 0 None, 1 RLE, 2 ZIP, 3 PIZ or 4 Auto
+ */
+
+#define TINYEXR_IMPLEMENTATION
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "tinyexr.h"
+#include "miniz.c"
+#include "capture_queue.h"
+#include "exr_writer.h"
+#include "half_float.h"
+
+// RGBA32F frame like the DepthToAddon export texture: normal in RGB, depth in A. The camera pans slowly.
+static void render_frame(std::vector<float> &texture, int width, int height, int frame)
+{
+	const float pan = frame * 0.002f;
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+		{
+			float *const texel = texture.data() + (static_cast<size_t>(y) * width + x) * 4;
+			const float u = static_cast<float>(x) / width + pan, v = static_cast<float>(y) / height;
+			float n[3] = { std::sin(u * 12.0f) * 0.3f, std::cos(v * 9.0f) * 0.3f, 1.0f };
+			const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			texel[0] = n[0] / len;
+			texel[1] = n[1] / len;
+			texel[2] = n[2] / len;
+			texel[3] = v < 0.4f ? 1.0f : 0.05f + 0.4f * (1.0f - v) + 0.02f * std::sin(u * 40.0f);
+		}
+}
+
+int main(int argc, char *argv[])
+{
+	const int width = argc > 1 ? std::atoi(argv[1]) : 1920;
+	const int height = argc > 2 ? std::atoi(argv[2]) : 1080;
+	const double fps = argc > 3 ? std::atof(argv[3]) : 60.0;
+	const double seconds = argc > 4 ? std::atof(argv[4]) : 5.0;
+	const int interval = argc > 5 ? std::max(std::atoi(argv[5]), 1) : 1;
+	const size_t threads = argc > 6 ? static_cast<size_t>(std::atoi(argv[6])) : 4;
+	const exr_compression compression = static_cast<exr_compression>(argc > 7 ? std::atoi(argv[7]) : static_cast<int>(exr_compression::none));
+	const int budget_mb = argc > 8 ? std::atoi(argv[8]) : 1024;
+
+	const std::filesystem::path directory = std::filesystem::temp_directory_path() / "sequence_bench";
+	std::filesystem::create_directories(directory);
+
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+	const size_t job_size = num_pixels * 3 * sizeof(float);
+
+	capture_queue queue;
+	queue.set_budget(static_cast<uint64_t>(budget_mb) * 1024 * 1024, 0.0f, budget_policy::drop_newest);
+	queue.preallocate(job_size, 2 * (threads + 2));
+	queue.start(threads);
+
+	capture_arena arenas[capture_queue::max_workers];
+	exr_codec_model models[capture_queue::max_workers];
+	exr_write_settings settings;
+	settings.compression = compression;
+
+	std::atomic<uint64_t> written_frames(0), written_bytes(0), failed_frames(0);
+	std::atomic<uint64_t> encode_us(0);
+
+	// Rendered up front and played in a loop, so the source costs no more than a GPU that already has the frame
+	std::vector<float> textures[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		textures[i].resize(num_pixels * 4);
+		render_frame(textures[i], width, height, i * 8);
+	}
+
+	const int num_frames = static_cast<int>(fps * seconds);
+	const auto frame_time = std::chrono::duration<double>(1.0 / fps);
+	uint64_t offered = 0, late_frames = 0;
+	double convert_ms = 0.0;
+
+	std::printf("%dx%d at %.0f fps for %.0f s, every %d frame(s), %zu threads, %s, budget %d MB\n", width, height, fps, seconds, interval, threads,
+		exr_compression_names[static_cast<int>(compression)], budget_mb);
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < num_frames; ++frame)
+	{
+		const auto present = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_time * frame);
+		if (std::chrono::steady_clock::now() > present + frame_time)
+			late_frames++;
+		std::this_thread::sleep_until(present);
+
+		if (frame % interval != 0)
+			continue;
+
+		const std::vector<float> &texture = textures[(frame / interval) % 8];
+
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			offered++;
+			if (queue.admit(job_size, job_size / 2) == admission::dropped)
+				continue;
+
+			const auto t = std::chrono::steady_clock::now();
+			capture_job job;
+			job.size = job_size;
+			queue.allocate(job);
+			float *const planes = reinterpret_cast<float *>(job.data.get());
+			for (size_t i = 0; i < num_pixels; ++i)
+			{
+				const float *const texel = texture.data() + i * 4;
+				planes[i] = pass == 0 ? texel[3] : texel[2];
+				planes[num_pixels + i] = pass == 0 ? texel[3] : texel[1];
+				planes[num_pixels * 2 + i] = pass == 0 ? texel[3] : texel[0];
+			}
+			convert_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+
+			char name[64];
+			std::snprintf(name, sizeof(name), "%.6d %s.exr", frame / interval, pass == 0 ? "DepthBuffer" : "NormalMap");
+			job.write = [&, path = directory / name](capture_job &job, size_t worker) {
+				capture_trace trace;
+				if (write_exr_planes(job.data.get(), job.half, width, height, path, settings, arenas[worker], models[worker], trace))
+				{
+					written_frames++;
+					written_bytes += trace.file_bytes;
+					encode_us += static_cast<uint64_t>(trace.encode_ms * 1000.0f);
+				}
+				else
+				{
+					failed_frames++;
+				}
+				std::filesystem::remove(path);
+			};
+			queue.submit(std::move(job));
+		}
+	}
+
+	const double capture_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	queue.stop();
+	const double drain_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - capture_s;
+
+	const capture_queue::stats stats = queue.get_stats();
+	const uint64_t written = written_frames.load();
+	const double captured = static_cast<double>(offered) / 2;
+
+	std::printf("\noffered %llu exports, written %llu, dropped %llu, failed %llu, late presents %llu\n", static_cast<unsigned long long>(offered),
+		static_cast<unsigned long long>(written), static_cast<unsigned long long>(stats.dropped_frames), static_cast<unsigned long long>(failed_frames.load()),
+		static_cast<unsigned long long>(late_frames));
+	std::printf("per captured frame: convert %.1f ms on the present thread, encode + write %.1f ms per export\n", convert_ms / captured,
+		written != 0 ? encode_us.load() / 1000.0 / written : 0.0);
+	std::printf("peak in flight %.0f MB, drained %.2f s after the last frame, %.1f MB/s written\n", stats.peak_bytes / (1024.0 * 1024.0), drain_s,
+		written_bytes.load() / (1024.0 * 1024.0) / (capture_s + drain_s));
+	const bool kept_up = stats.dropped_frames == 0 && failed_frames == 0 && late_frames == 0 && drain_s < 1.0;
+	std::printf("%s\n", kept_up ? "kept up" : "did NOT keep up");
+
+	return kept_up ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+/*
+ * Throughput and latency of the shared memory frame stream. A synthetic producer converts RGBA32F textures into the planes of
+ * depth and normal exports right inside the slots, like the add-on does, and a consumer process forked off reads every frame in place.
+ * Without a frame rate the producer runs as fast as it can, which shows how many frames the consumer loses to overwrites.
+ *
+ * Build: g++ -O2 -std=c++17 -I.. stream_bench.cpp -o stream_bench -lrt
+ * Usage: stream_bench [width height [slots [seconds [fps]]]]
+ */
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include "frame_stream.h"
+
+static const char *const stream_name = "FrameCaptureBench";
+
+struct consumer_result
+{
+	uint64_t received = 0, missed = 0, torn = 0;
+	uint64_t bytes = 0;
+	std::vector<uint32_t> seen_us, done_us;
+};
+
+static double percentile(std::vector<uint32_t> values, double p)
+{
+	if (values.empty())
+		return 0.0;
+	const size_t i = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+	std::nth_element(values.begin(), values.begin() + i, values.end());
+	return values[i];
+}
+
+static int run_consumer()
+{
+	frame_stream stream;
+	while (!stream.open(stream_name))
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	consumer_result result;
+	uint64_t next = 0;
+	double checksum = 0.0;
+	for (;;)
+	{
+		const uint64_t published = stream.published();
+		if (next >= published)
+		{
+			if (stream.closed())
+				break;
+			std::this_thread::yield();
+			continue;
+		}
+		if (published - next > stream.slot_count())
+		{
+			result.missed += published - stream.slot_count() - next;
+			next = published - stream.slot_count();
+		}
+
+		frame_stream_info info;
+		const unsigned char *data = nullptr;
+		if (!stream.read(next, info, data))
+		{
+			result.missed++;
+			next++;
+			continue;
+		}
+		const uint64_t seen = frame_stream_now();
+
+		// Stands in for the work of the consumer, every value of the frame is read once
+		const float *const values = reinterpret_cast<const float *>(data);
+		const size_t count = info.size / sizeof(float);
+		float sum = 0.0f;
+		for (size_t i = 0; i < count; ++i)
+			sum += values[i];
+
+		if (stream.still_valid(next))
+		{
+			const uint64_t done = frame_stream_now();
+			checksum += sum;
+			result.received++;
+			result.bytes += info.size;
+			result.seen_us.push_back(static_cast<uint32_t>(seen - info.timestamp));
+			result.done_us.push_back(static_cast<uint32_t>(done - info.timestamp));
+		}
+		else
+		{
+			result.torn++;
+		}
+		next++;
+	}
+
+	std::printf("consumer: %llu frames, %llu missed, %llu overwritten while read, %.1f MB (checksum %g)\n", static_cast<unsigned long long>(result.received),
+		static_cast<unsigned long long>(result.missed), static_cast<unsigned long long>(result.torn), result.bytes / (1024.0 * 1024.0), checksum);
+	std::printf("consumer: published to seen p50 %.0f us, p99 %.0f us, max %.0f us\n", percentile(result.seen_us, 0.5), percentile(result.seen_us, 0.99), percentile(result.seen_us, 1.0));
+	std::printf("consumer: published to processed p50 %.0f us, p99 %.0f us, max %.0f us\n", percentile(result.done_us, 0.5), percentile(result.done_us, 0.99), percentile(result.done_us, 1.0));
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const uint32_t width = argc > 2 ? std::atoi(argv[1]) : 1920;
+	const uint32_t height = argc > 2 ? std::atoi(argv[2]) : 1080;
+	const uint32_t slots = argc > 3 ? std::atoi(argv[3]) : 4;
+	const double seconds = argc > 4 ? std::atof(argv[4]) : 5.0;
+	const double fps = argc > 5 ? std::atof(argv[5]) : 0.0;
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+
+	if (slots == 0)
+		return 2;
+
+	// The consumer waits until the stream exists, just like it would wait for the add-on
+	const pid_t consumer = fork();
+	if (consumer == 0)
+		return run_consumer();
+
+	frame_stream stream;
+	if (!stream.create(stream_name, slots, num_pixels * 3 * sizeof(float)))
+	{
+		std::fprintf(stderr, "Failed to create the stream\n");
+		kill(consumer, SIGTERM);
+		return 1;
+	}
+
+	// A few export textures to cycle through, normals in RGB and depth in alpha like the export shader writes them
+	std::vector<std::vector<float>> textures(4, std::vector<float>(num_pixels * 4));
+	for (size_t t = 0; t < textures.size(); ++t)
+		for (size_t i = 0; i < num_pixels; ++i)
+			for (int c = 0; c < 4; ++c)
+				textures[t][i * 4 + c] = static_cast<float>((i * (c + 3) + t * 7919) % 4096) / 4096.0f;
+
+	uint64_t frames = 0, bytes = 0;
+	double convert_seconds = 0.0;
+	const auto start = std::chrono::steady_clock::now();
+	for (;; ++frames)
+	{
+		const auto frame_start = std::chrono::steady_clock::now();
+		if (std::chrono::duration<double>(frame_start - start).count() >= seconds)
+			break;
+
+		const bool depth = frames % 2 == 0;
+		frame_stream_info info;
+		info.frame_index = frames / 2;
+		info.width = width;
+		info.height = height;
+		info.channels = depth ? 1 : 3;
+		info.format = frame_stream_format::float_planes;
+		info.pass = depth ? frame_stream_pass::depth : frame_stream_pass::normal;
+		info.size = num_pixels * info.channels * sizeof(float);
+
+		float *const planes = reinterpret_cast<float *>(stream.begin_write(info));
+		const float *const src = textures[(frames / 2) % textures.size()].data();
+		if (depth)
+		{
+			for (size_t i = 0; i < num_pixels; ++i)
+				planes[i] = src[i * 4 + 3];
+		}
+		else
+		{
+			for (size_t i = 0; i < num_pixels; ++i)
+			{
+				planes[i] = src[i * 4 + 2];
+				planes[num_pixels + i] = src[i * 4 + 1];
+				planes[num_pixels * 2 + i] = src[i * 4 + 0];
+			}
+		}
+		stream.end_write(frame_stream_now());
+		bytes += info.size;
+		convert_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - frame_start).count();
+
+		// The rate counts frames of the game, each has a depth and a normal export
+		if (fps > 0.0 && !depth)
+			std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((frames / 2 + 1) / fps)));
+	}
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stream.close();
+
+	std::printf("producer: %llu exports of %ux%u into %u slots in %.2f s, %.2f ms per export, %.2f GB/s written\n", static_cast<unsigned long long>(frames), width, height, slots, elapsed,
+		frames != 0 ? convert_seconds * 1000.0 / frames : 0.0, bytes / elapsed / 1e9);
+	std::fflush(stdout);
+
+	int status = 0;
+	waitpid(consumer, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
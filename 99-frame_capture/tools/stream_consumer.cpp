@@ -0,0 +1,90 @@
+/*
+ * Sample consumer of the shared memory frame stream: follows the frames the add-on publishes and prints what arrives,
+ * reading every frame in place. A starting point for feeding the frames to another pipeline without files.
+ *
+ * Build: g++ -O2 -std=c++17 -I.. stream_consumer.cpp -o stream_consumer -lrt
+ * Usage: stream_consumer [name [frames]]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "frame_stream.h"
+
+static const char *pass_names[] = { "back buffer", "depth", "normal" };
+
+int main(int argc, char *argv[])
+{
+	const char *const name = argc > 1 ? argv[1] : "FrameCapture";
+	const uint64_t max_frames = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0;
+
+	frame_stream stream;
+	uint64_t next = 0, received = 0, missed = 0;
+	while (max_frames == 0 || received < max_frames)
+	{
+		if (!stream.is_open() || stream.closed())
+		{
+			// Waits for the producer, which creates the stream when a recording starts
+			if (!stream.open(name))
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				continue;
+			}
+			next = stream.published();
+			std::printf("opened %s, %u slots of %.1f MB\n", name, stream.slot_count(), stream.slot_capacity() / (1024.0 * 1024.0));
+		}
+
+		const uint64_t published = stream.published();
+		if (next >= published)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			continue;
+		}
+		// Frames the producer already wrote over are gone
+		if (published - next > stream.slot_count())
+		{
+			missed += published - stream.slot_count() - next;
+			next = published - stream.slot_count();
+		}
+
+		frame_stream_info info;
+		const unsigned char *data = nullptr;
+		if (stream.read(next, info, data))
+		{
+			// The work on the frame happens in place, here only the range of the first channel
+			float lo = 0.0f, hi = 0.0f;
+			if (info.format == frame_stream_format::float_planes)
+			{
+				const float *const values = reinterpret_cast<const float *>(data);
+				const size_t count = static_cast<size_t>(info.width) * info.height;
+				lo = hi = values[0];
+				for (size_t i = 1; i < count; ++i)
+				{
+					lo = std::min(lo, values[i]);
+					hi = std::max(hi, values[i]);
+				}
+			}
+
+			if (stream.still_valid(next))
+			{
+				received++;
+				std::printf("frame %6llu %-11s %ux%u x%u  range %g .. %g  %.2f ms after publishing\n", static_cast<unsigned long long>(info.frame_index),
+					pass_names[std::min(static_cast<uint32_t>(info.pass), 2u)], info.width, info.height, info.channels, lo, hi, (frame_stream_now() - info.timestamp) / 1000.0);
+			}
+			else
+			{
+				missed++;
+			}
+		}
+		else
+		{
+			missed++;
+		}
+		next++;
+	}
+
+	std::printf("%llu frames received, %llu missed\n", static_cast<unsigned long long>(received), static_cast<unsigned long long>(missed));
+	return 0;
+}
@@ -524,6 +524,27 @@ extern size_t SaveEXRMultipartImageToMemory(const EXRImage *images,
                                             const EXRHeader **exr_headers,
                                             unsigned int num_parts,
                                             unsigned char **memory, const char **err);
+
+// Allocator for the buffers of the encoder (TinyEXR extension).
+// `scratch` is 1 for short-lived per-chunk buffers, which are mostly released
+// in reverse order of allocation, and 0 for the encoded chunk data and the
+// output memory that live until the encode has finished.
+// `deallocate` may also receive pointers that were allocated with malloc().
+typedef struct _EXRAllocator {
+  void *(*allocate)(void *userdata, size_t size, int scratch);
+  void (*deallocate)(void *userdata, void *ptr, int scratch);
+  void *userdata;
+} EXRAllocator;
+
+// Routes the allocations of SaveEXRImageToMemory/SaveEXRImageToFile and
+// friends made on the calling thread through `allocator` (copied), NULL
+// restores malloc/free. While it is set, memory returned by the Save*ToMemory
+// functions must be released with FreeEXREncodeMemory() instead of free().
+// Encoder threads started with TINYEXR_USE_THREAD keep using malloc/free.
+extern void SetEXREncodeAllocator(const EXRAllocator *allocator);
+
+// Releases memory returned by the Save*ToMemory functions.
+extern void FreeEXREncodeMemory(unsigned char *memory);
 // Loads single-frame OpenEXR deep image.
 // Application must free memory of variables in DeepImage(image, offset_table)
 // Returns negative value and may set error string in `err` when there's an
@@ -590,6 +611,7 @@ extern int LoadEXRFromMemory(float **out_rgba, int *width, int *height,
 // #include <iostream> // debug
 
 #include <limits>
+#include <new>
 #include <string>
 #include <vector>
 #include <set>
@@ -685,6 +707,58 @@ static void SetWarningMessage(const std::string &msg, const char **warn) {
 
 static const int kEXRVersionSize = 8;
 
+#if TINYEXR_HAS_CXX11
+static thread_local EXRAllocator encode_allocator = {NULL, NULL, NULL};
+#else
+static EXRAllocator encode_allocator = {NULL, NULL, NULL};
+#endif
+
+static void *AllocateEncodeMemory(size_t size, int scratch) {
+  if (encode_allocator.allocate) {
+    return encode_allocator.allocate(encode_allocator.userdata, size, scratch);
+  }
+  return malloc(size);
+}
+
+static void DeallocateEncodeMemory(void *ptr, int scratch) {
+  if (encode_allocator.deallocate) {
+    encode_allocator.deallocate(encode_allocator.userdata, ptr, scratch);
+  } else {
+    free(ptr);
+  }
+}
+
+// Stateless STL allocator on top of the current encode allocator.
+template <typename T, int Scratch>
+struct EncodeAllocator {
+  typedef T value_type;
+  template <typename U>
+  struct rebind {
+    typedef EncodeAllocator<U, Scratch> other;
+  };
+
+  EncodeAllocator() {}
+  template <typename U>
+  EncodeAllocator(const EncodeAllocator<U, Scratch> &) {}
+
+  T *allocate(size_t n) {
+    void *ptr = AllocateEncodeMemory(n * sizeof(T), Scratch);
+    if (!ptr) throw std::bad_alloc();
+    return static_cast<T *>(ptr);
+  }
+  void deallocate(T *ptr, size_t) { DeallocateEncodeMemory(ptr, Scratch); }
+
+  bool operator==(const EncodeAllocator &) const { return true; }
+  bool operator!=(const EncodeAllocator &) const { return false; }
+};
+
+// Per-chunk temporaries.
+typedef std::vector<unsigned char, EncodeAllocator<unsigned char, 1> >
+    ScratchBuffer;
+// Encoded chunk data.
+typedef std::vector<unsigned char, EncodeAllocator<unsigned char, 0> >
+    ChunkBuffer;
+
 static void cpy2(unsigned short *dst_val, const unsigned short *src_val) {
   unsigned char *dst = reinterpret_cast<unsigned char *>(dst_val);
   const unsigned char *src = reinterpret_cast<const unsigned char *>(src_val);
@@ -1222,7 +1296,7 @@ static void WriteChannelInfo(std::vector<unsigned char> &data,
 static void CompressZip(unsigned char *dst,
                         tinyexr::tinyexr_uint64 &compressedSize,
                         const unsigned char *src, unsigned long src_size) {
-  std::vector<unsigned char> tmpBuf(src_size);
+  ScratchBuffer tmpBuf(src_size);
 
   //
   // Apply EXR-specific? postprocess. Grabbed from OpenEXR's
@@ -1487,7 +1561,7 @@ static int rleUncompress(int inLength, int maxLength, const signed char in[],
 static void CompressRle(unsigned char *dst,
                         tinyexr::tinyexr_uint64 &compressedSize,
                         const unsigned char *src, unsigned long src_size) {
-  std::vector<unsigned char> tmpBuf(src_size);
+  ScratchBuffer tmpBuf(src_size);
 
   //
   // Apply EXR-specific? postprocess. Grabbed from OpenEXR's
@@ -6413,9 +6487,35 @@ int LoadEXRImageFromMemory(EXRImage *exr_image, const EXRHeader *exr_header,
 namespace tinyexr
 {
 
+// Copies `num_lines` rows of a channel whose input and output pixel types are
+// identical into the block buffer. EXR stores little-endian data, so on
+// little-endian hosts every row is a single memcpy; the per-element swap is
+// only needed on big-endian hosts. Shared by the scanline and tiled encoders.
+static void CopyChannelLines(unsigned char *dst, size_t dst_line_stride,
+                             const unsigned char *src, size_t src_line_stride,
+                             int width, int num_lines, size_t element_size) {
+  const size_t line_bytes = static_cast<size_t>(width) * element_size;
+#if TINYEXR_LITTLE_ENDIAN
+  for (int y = 0; y < num_lines; y++) {
+    memcpy(dst + static_cast<size_t>(y) * dst_line_stride,
+           src + static_cast<size_t>(y) * src_line_stride, line_bytes);
+  }
+#else
+  for (int y = 0; y < num_lines; y++) {
+    unsigned char *d = dst + static_cast<size_t>(y) * dst_line_stride;
+    const unsigned char *s = src + static_cast<size_t>(y) * src_line_stride;
+    for (size_t x = 0; x < line_bytes; x += element_size) {
+      for (size_t b = 0; b < element_size; b++) {
+        d[x + b] = s[x + element_size - 1 - b];
+      }
+    }
+  }
+#endif
+}
+
 // out_data must be allocated initially with the block-header size
 // of the current image(-part) type
-static bool EncodePixelData(/* out */ std::vector<unsigned char>& out_data,                         
+static bool EncodePixelData(/* out */ ChunkBuffer& out_data,                         
                             const unsigned char* const* images,
                             int compression_type,
                             int /*line_order*/,
@@ -6435,18 +6535,37 @@ static bool EncodePixelData(/* out */ std::vector<unsigned char>& out_data,
   //int last2bit = (buf_size & 3);
   // buf_size must be multiple of four
   //if(last2bit) buf_size += 4 - last2bit;
-  std::vector<unsigned char> buf(buf_size);
+  ScratchBuffer buf(buf_size);
+
+  // Every scanline of the block holds all channels one after another, so the
+  // rows of one channel are `line_stride` bytes apart in `buf`.
+  const size_t line_stride = pixel_data_size * static_cast<size_t>(width);
 
   size_t start_y = static_cast<size_t>(line_no);
   for (size_t c = 0; c < channels.size(); c++) {
+    unsigned char *channel_ptr =
+        buf.data() + channel_offset_list[c] * static_cast<size_t>(width);
+
+    if (channels[c].pixel_type == channels[c].requested_pixel_type) {
+      // HALF -> HALF, FLOAT -> FLOAT and UINT -> UINT are plain row copies.
+      const size_t element_size =
+          channels[c].pixel_type == TINYEXR_PIXELTYPE_HALF
+              ? sizeof(unsigned short)
+              : sizeof(unsigned int);
+      CopyChannelLines(channel_ptr, line_stride,
+                       images[c] + start_y * static_cast<size_t>(x_stride) *
+                                       element_size,
+                       static_cast<size_t>(x_stride) * element_size, width,
+                       num_lines, element_size);
+      continue;
+    }
+
     if (channels[c].pixel_type == TINYEXR_PIXELTYPE_HALF) {
       if (channels[c].requested_pixel_type == TINYEXR_PIXELTYPE_FLOAT) {
         for (int y = 0; y < num_lines; y++) {
           // Assume increasing Y
-          float *line_ptr = reinterpret_cast<float *>(&buf.at(
-            static_cast<size_t>(pixel_data_size * y * width) +
-            channel_offset_list[c] *
-            static_cast<size_t>(width)));
+          float *line_ptr = reinterpret_cast<float *>(
+            channel_ptr + static_cast<size_t>(y) * line_stride);
           for (int x = 0; x < width; x++) {
             tinyexr::FP16 h16;
             h16.u = reinterpret_cast<const unsigned short * const *>(
@@ -6460,24 +6579,6 @@ static bool EncodePixelData(/* out */ std::vector<unsigned char>& out_data,
             tinyexr::cpy4(line_ptr + x, &(f32.f));
           }
         }
-      } else if (channels[c].requested_pixel_type == TINYEXR_PIXELTYPE_HALF) {
-        for (int y = 0; y < num_lines; y++) {
-          // Assume increasing Y
-          unsigned short *line_ptr = reinterpret_cast<unsigned short *>(
-            &buf.at(static_cast<size_t>(pixel_data_size * y *
-                                        width) +
-                    channel_offset_list[c] *
-                    static_cast<size_t>(width)));
-          for (int x = 0; x < width; x++) {
-            unsigned short val = reinterpret_cast<const unsigned short * const *>(
-              images)[c][(y + start_y) * x_stride + x];
-
-            tinyexr::swap2(&val);
-
-            // line_ptr[x] = val;
-            tinyexr::cpy2(line_ptr + x, &val);
-          }
-        }
       } else {
         assert(0);
       }
@@ -6487,10 +6588,7 @@ static bool EncodePixelData(/* out */ std::vector<unsigned char>& out_data,
         for (int y = 0; y < num_lines; y++) {
           // Assume increasing Y
           unsigned short *line_ptr = reinterpret_cast<unsigned short *>(
-            &buf.at(static_cast<size_t>(pixel_data_size * y *
-                                        width) +
-                    channel_offset_list[c] *
-                    static_cast<size_t>(width)));
+            channel_ptr + static_cast<size_t>(y) * line_stride);
           for (int x = 0; x < width; x++) {
             tinyexr::FP32 f32;
             f32.f = reinterpret_cast<const float * const *>(
@@ -6505,42 +6603,12 @@ static bool EncodePixelData(/* out */ std::vector<unsigned char>& out_data,
             tinyexr::cpy2(line_ptr + x, &(h16.u));
           }
         }
-      } else if (channels[c].requested_pixel_type == TINYEXR_PIXELTYPE_FLOAT) {
-        for (int y = 0; y < num_lines; y++) {
-          // Assume increasing Y
-          float *line_ptr = reinterpret_cast<float *>(&buf.at(
-            static_cast<size_t>(pixel_data_size * y * width) +
-            channel_offset_list[c] *
-            static_cast<size_t>(width)));
-          for (int x = 0; x < width; x++) {
-            float val = reinterpret_cast<const float * const *>(
-              images)[c][(y + start_y) * x_stride + x];
-
-            tinyexr::swap4(&val);
-
-            // line_ptr[x] = val;
-            tinyexr::cpy4(line_ptr + x, &val);
-          }
-        }
       } else {
         assert(0);
       }
-    } else if (channels[c].pixel_type == TINYEXR_PIXELTYPE_UINT) {
-      for (int y = 0; y < num_lines; y++) {
-        // Assume increasing Y
-        unsigned int *line_ptr = reinterpret_cast<unsigned int *>(&buf.at(
-          static_cast<size_t>(pixel_data_size * y * width) +
-          channel_offset_list[c] * static_cast<size_t>(width)));
-        for (int x = 0; x < width; x++) {
-          unsigned int val = reinterpret_cast<const unsigned int * const *>(
-            images)[c][(y + start_y) * x_stride + x];
-
-          tinyexr::swap4(&val);
-
-          // line_ptr[x] = val;
-          tinyexr::cpy4(line_ptr + x, &val);
-        }
-      }
+    } else {
+      // UINT can only be stored as UINT, which is handled above.
+      assert(0);
     }
   }
 
@@ -6553,10 +6621,10 @@ static bool EncodePixelData(/* out */ std::vector<unsigned char>& out_data,
   } else if ((compression_type == TINYEXR_COMPRESSIONTYPE_ZIPS) ||
     (compression_type == TINYEXR_COMPRESSIONTYPE_ZIP)) {
 #if TINYEXR_USE_MINIZ
-    std::vector<unsigned char> block(mz_compressBound(
+    ScratchBuffer block(mz_compressBound(
       static_cast<unsigned long>(buf.size())));
 #else
-    std::vector<unsigned char> block(
+    ScratchBuffer block(
       compressBound(static_cast<uLong>(buf.size())));
 #endif
     tinyexr::tinyexr_uint64 outSize = block.size();
@@ -6574,7 +6642,7 @@ static bool EncodePixelData(/* out */ std::vector<unsigned char>& out_data,
 
   } else if (compression_type == TINYEXR_COMPRESSIONTYPE_RLE) {
     // (buf.size() * 3) / 2 would be enough.
-    std::vector<unsigned char> block((buf.size() * 3) / 2);
+    ScratchBuffer block((buf.size() * 3) / 2);
 
     tinyexr::tinyexr_uint64 outSize = block.size();
 
@@ -6594,7 +6662,7 @@ static bool EncodePixelData(/* out */ std::vector<unsigned char>& out_data,
       8192 + static_cast<unsigned int>(
         2 * static_cast<unsigned int>(
           buf.size()));  // @fixme { compute good bound. }
-    std::vector<unsigned char> block(bufLen);
+    ScratchBuffer block(bufLen);
     unsigned int outSize = static_cast<unsigned int>(block.size());
 
     CompressPiz(&block.at(0), &outSize,
@@ -6640,7 +6708,7 @@ static bool EncodePixelData(/* out */ std::vector<unsigned char>& out_data,
 
 static int EncodeTiledLevel(const EXRImage* level_image, const EXRHeader* exr_header,
                             const std::vector<tinyexr::ChannelInfo>& channels,
-                            std::vector<std::vector<unsigned char> >& data_list,
+                            std::vector<ChunkBuffer>& data_list,
                             size_t start_index, // for data_list
                             int num_x_tiles, int num_y_tiles,
                             const std::vector<size_t>& channel_offset_list,
@@ -6772,7 +6840,7 @@ static int EncodeChunk(const EXRImage* exr_image, const EXRHeader* exr_header,
                        tinyexr_uint64 chunk_offset, // starting offset of current chunk
                        bool is_multipart,
                        OffsetData& offset_data, // output block offsets, must be initialized
-                       std::vector<std::vector<unsigned char> >& data_list, // output
+                       std::vector<ChunkBuffer>& data_list, // output
                        tinyexr_uint64& total_size, // output: ending offset of current chunk
                        std::string* err) {
   int num_scanlines = NumScanlines(exr_header->compression_type);
@@ -7234,7 +7302,7 @@ static size_t SaveEXRNPartImageToMemory(const EXRImage* exr_images,
   tinyexr_uint64 chunk_offset = memory.size() + size_t(total_chunk_count) * sizeof(tinyexr_uint64);
 
   tinyexr_uint64 total_size = 0;
-  std::vector< std::vector< std::vector<unsigned char> > > data_lists(num_parts);
+  std::vector< std::vector<ChunkBuffer> > data_lists(num_parts);
   for (unsigned int i = 0; i < num_parts; ++i) {
     std::string e;
     int ret = EncodeChunk(&exr_images[i], exr_headers[i],
@@ -7261,7 +7329,11 @@ static size_t SaveEXRNPartImageToMemory(const EXRImage* exr_images,
     tinyexr::SetErrorMessage("Output memory size is zero", err);
     return 0;
   }
-  (*memory_out) = static_cast<unsigned char*>(malloc(total_size));
+  (*memory_out) = static_cast<unsigned char*>(AllocateEncodeMemory(total_size, 0));
+  if (!(*memory_out)) {
+    tinyexr::SetErrorMessage("Failed to allocate output memory", err);
+    return 0;
+  }
 
   // Writing header
   memcpy((*memory_out), &memory[0], memory.size());
@@ -7319,6 +7391,22 @@ static size_t SaveEXRNPartImageToMemory(const EXRImage* exr_images,
 
 } // tinyexr
 
+void SetEXREncodeAllocator(const EXRAllocator *allocator) {
+  if (allocator) {
+    tinyexr::encode_allocator = *allocator;
+  } else {
+    tinyexr::encode_allocator.allocate = NULL;
+    tinyexr::encode_allocator.deallocate = NULL;
+    tinyexr::encode_allocator.userdata = NULL;
+  }
+}
+
+void FreeEXREncodeMemory(unsigned char *memory) {
+  if (memory) {
+    tinyexr::DeallocateEncodeMemory(memory, 0);
+  }
+}
+
 size_t SaveEXRImageToMemory(const EXRImage* exr_image,
                              const EXRHeader* exr_header,
                              unsigned char** memory_out, const char** err) {
@@ -7382,7 +7470,7 @@ int SaveEXRImageToFile(const EXRImage *exr_image, const EXRHeader *exr_header,
   if ((mem_size > 0) && mem) {
     written_size = fwrite(mem, 1, mem_size, fp);
   }
-  free(mem);
+  FreeEXREncodeMemory(mem);
 
   fclose(fp);
 
@@ -7451,7 +7539,7 @@ int SaveEXRMultipartImageToFile(const EXRImage* exr_images,
   if ((mem_size > 0) && mem) {
     written_size = fwrite(mem, 1, mem_size, fp);
   }
-  free(mem);
+  FreeEXREncodeMemory(mem);
 
   fclose(fp);
 